@@ -0,0 +1,38 @@
+# Turns every file under SHADER_DIR into a constant C array, plus the EMBEDDED_SHADERS lookup table.
+# Usage: cmake -DSHADER_DIR=<dir> -DOUTPUT=<file.c> -P embed_shaders.cmake
+
+file(GLOB_RECURSE SHADER_FILES RELATIVE "${SHADER_DIR}" "${SHADER_DIR}/*")
+list(SORT SHADER_FILES)
+
+# CMake regexes have no {n} repetition, so spell out a row of 16 bytes.
+string(REPEAT "0x..," 16 ROW)
+
+set(ARRAYS "")
+set(TABLE "")
+set(INDEX 0)
+foreach (NAME ${SHADER_FILES})
+    file(READ "${SHADER_DIR}/${NAME}" HEX HEX)
+    file(SIZE "${SHADER_DIR}/${NAME}" SIZE)
+
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX}")
+    string(REGEX REPLACE "(${ROW})" "\\1\n    " BYTES "${BYTES}")
+
+    # A trailing zero keeps the data usable as a C string, it is not counted in the size.
+    string(APPEND ARRAYS "static const unsigned char shader_${INDEX}[] = {\n    ${BYTES}0x00\n};\n\n")
+    string(APPEND TABLE "    {\"${NAME}\", (const char*) shader_${INDEX}, ${SIZE}},\n")
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach ()
+
+set(CONTENT "// Generated by cmake/embed_shaders.cmake from ${SHADER_DIR}, do not edit.\n\n")
+string(APPEND CONTENT "#include \"shader.h\"\n\n")
+string(APPEND CONTENT "${ARRAYS}")
+string(APPEND CONTENT "const EmbeddedFile EMBEDDED_SHADERS[] = {\n${TABLE}};\n\n")
+string(APPEND CONTENT "const size_t EMBEDDED_SHADER_COUNT = ${INDEX};\n")
+
+# Only touch the output when something changed, so dependents are not rebuilt needlessly.
+if (EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" OLD_CONTENT)
+endif ()
+if (NOT "${OLD_CONTENT}" STREQUAL "${CONTENT}")
+    file(WRITE "${OUTPUT}" "${CONTENT}")
+endif ()
@@ -0,0 +1,56 @@
+//
+// Created by marios on 3/11/26.
+//
+
+#ifndef BC_ENCODE_H
+#define BC_ENCODE_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * CPU encoder for the GPU block compression formats. Every format stores 4x4 texel blocks:
+ * BC1 (RGB, 8 bytes), BC3 (RGBA, 16 bytes), BC7 (RGBA, 16 bytes) and BC6H (unsigned float RGB, 16 bytes).
+ * BC7 is always written in mode 6 and BC6H in mode 11, the single partition modes with the widest endpoints.
+ */
+
+typedef enum {
+    BC_FORMAT_BC1,
+    BC_FORMAT_BC3,
+    BC_FORMAT_BC6H,
+    BC_FORMAT_BC7,
+} BcFormat;
+
+typedef enum {
+    BC_QUALITY_FAST, // principal axis endpoints
+    BC_QUALITY_HIGH, // plus least squares refinement of the endpoints against the chosen indices
+} BcQuality;
+
+size_t bc_block_size(BcFormat format);
+
+/**
+ * @return The bytes of a width x height image, partial blocks at the right and bottom edge count as whole blocks.
+ */
+size_t bc_image_size(BcFormat format, int width, int height);
+
+/**
+ * @return true for BC6H, whose input and decoded output are float RGB instead of 8 bit RGBA.
+ */
+bool bc_format_is_hdr(BcFormat format);
+
+const char* bc_format_name(BcFormat format);
+
+/**
+ * Encodes an image, block rows are spread over the shared thread pool. Blocks overhanging the image edge
+ * repeat the last row and column.
+ * @param pixels width * height texels, RGBA8 or float RGB for BC6H.
+ * @param out bc_image_size(format, width, height) bytes.
+ */
+void bc_encode_image(BcFormat format, BcQuality quality, const void* pixels, int width, int height, void* out);
+
+/**
+ * Decodes an image written by bc_encode_image, only the modes the encoder emits are understood for BC6H and BC7.
+ * @param out width * height texels, RGBA8 or float RGB for BC6H.
+ */
+void bc_decode_image(BcFormat format, const void* blocks, int width, int height, void* out);
+
+#endif //BC_ENCODE_H
@@ -6,7 +6,7 @@
 #define CAMERA_H
 #include <cglm/cglm.h>
 
-#include "shader.h"
+#include "frame_data.h"
 #include "GLFW/glfw3.h"
 
 typedef struct {
@@ -32,7 +32,10 @@ void camera_view_matrix(Camera camera, mat4 view);
 
 void camera_projection_matrix(Camera camera, float aspect_ratio, mat4 projection);
 
-void camera_to_shader(Camera camera, Shader shader, float aspect_ratio);
+/**
+ * Fills the camera part of the frame data: view, projection and their product, the camera position and basis, and the fov.
+ */
+void camera_frame_data(Camera camera, float aspect_ratio, FrameData* data);
 
 void camera_process_input(Camera* camera, GLFWwindow* window, float delta_time);
 
@@ -0,0 +1,58 @@
+//
+// Created by marios on 3/13/26.
+//
+
+#ifndef ENV_MAP_H
+#define ENV_MAP_H
+#include <stdbool.h>
+#include "mip_builder.h"
+
+/**
+ * Resampling of equirectangular environment maps into layouts that spread their texels evenly over the sphere.
+ * A cube map is sampled without trigonometry and filters seamlessly across faces, an octahedral map packs the
+ * whole sphere into one square 2D texture. Levels are float RGB with a prefiltered mip chain per face, built in
+ * parallel on the shared thread pool. shaders/common/env_map.glsl is the matching lookup.
+ */
+
+typedef enum {
+    ENV_MAP_EQUIRECT,   // the source layout, u follows atan(x, y) and v follows asin(z)
+    ENV_MAP_CUBE,       // six faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order
+    ENV_MAP_OCTAHEDRAL, // one square, the upper hemisphere in the center diamond
+    ENV_MAP_VIRTUAL,    // equirect tiles streamed by virtual_texture.h, never built here
+} EnvMapLayout;
+
+typedef struct {
+    EnvMapLayout layout;
+    int size;          // edge of a face or of the octahedral square, the width of an equirect map
+    int faceCount;     // 6 for cube maps, 1 otherwise
+    MipChain faces[6]; // level 0 of every face lives in storage
+    float* storage;
+} EnvMap;
+
+/**
+ * @return The edge that keeps about the texel density of an equirect map this wide along the equator.
+ */
+int env_map_default_size(EnvMapLayout layout, int equirectWidth);
+
+/**
+ * @return The define selecting the layout in env_map.glsl, empty for equirect maps.
+ */
+const char* env_map_define(EnvMapLayout layout);
+
+/**
+ * Resamples a float RGB equirect image with 2x2 supersampling and builds the mip chain of every face.
+ * ENV_MAP_EQUIRECT keeps the image as it is and only adds the mips. ENV_MAP_VIRTUAL is rejected, see vt_build_from_hdr.
+ * @param size The edge of the result, 0 for env_map_default_size. Ignored for equirect maps.
+ * @return false if out of memory or for ENV_MAP_VIRTUAL.
+ */
+bool env_map_from_equirect(const float* rgb, int width, int height, EnvMapLayout layout, int size, MipFilter filter,
+                           EnvMap* map);
+
+/**
+ * Loads an equirect HDR file and converts it, see env_map_from_equirect. Safe to call from a worker.
+ */
+bool env_map_load(const char* path, EnvMapLayout layout, int size, MipFilter filter, EnvMap* map);
+
+void env_map_free(EnvMap* map);
+
+#endif //ENV_MAP_H
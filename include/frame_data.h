@@ -0,0 +1,46 @@
+//
+// Created by marios on 2/15/26.
+//
+
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+#include <glad/glad.h>
+#include <cglm/cglm.h>
+
+/**
+ * The uniform buffer binding point of the FrameData block. Every program made by create_shader
+ * has its FrameData block bound here.
+ */
+#define FRAME_DATA_BINDING 0
+
+/**
+ * Per-frame values shared by all programs, laid out to match the std140 block
+ * declared in the shaders as "layout(std140) uniform FrameData { ... } frame;".
+ * vec3 members are padded to vec4.
+ */
+typedef struct {
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 cam_pos;
+    vec4 cam_x;
+    vec4 cam_y;
+    vec4 cam_z;
+    float time;
+    float fov;
+    vec2 resolution;
+} FrameData;
+
+/**
+ * Creates the FrameData uniform buffer and binds it to FRAME_DATA_BINDING.
+ */
+void frame_data_init();
+
+/**
+ * Uploads the data for the current frame. Call once per frame before drawing.
+ */
+void frame_data_update(const FrameData* data);
+
+void frame_data_delete();
+
+#endif //FRAME_DATA_H
@@ -0,0 +1,77 @@
+//
+// Created by marios on 2/20/26.
+//
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+#include <stdbool.h>
+#include <glad/glad.h>
+
+/**
+ * Shadow copy of the GL state the library touches. Every gl_state_* call compares against the shadow
+ * and only reaches the driver when the state would actually change. State changed behind the tracker's
+ * back (raw gl* calls) makes the shadow stale, call gl_state_reset afterwards.
+ */
+
+typedef struct {
+    unsigned long issued;  // calls that reached the driver
+    unsigned long skipped; // calls dropped because nothing would have changed
+} GLStateStats;
+
+#define GL_STATE_MAX_TEXTURE_UNITS 32
+
+void gl_state_use_program(GLuint program);
+
+/**
+ * Binds a program pipeline. Also unbinds the current program, as a program made current
+ * with glUseProgram takes precedence over the pipeline.
+ */
+void gl_state_bind_program_pipeline(GLuint pipeline);
+
+/**
+ * glUseProgramStages for GL_VERTEX_SHADER_BIT and/or GL_FRAGMENT_SHADER_BIT.
+ */
+void gl_state_use_program_stages(GLuint pipeline, GLbitfield stages, GLuint program);
+
+void gl_state_bind_vertex_array(GLuint vao);
+
+/**
+ * Binds a texture to the currently active unit, like glBindTexture. Binds that are skipped as redundant still count
+ * as a use for texture_residency, as do those of gl_state_bind_texture_unit.
+ */
+void gl_state_bind_texture(GLenum target, GLuint texture);
+
+void gl_state_active_texture(GLuint unit);
+
+/**
+ * Makes the unit active and binds the texture to it.
+ * @param unit The unit index, starting at 0 (not GL_TEXTURE0).
+ */
+void gl_state_bind_texture_unit(GLuint unit, GLenum target, GLuint texture);
+
+void gl_state_enable(GLenum cap);
+void gl_state_disable(GLenum cap);
+
+/**
+ * Drops the shadow of deleted objects, so a recycled name is not mistaken for the old binding.
+ * Forgetting a texture also stops its texture_residency accounting.
+ */
+void gl_state_forget_program(GLuint program);
+void gl_state_forget_program_pipeline(GLuint pipeline);
+void gl_state_forget_vertex_array(GLuint vao);
+void gl_state_forget_texture(GLuint texture);
+
+/**
+ * Forgets everything, the next call of each kind goes to the driver.
+ */
+void gl_state_reset();
+
+/**
+ * Counts a call made elsewhere, e.g. uniform writes filtered by the shader uniform cache.
+ */
+void gl_state_count(bool issued);
+
+GLStateStats gl_state_stats();
+void gl_state_stats_reset();
+
+#endif //GL_STATE_H
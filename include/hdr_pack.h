@@ -0,0 +1,67 @@
+//
+// Created by marios on 3/6/26.
+//
+
+#ifndef HDR_PACK_H
+#define HDR_PACK_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <glad/glad.h>
+
+/**
+ * Conversion of float RGB images into the compact HDR texture formats:
+ *  GL_RGB9_E5          4 bytes, 9 bit mantissas with a shared 5 bit exponent
+ *  GL_R11F_G11F_B10F   4 bytes, unsigned 11/11/10 bit floats
+ *  GL_RGBA16F          8 bytes, half floats with alpha 1
+ *  GL_RGB32F          12 bytes, copied as is
+ * Negative and NaN components become 0, values above the format's range are clamped to its maximum.
+ * The kernels are picked at runtime from the instruction sets of the CPU.
+ */
+
+typedef enum {
+    HDR_PACK_SCALAR,
+    HDR_PACK_SSE2,
+    HDR_PACK_AVX2,
+} HdrPackLevel;
+
+/**
+ * @return The kernels in use, the best the CPU supports unless hdr_pack_set_level lowered it.
+ */
+HdrPackLevel hdr_pack_level();
+
+/**
+ * Forces a kernel level, for benchmarks and comparisons. Levels the CPU lacks fall back to the best supported one.
+ */
+void hdr_pack_set_level(HdrPackLevel level);
+
+const char* hdr_pack_level_name(HdrPackLevel level);
+
+/**
+ * @return true if internalFormat is one of the formats above.
+ */
+bool hdr_pack_supported(GLenum internalFormat);
+
+size_t hdr_pack_texel_size(GLenum internalFormat);
+
+/**
+ * The format and type to pass to glTexImage2D along with the packed data.
+ */
+void hdr_pack_upload_format(GLenum internalFormat, GLenum* format, GLenum* type);
+
+const char* hdr_pack_format_name(GLenum internalFormat);
+
+/**
+ * Packs count RGB float texels into out, which must hold count * hdr_pack_texel_size(internalFormat) bytes.
+ * out may be a mapped buffer, it is only written sequentially.
+ */
+void hdr_pack(GLenum internalFormat, const float* rgb, void* out, size_t count);
+
+/**
+ * Single value half float conversion with the clamping rules above, the sign bit of the result is always clear.
+ */
+uint16_t hdr_half_from_float(float x);
+
+float hdr_half_to_float(uint16_t h);
+
+#endif //HDR_PACK_H
@@ -0,0 +1,38 @@
+//
+// Created by marios on 3/9/26.
+//
+
+#ifndef HDR_READER_H
+#define HDR_READER_H
+#include <stdbool.h>
+#include <glad/glad.h>
+
+/**
+ * Scanline decoder for Radiance .hdr (RGBE) files, flat or run length encoded. Rows are decoded one at a time
+ * and packed straight into the caller's memory, so only a single row is ever held in float form.
+ * Only the standard "-Y height +X width" orientation is supported, rows come out top to bottom like stbi_loadf.
+ */
+
+typedef struct HdrReader HdrReader;
+
+/**
+ * Opens the file and parses its header.
+ * @return The reader, or NULL if the file is missing or not a supported Radiance file.
+ */
+HdrReader* hdr_reader_open(const char* path);
+
+int hdr_reader_width(const HdrReader* reader);
+
+int hdr_reader_height(const HdrReader* reader);
+
+/**
+ * Decodes the next rows and packs them with hdr_pack.
+ * @param internalFormat One of the hdr_pack formats.
+ * @param out rows * width texels of the packed format, rows are written back to back.
+ * @return false on a truncated or corrupt file.
+ */
+bool hdr_reader_read_rows(HdrReader* reader, GLenum internalFormat, void* out, int rows);
+
+void hdr_reader_close(HdrReader* reader);
+
+#endif //HDR_READER_H
@@ -0,0 +1,70 @@
+//
+// Created by marios on 3/11/26.
+//
+
+#ifndef KTX2_H
+#define KTX2_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <glad/glad.h>
+#include "bc_encode.h"
+
+/**
+ * KTX 2.0 container for single 2D block compressed textures with a mip chain, no supercompression.
+ * https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+ */
+
+#define KTX2_MAX_LEVELS 16
+
+// S3TC is an extension, the loader only declares core enums.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+typedef struct {
+    uint32_t vkFormat;
+    int width;
+    int height;
+    int levelCount;
+    const unsigned char* levels[KTX2_MAX_LEVELS]; // level 0 is the full size image
+    size_t levelSizes[KTX2_MAX_LEVELS];
+    unsigned char* data; // the whole file, the level pointers point into it
+} Ktx2Texture;
+
+/**
+ * @return The VkFormat of the block format, used as the format identifier of the file.
+ */
+uint32_t ktx2_vk_format(BcFormat format, bool srgb);
+
+/**
+ * @return The matching compressed GL internal format, or 0 for formats this loader does not know.
+ */
+GLenum ktx2_gl_format(uint32_t vkFormat);
+
+/**
+ * @return true if the file starts with the KTX 2.0 identifier.
+ */
+bool ktx2_is_file(const char* path);
+
+/**
+ * @param levels levelCount images from the full size one down, each bc_image_size of its level.
+ * @return false if the file could not be written.
+ */
+bool ktx2_write(const char* path, BcFormat format, bool srgb, int width, int height, int levelCount,
+                const void* const* levels);
+
+/**
+ * Reads and validates a whole file, free it with ktx2_free.
+ * @return false if the file is missing, corrupt or uses features outside the subset above.
+ */
+bool ktx2_read(const char* path, Ktx2Texture* texture);
+
+void ktx2_free(Ktx2Texture* texture);
+
+#endif //KTX2_H
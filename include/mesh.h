@@ -10,6 +10,11 @@
 
 #include "shader.h"
 
+/**
+ * The shader storage binding point of the per-instance matrices read by mesh_draw_instanced shaders.
+ */
+#define INSTANCE_DATA_BINDING 1
+
 typedef struct {
     vec3 position;
     versor orientation; //quaternion
@@ -20,7 +25,8 @@ typedef struct {
     GLuint vao;
     GLuint vbo;
     GLuint ebo;
-    GLsizei indices;
+    GLsizei indices;  // size of the index buffer in bytes
+    GLsizei vertices; // drawn by mesh_draw_instanced when there are no indices
 } Mesh;
 
 typedef struct {
@@ -43,6 +49,20 @@ void mesh_bind(Mesh mesh);
 
 void mesh_destroy(Mesh *m);
 
+/**
+ * Draws one instance of the mesh per model with a single instanced draw call. The model matrices are streamed
+ * into a shader storage buffer bound to INSTANCE_DATA_BINDING, which the vertex shader indexes with
+ * gl_InstanceID instead of reading the "model" uniform, see the INSTANCED variant of vertex_shader.vert.
+ * The shader must be in use.
+ * @param count The number of models.
+ */
+void mesh_draw_instanced(Mesh mesh, const Model* models, int count);
+
+/**
+ * Frees the instance buffer of mesh_draw_instanced.
+ */
+void mesh_instance_data_delete();
+
 Model model_init(float x, float y, float z);
 
 void model_translate(Model *m, float x, float y, float z);
@@ -57,6 +77,8 @@ void model_add_rotation_deg(Model *m, float deg, float x, float y, float z);
 
 void model_scale(Model *m, float x, float y, float z);
 
+void model_to_matrix(Model m, mat4 dest);
+
 void model_to_shader(Model m, Shader shader);
 
 Mesh shape_square();
@@ -0,0 +1,61 @@
+//
+// Created by marios on 3/12/26.
+//
+
+#ifndef MIP_BUILDER_H
+#define MIP_BUILDER_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * CPU mip chain generation, a replacement for glGenerateMipmap that filters 8 bit sRGB images in linear light,
+ * offers a sharper Kaiser windowed sinc filter and works for formats the GPU cannot render to, like RGB9_E5.
+ * Each level is filtered from the float result of the previous one, rows of a level are spread over the
+ * shared thread pool.
+ */
+
+#define MIP_MAX_LEVELS 16
+
+typedef enum {
+    MIP_FILTER_BOX,    // 2x2 average, what glGenerateMipmap does
+    MIP_FILTER_KAISER, // Kaiser windowed sinc over 8x8 texels, keeps detail without aliasing
+} MipFilter;
+
+typedef struct {
+    int channels;     // 1 to 4
+    bool hdr;         // float texels, otherwise 8 bit
+    bool srgb;        // the first three channels of an 8 bit image are sRGB encoded, alpha is always linear
+    MipFilter filter;
+} MipDesc;
+
+typedef struct {
+    int levelCount; // level 0 included
+    int widths[MIP_MAX_LEVELS];
+    int heights[MIP_MAX_LEVELS];
+    size_t sizes[MIP_MAX_LEVELS];
+    const void* levels[MIP_MAX_LEVELS]; // level 0 is the caller's image
+    void* storage;                      // levels 1 and up
+} MipChain;
+
+/**
+ * @return The number of levels of a full chain down to 1x1.
+ */
+int mip_level_count(int width, int height);
+
+size_t mip_texel_size(const MipDesc* desc);
+
+/**
+ * Builds the full chain below an image. Texels are tightly packed, rows have no padding.
+ * @return false if out of memory.
+ */
+bool mip_build(const MipDesc* desc, const void* pixels, int width, int height, MipChain* chain);
+
+/**
+ * Like mip_build, but stops after levelCount levels, for textures that only allocate the top of their chain.
+ */
+bool mip_build_levels(const MipDesc* desc, const void* pixels, int width, int height, int levelCount,
+                      MipChain* chain);
+
+void mip_chain_free(MipChain* chain);
+
+#endif //MIP_BUILDER_H
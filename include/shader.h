@@ -7,10 +7,58 @@
 #include <glad/glad.h>
 #include <cglm/cglm.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Name -> location table of the active uniforms of a program. It is filled once after linking,
+ * so that setting a uniform by name never has to go through glGetUniformLocation.
+ */
+typedef struct UniformTable UniformTable;
+
 typedef struct {
-    GLuint id;
+    GLuint id;              // the program the shader was created with, see shader_program
+    UniformTable* uniforms;
 } Shader;
 
+/**
+ * Two separable single stage programs combined at draw time, see shader_pipeline_create.
+ */
+typedef struct {
+    GLuint id;
+} ShaderPipeline;
+
+/**
+ * Describes a program to build. Leaving one of the paths NULL builds a separable
+ * single stage program for use in a ShaderPipeline.
+ */
+typedef struct {
+    const char* vertexPath;
+    const char* fragmentPath;
+    const char* defines; // injected into both stages, e.g. "MAX_STEPS=300;NO_DISK", may be NULL
+} ShaderDesc;
+
+/**
+ * A shader source compiled into the binary, see embed_shaders() in CMakeLists.txt.
+ */
+typedef struct {
+    const char* name; // path relative to the shaders directory, e.g. "blackhole/black_hole.frag"
+    const char* data;
+    size_t size;
+} EmbeddedFile;
+
+/**
+ * The table generated for targets that call embed_shaders(). Only defined in those targets.
+ */
+extern const EmbeddedFile EMBEDDED_SHADERS[];
+extern const size_t EMBEDDED_SHADER_COUNT;
+
+/**
+ * A group of programs that compile and link concurrently, see shader_create_batch.
+ */
+typedef struct ShaderBatch ShaderBatch;
+
 /**
  * Reads, compiles and links the given shader files to a new program.
  * It is the combination of the previous functions
@@ -22,13 +70,167 @@ GLuint create_shader_program(const char* vertexPath, const char* fragmentPath);
 
 Shader create_shader(const char* vertexPath, const char* fragmentPath);
 
+/**
+ * Builds the program a ShaderDesc describes and waits for it, the serial counterpart of shader_create_batch.
+ */
+Shader create_shader_desc(const ShaderDesc* desc);
+
+/**
+ * Makes embedded shaders available by name to every function taking a shader path, includes included.
+ * Names are looked up in the table before trying the path on disk.
+ */
+void shader_embed_register(const EmbeddedFile* files, size_t count);
+
+/**
+ * During development, loads shaders from this directory (through mmap) instead of the embedded copies,
+ * so edits show up without rebuilding and hot reload can watch the files. NULL turns the override off.
+ */
+void shader_source_override(const char* directory);
+
+/**
+ * Creates a shader from embedded sources, or from the override directory if one is set.
+ * Does no file I/O otherwise.
+ * @param vertexName The name of the vertex shader relative to the shaders directory.
+ * @param fragmentName The name of the fragment shader relative to the shaders directory.
+ */
+Shader create_shader_embedded(const char* vertexName, const char* fragmentName);
+
+/**
+ * Compiles one stage into a separable program (GL_PROGRAM_SEPARABLE). Stages are combined with
+ * shader_pipeline_create, so one vertex stage can serve many fragment stages without relinking.
+ * Uniforms are set on the stage they belong to, with the usual setters.
+ * @param stage GL_VERTEX_SHADER or GL_FRAGMENT_SHADER.
+ */
+Shader create_shader_stage(GLenum stage, const char* path);
+
+ShaderPipeline shader_pipeline_create(Shader vertexStage, Shader fragmentStage);
+
+/**
+ * Swaps the program of one stage of the pipeline, e.g. to switch between fragment passes.
+ * @param stage GL_VERTEX_SHADER or GL_FRAGMENT_SHADER.
+ */
+void shader_pipeline_set_stage(ShaderPipeline pipeline, GLenum stage, Shader shader);
+
+/**
+ * Binds the pipeline for drawing, in place of the program set with shader_use.
+ */
+void shader_pipeline_bind(ShaderPipeline pipeline);
+
+void shader_pipeline_delete(ShaderPipeline* pipeline);
+
+/**
+ * Returns the permutation of a shader with the given defines injected after the #version line.
+ * Each permutation is compiled on first use and cached under the key (paths, defines), later calls are a lookup.
+ * The cache owns the returned handle, do not delete it. Variants are rebuilt when a watched shader with
+ * the same files is reloaded, so fetch the handle each time rather than keeping it.
+ * Either path may be NULL for a separable single stage variant.
+ * @param defines A list like "MAX_STEPS=300;FBM_OCTAVES=1", or NULL for the plain shader.
+ */
+Shader shader_variant(const char* vertexPath, const char* fragmentPath, const char* defines);
+
+/**
+ * Deletes every cached variant.
+ */
+void shader_variants_clear();
+
+/**
+ * Submits the compile and link of every program before checking any of them, so that the driver
+ * can spread the work over its compiler threads (KHR_parallel_shader_compile).
+ * The handles are written to shaders[] as the programs finish, see shader_batch_poll.
+ * @param descs The vertex/fragment paths of each program.
+ * @param n The number of programs.
+ * @param shaders Receives the handles. Must stay valid until the batch is done.
+ * @return The batch, to be polled and then freed with shader_batch_free, or NULL if out of memory. Nothing
+ *         is compiled then, see create_shader_desc.
+ */
+ShaderBatch* shader_create_batch(const ShaderDesc* descs, int n, Shader* shaders);
+
+/**
+ * Finalizes the programs of the batch whose link completed, without blocking.
+ * @return true once every program of the batch is done.
+ */
+bool shader_batch_poll(ShaderBatch* batch);
+
+/**
+ * Blocks until every program of the batch is done.
+ */
+void shader_batch_wait(ShaderBatch* batch);
+
+void shader_batch_free(ShaderBatch* batch);
+
+/**
+ * Whether a shader is linked and can be used. Shaders of a batch become ready as it is polled,
+ * shaders that failed to compile or link never do.
+ */
+bool shader_ready(Shader shader);
+
+/**
+ * The program currently behind a handle. It differs from shader.id once a hot reload swapped the program,
+ * for every copy of the handle.
+ */
+GLuint shader_program(Shader shader);
+
 void shader_use(Shader shader);
 void shader_delete(Shader* shader);
 
+/**
+ * Watches the source files of the shader and every file they include, and recompiles it in the background
+ * whenever one of them changes. The included files are found again after every successful recompile.
+ * The old program keeps rendering until the new one has linked successfully, then the program
+ * behind the handle is swapped. The swap goes through the uniform table the handle shares with its copies,
+ * so any copy can be used and the handle may be moved, as long as the program is read with shader_program.
+ * Either path may be NULL for separable single stage programs.
+ * Without KHR_parallel_shader_compile a reload compiles in one frame and links in the next, each blocking.
+ * Only supported on Linux (inotify), elsewhere this does nothing.
+ */
+void shader_watch(Shader* shader, const char* vertexPath, const char* fragmentPath);
+
+/**
+ * Like shader_watch, recompiling with the given defines, for a shader that was built with them.
+ */
+void shader_watch_defines(Shader* shader, const char* vertexPath, const char* fragmentPath, const char* defines);
+
+/**
+ * Stops watching the shader, given any copy of its handle.
+ */
+void shader_unwatch(Shader* shader);
+
+/**
+ * Handles file changes and finished recompiles of watched shaders. Call once per frame.
+ * @return true if a program was swapped, in which case cached uniform locations have to be looked up again.
+ */
+bool shader_reload_poll();
+
+/**
+ * Looks up the location of a uniform in the table built at link time.
+ * The result can be cached by the caller and passed to the shader_*_loc setters.
+ * @return The location of the uniform, or -1 if the program has no active uniform with that name.
+ */
+GLint shader_uniform_location(Shader shader, const char* name);
+
+/**
+ * Reflection data of an active uniform, as enumerated at link time.
+ * @param location Receives the location.
+ * @param type Receives the GL type, e.g. GL_FLOAT_VEC3 or GL_SAMPLER_2D.
+ * @param size Receives the array size, 1 for non-arrays. For an element "name[i]" the elements left from i on.
+ * @return false if the program has no active uniform with that name.
+ */
+bool shader_uniform_info(Shader shader, const char* name, GLint* location, GLenum* type, GLint* size);
+
 void shader_u1i(Shader shader, const char* name, int val);
 void shader_u1f(Shader shader, const char* name, float val);
 void shader_u2f(Shader shader, const char* name, float val1, float val2);
 void shader_u3f(Shader shader, const char* name, vec3 val);
 void shader_uMat4f(Shader shader, const char* name, mat4 val);
 
+void shader_u1i_loc(Shader shader, GLint location, int val);
+void shader_u1f_loc(Shader shader, GLint location, float val);
+void shader_u2f_loc(Shader shader, GLint location, float val1, float val2);
+void shader_u3f_loc(Shader shader, GLint location, vec3 val);
+void shader_uMat4f_loc(Shader shader, GLint location, mat4 val);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif //SHADER_HELPER_H
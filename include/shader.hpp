@@ -0,0 +1,143 @@
+//
+// Created by marios on 2/24/26.
+//
+
+#ifndef SHADER_HPP
+#define SHADER_HPP
+#include <cstdio>
+#include "shader.h"
+
+/**
+ * Typed uniform handles for C++ callers. A handle is resolved once from the link time table and checked
+ * against the reflected GL type, after that set() writes through the shader_u*_loc setters with no strings
+ * and no lookups. The argument types are checked at compile time, a vec3 handle only takes a float[3].
+ *
+ *     gl::Uniform<gl::Vec3> camPos(shader, "cam_pos");
+ *     camPos.set(camera.position);
+ *
+ * Writes go through the same redundant write filter as the shader_u* setters, so both can be mixed for a uniform.
+ * After shader_reload_poll reports a swap, handles of the reloaded shader have to be resolved again.
+ */
+namespace gl {
+
+struct Float;
+struct Int;
+struct Vec2;
+struct Vec3;
+struct Mat4;
+struct Sampler2D;
+struct SamplerCube;
+struct Sampler2DArray;
+
+template <typename T>
+struct UniformTraits;
+
+template <>
+struct UniformTraits<Float> {
+    using Arg = float;
+    static constexpr const char* name = "float";
+    static bool accepts(GLenum type) { return type == GL_FLOAT; }
+    static void set(Shader shader, GLint location, Arg value) { shader_u1f_loc(shader, location, value); }
+};
+
+template <>
+struct UniformTraits<Int> {
+    using Arg = int;
+    static constexpr const char* name = "int";
+    static bool accepts(GLenum type) { return type == GL_INT || type == GL_BOOL; }
+    static void set(Shader shader, GLint location, Arg value) { shader_u1i_loc(shader, location, value); }
+};
+
+template <>
+struct UniformTraits<Vec2> {
+    using Arg = const float (&)[2];
+    static constexpr const char* name = "vec2";
+    static bool accepts(GLenum type) { return type == GL_FLOAT_VEC2; }
+    static void set(Shader shader, GLint location, Arg value) { shader_u2f_loc(shader, location, value[0], value[1]); }
+};
+
+template <>
+struct UniformTraits<Vec3> {
+    using Arg = const float (&)[3];
+    static constexpr const char* name = "vec3";
+    static bool accepts(GLenum type) { return type == GL_FLOAT_VEC3; }
+    // The C setters take non-const cglm arrays, but only read them.
+    static void set(Shader shader, GLint location, Arg value) {
+        shader_u3f_loc(shader, location, const_cast<float*>(value));
+    }
+};
+
+template <>
+struct UniformTraits<Mat4> {
+    using Arg = const float (&)[4][4];
+    static constexpr const char* name = "mat4";
+    static bool accepts(GLenum type) { return type == GL_FLOAT_MAT4; }
+    static void set(Shader shader, GLint location, Arg value) {
+        shader_uMat4f_loc(shader, location, const_cast<vec4*>(value));
+    }
+};
+
+// Samplers take the texture unit index.
+template <>
+struct UniformTraits<Sampler2D> {
+    using Arg = int;
+    static constexpr const char* name = "sampler2D";
+    static bool accepts(GLenum type) { return type == GL_SAMPLER_2D; }
+    static void set(Shader shader, GLint location, Arg unit) { shader_u1i_loc(shader, location, unit); }
+};
+
+template <>
+struct UniformTraits<SamplerCube> {
+    using Arg = int;
+    static constexpr const char* name = "samplerCube";
+    static bool accepts(GLenum type) { return type == GL_SAMPLER_CUBE; }
+    static void set(Shader shader, GLint location, Arg unit) { shader_u1i_loc(shader, location, unit); }
+};
+
+template <>
+struct UniformTraits<Sampler2DArray> {
+    using Arg = int;
+    static constexpr const char* name = "sampler2DArray";
+    static bool accepts(GLenum type) { return type == GL_SAMPLER_2D_ARRAY; }
+    static void set(Shader shader, GLint location, Arg unit) { shader_u1i_loc(shader, location, unit); }
+};
+
+template <typename T>
+class Uniform {
+public:
+    using Traits = UniformTraits<T>;
+
+    Uniform() = default;
+
+    /**
+     * Resolves the uniform. A missing uniform (e.g. optimized out) gives a handle whose set() does nothing,
+     * a uniform of another type is reported and treated the same way.
+     */
+    Uniform(Shader shader, const char* name) : shader_(shader) {
+        GLint location, size;
+        GLenum type;
+        if (!shader_uniform_info(shader, name, &location, &type, &size))
+            return;
+        if (!Traits::accepts(type)) {
+            std::printf("Uniform %s is not a %s (GL type 0x%04X)\n", name, Traits::name, type);
+            return;
+        }
+        location_ = location;
+    }
+
+    void set(typename Traits::Arg value) const {
+        if (location_ >= 0)
+            Traits::set(shader_, location_, value);
+    }
+
+    bool valid() const { return location_ >= 0; }
+    GLint location() const { return location_; }
+
+private:
+    Shader shader_ = {};
+    GLint location_ = -1;
+};
+
+} // namespace gl
+
+#endif //SHADER_HPP
@@ -0,0 +1,47 @@
+//
+// Created by marios on 2/14/26.
+//
+
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <glad/glad.h>
+
+typedef struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int rejected; // entries that existed but were corrupt, stale or refused by the driver
+    unsigned int stores;
+} ShaderCacheStats;
+
+/**
+ * Enables the on-disk program binary cache. Must be called with a current context,
+ * since the driver strings become part of every key.
+ * @param directory The directory holding the cached binaries. It is created if missing.
+ * @return false if the driver exposes no program binary formats, in which case the cache stays disabled.
+ */
+bool shader_cache_init(const char* directory);
+
+bool shader_cache_enabled();
+
+/**
+ * Hashes the given sources together with the driver vendor/renderer/version and the cache format tag.
+ */
+uint64_t shader_cache_key(const char** sources, int count);
+
+/**
+ * Creates a program from a cached binary.
+ * @return The linked program, or 0 if there is no usable entry for the key.
+ */
+GLuint shader_cache_load(uint64_t key);
+
+/**
+ * Writes the binary of a linked program to the cache. The program should have been linked
+ * with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+ */
+void shader_cache_store(uint64_t key, GLuint program);
+
+ShaderCacheStats shader_cache_stats();
+
+#endif //SHADER_CACHE_H
@@ -0,0 +1,77 @@
+//
+// Created by marios on 3/18/26.
+//
+
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+#include <stdbool.h>
+#include <glad/glad.h>
+
+/**
+ * Packs many small images into one texture, so draws using different images bind the same texture and can be
+ * batched. Images are placed with a skyline bottom-left packer on the CPU, either all into one 2D atlas or into the
+ * layers of a 2D array of equally sized pages. Every image gets a gutter of its edge texels extruded outwards, and
+ * images start on multiples of the size of a texel of the last mip level, so mips are filtered from each image
+ * alone and keep at least the padding between images at every level. Shaders map the uv of an image into the
+ * texture with the uvScale and uvOffset of its region, and pick the layer of arrays.
+ * Images are stored as RGBA8 with sRGB aware box filtered mips, like 8 bit textures of texture_helper.
+ */
+
+typedef enum {
+    ATLAS_TEXTURE_2D,    // a single page, grown until everything fits
+    ATLAS_TEXTURE_ARRAY, // as many pages as needed, each a layer
+} AtlasTarget;
+
+typedef struct {
+    AtlasTarget target;
+    int maxSize;  // edge limit of the atlas or of a layer, 0 for 4096
+    int levels;   // mip levels, 1 for none, 0 for 4
+    int padding;  // texels kept between images at the last level, 0 for 1. Level 0 keeps padding << (levels - 1).
+} AtlasDesc;
+
+typedef struct {
+    const unsigned char* pixels; // RGBA, tightly packed rows
+    int width;
+    int height;
+} AtlasImage;
+
+typedef struct {
+    int layer;          // 0 for ATLAS_TEXTURE_2D
+    int x;              // texels of level 0
+    int y;
+    int width;
+    int height;
+    float uvScale[2];   // uv in the texture = uv of the image * uvScale + uvOffset
+    float uvOffset[2];
+} AtlasRegion;
+
+typedef struct {
+    GLuint texture;
+    GLenum target;        // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+    int width;            // of a page
+    int height;
+    int layers;
+    int levelCount;
+    int regionCount;
+    AtlasRegion* regions; // in the order of the images
+    double occupancy;     // share of the page texels covered by images, gutters excluded
+} TextureAtlas;
+
+/**
+ * Packs images and uploads them into a new texture, bound to the active unit.
+ * @return false if an image does not fit within maxSize, or out of memory.
+ */
+bool texture_atlas_pack(const AtlasImage* images, int count, const AtlasDesc* desc, TextureAtlas* atlas);
+
+/**
+ * Decodes image files on the shared thread pool and packs them, see texture_atlas_pack.
+ * @return false if a file could not be decoded, or the images could not be packed.
+ */
+bool texture_atlas_load(const char* const* paths, int count, const AtlasDesc* desc, TextureAtlas* atlas);
+
+/**
+ * Deletes the texture and the regions.
+ */
+void texture_atlas_free(TextureAtlas* atlas);
+
+#endif //TEXTURE_ATLAS_H
@@ -0,0 +1,42 @@
+//
+// Created by marios on 3/4/26.
+//
+
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+#include <glad/glad.h>
+#include "texture_stream.h"
+
+/**
+ * Registry of streamed textures keyed by canonical path and load parameters, so an image used by several
+ * materials is decoded and uploaded once. Textures are reference counted, every acquire needs a release.
+ */
+
+typedef struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int entries;    // distinct textures currently alive
+    unsigned int references; // outstanding acquires over all entries
+} TextureCacheStats;
+
+/**
+ * Returns the texture for path and desc, starting a texture_stream_load on a miss.
+ * The callback of desc only runs for the acquire that starts the load, the placeholder only
+ * applies to it as well.
+ * @param desc Loading options, NULL for the defaults of an 8 bit texture.
+ */
+GLuint texture_cache_acquire(const char* path, const TextureStreamDesc* desc);
+
+/**
+ * Drops one reference, the texture is deleted with the last one.
+ */
+void texture_cache_release(GLuint texture);
+
+TextureCacheStats texture_cache_stats();
+
+/**
+ * Deletes every cached texture regardless of outstanding references.
+ */
+void texture_cache_clear();
+
+#endif //TEXTURE_CACHE_H
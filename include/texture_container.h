@@ -0,0 +1,74 @@
+//
+// Created by marios on 3/15/26.
+//
+
+#ifndef TEXTURE_CONTAINER_H
+#define TEXTURE_CONTAINER_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <glad/glad.h>
+#include "mip_builder.h"
+
+/**
+ * Pre-decoded texture files: the pixel format, dimensions and mip chain of a 2D texture, stored exactly as
+ * glTexImage2D takes them. Levels start on TEXTURE_CONTAINER_LEVEL_ALIGNMENT boundaries and rows are padded to
+ * TEXTURE_CONTAINER_ROW_ALIGNMENT, so a mapped file is uploaded without copying or decoding anything. A checksum
+ * of the payload rejects truncated or corrupt files.
+ * texture_helper writes one next to an asset as "<asset>.gtex" the first time it decodes it, TextureCompressor
+ * writes them ahead of time.
+ */
+
+#define TEXTURE_CONTAINER_EXTENSION ".gtex"
+#define TEXTURE_CONTAINER_ROW_ALIGNMENT 4    // GL's default unpack alignment
+#define TEXTURE_CONTAINER_LEVEL_ALIGNMENT 64
+
+typedef struct {
+    GLenum internalFormat; // what the writer uploaded it as, callers may pick another
+    GLenum format;         // pixel format and type of the payload
+    GLenum type;
+    int channels;
+    int width;
+    int height;
+    int levelCount;
+    int widths[MIP_MAX_LEVELS];
+    int heights[MIP_MAX_LEVELS];
+    size_t rowPitches[MIP_MAX_LEVELS];
+    size_t levelSizes[MIP_MAX_LEVELS];
+    const void* levels[MIP_MAX_LEVELS]; // point into the mapping
+    void* mapping;
+    size_t mappingSize;
+} TextureContainer;
+
+/**
+ * Identifies an asset and the way it was decoded, a container written under another key is stale.
+ * Built from the size and modification time of the asset and the parameters it was decoded and filtered with.
+ * @param desc How the asset is decoded, channels being the count requested from the decoder, 0 for as stored.
+ * @param mipmaps Whether the container holds the full chain or only level 0.
+ * @return 0 if the asset does not exist.
+ */
+uint64_t texture_container_key(const char* assetPath, const MipDesc* desc, bool mipmaps);
+
+/**
+ * @return true if the file starts with the container magic.
+ */
+bool texture_container_is_file(const char* path);
+
+/**
+ * Writes the levels of a chain, padding rows and levels to the alignments above. The file appears atomically.
+ * @param texelSize Bytes per texel of the payload, mip_texel_size for chains from mip_build.
+ * @return false if the file could not be written.
+ */
+bool texture_container_write(const char* path, uint64_t key, GLenum internalFormat, GLenum format, GLenum type,
+                             int channels, size_t texelSize, const MipChain* chain);
+
+/**
+ * Maps a container and checks it, the level pointers stay valid until texture_container_close.
+ * @param key The key the container has to carry, 0 to accept any.
+ * @return false if the file is missing, stale or corrupt.
+ */
+bool texture_container_open(const char* path, uint64_t key, TextureContainer* container);
+
+void texture_container_close(TextureContainer* container);
+
+#endif //TEXTURE_CONTAINER_H
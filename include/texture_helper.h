@@ -1,5 +1,27 @@
 #ifndef TEXTURE_HELPER_H
 #define TEXTURE_HELPER_H
+#include <glad/glad.h>
+#include "env_map.h"
+
+/**
+ * @return The pixel format matching an 8 bit image with the given channel count.
+ */
+GLint get_image_format(int nrChannels);
+
+/**
+ * Loads a block compressed KTX2 file (see ktx2.h) with all of its stored mip levels.
+ * The texture functions below take this path automatically when given a KTX2 file.
+ * @return The texture, or 0 if the file is unreadable or its format is not supported by the driver.
+ */
+unsigned int gen_texture_ktx2(const char* path, int* width, int* height);
+
+/**
+ * Loads a pre-decoded container (see texture_container.h) written by TextureCompressor, uploading straight from the
+ * mapped file. The texture functions below take this path automatically when given a container, and keep one
+ * next to every decoded asset so later runs skip decoding.
+ * @return The texture, or 0 if the file is unreadable or corrupt.
+ */
+unsigned int gen_texture_container(const char* path, int* width, int* height, int* nrChannels);
 
 unsigned int gen_texture_whcf(char* texLocation, int* width, int* height, int* nrChannels, GLint format);
 
@@ -11,13 +33,40 @@ unsigned int gen_texture_wh(char* texLocation, int* width, int* height);
 
 unsigned int gen_texture(char* texLocation);
 
+/**
+ * Loads many files at once like gen_texture: every file is decoded and its mip chain filtered in parallel on the
+ * shared thread pool, then all of them are uploaded in one pass on this thread. Radiance HDR files load as float
+ * RGB like gen_skybox_texture, but keep repeating in both directions.
+ * @param textures Receives a texture per path, 0 for files that could not be loaded.
+ * @return The number of textures loaded.
+ */
+int gen_textures(const char* const* paths, int count, unsigned int* textures);
+
 
 
 
 unsigned int gen_skybox_texture(char* texLocation);
 
+/**
+ * Uploads a converted environment map, every level packed with hdr_pack.
+ * @param hdrFormat One of the hdr_pack formats.
+ * @return A GL_TEXTURE_CUBE_MAP for cube maps, a GL_TEXTURE_2D otherwise.
+ */
+unsigned int gen_env_map_texture(const EnvMap* map, GLenum hdrFormat);
+
+/**
+ * Loads an equirect HDR file as an environment map of the given layout with mips, see env_map_load.
+ * @param size The edge of a face, 0 to follow the resolution of the file.
+ * @return The texture, or 0 if the file could not be loaded.
+ */
+unsigned int gen_env_map(const char* path, EnvMapLayout layout, int size, GLenum hdrFormat);
+
 unsigned int gen_texture_data(unsigned char* data, int width, int height, int nrChannels);
 
+/**
+ * Copies a size x size square out of an 8 bit image, row by row.
+ * @return The square, to be freed by the caller, or NULL if it does not fit inside the image or out of memory.
+ */
 unsigned char* image_subregion(unsigned char* source, int width, int height, int channels, int xOffset, int yOffset, int size);
 
 /**
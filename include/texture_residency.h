@@ -0,0 +1,97 @@
+//
+// Created by marios on 3/17/26.
+//
+
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <glad/glad.h>
+
+/**
+ * Video memory accounting for the textures made by texture_helper. Every gen_* texture is measured when it is
+ * created, from the sizes the driver reports for each of its levels, and gl_state stamps it whenever it is bound.
+ * With a budget set, texture_residency_update shrinks the least recently bound textures until the total fits again,
+ * either by dropping their top mip levels or by evicting them down to their last level. The levels that stay are
+ * copied on the GPU, so shrinking never reads anything back. Textures that were loaded from a file are reloaded
+ * once they are bound again, textures generated from memory stay at the resolution they were shrunk to.
+ * GL thread only.
+ */
+
+#define RESIDENCY_MAX_LEVELS 16
+#define RESIDENCY_MAX_FORMATS 32
+
+typedef enum {
+    RESIDENCY_DROP_MIPS, // drop top levels one at a time, never below minSize
+    RESIDENCY_EVICT,     // drop every level but the last, reloading from the file on the next bind
+} ResidencyPolicy;
+
+typedef struct {
+    size_t bytes;           // 0 for no limit
+    ResidencyPolicy policy;
+    int minSize;            // edge the top level is never dropped below, 0 for 64. Files evicted with
+                            // RESIDENCY_EVICT ignore it, they come back whole.
+} ResidencyBudget;
+
+/**
+ * Reloads a texture from its file into the same name, with the same parameters it was made with.
+ * @return false if the file could not be loaded, the texture then stays shrunk.
+ */
+typedef bool (*TextureReloadFn)(GLuint texture, GLenum target, const char* path, GLint format);
+
+typedef struct {
+    GLenum internalFormat;
+    unsigned int textures;
+    size_t bytes;
+} ResidencyFormatStats;
+
+typedef struct {
+    size_t budget;
+    size_t residentBytes;
+    size_t fullBytes;        // what the textures would take with none of them shrunk
+    unsigned int textures;
+    unsigned int shrunk;     // textures currently below their full size
+    uint64_t evictions;
+    uint64_t mipDrops;       // levels dropped by RESIDENCY_DROP_MIPS
+    uint64_t reloads;
+    int formatCount;
+    ResidencyFormatStats formats[RESIDENCY_MAX_FORMATS]; // by resident bytes, largest first
+} ResidencyStats;
+
+void texture_residency_set_budget(const ResidencyBudget* budget);
+
+/**
+ * Starts accounting for a texture whose levels are all specified.
+ * @param path The file the texture was loaded from, NULL if it was generated.
+ * @param format Passed back to reload.
+ * @param reload How to load it again after an eviction, NULL if it cannot be.
+ */
+void texture_residency_track(GLuint texture, GLenum target, const char* path, GLint format, TextureReloadFn reload);
+
+/**
+ * Stops accounting for a texture, gl_state_forget_texture calls it for deleted ones.
+ */
+void texture_residency_untrack(GLuint texture);
+
+/**
+ * Marks a texture as used in the current frame, gl_state calls it for every texture bind. Binds residency makes
+ * itself while measuring, shrinking or reloading a texture are not counted.
+ */
+void texture_residency_touch(GLuint texture);
+
+/**
+ * Reloads one shrunk texture that was bound since the last call if the budget allows, then shrinks the least
+ * recently bound textures until the budget holds. Nothing is shrunk while the upload queue still holds uploads,
+ * they would land in levels that no longer exist. Call once per frame.
+ */
+void texture_residency_update();
+
+ResidencyStats texture_residency_stats();
+
+/**
+ * @return A readable name of a sized internal format, like "RGBA8", for printing the stats.
+ */
+const char* texture_residency_format_name(GLenum internalFormat);
+
+#endif //TEXTURE_RESIDENCY_H
@@ -0,0 +1,77 @@
+//
+// Created by marios on 3/2/26.
+//
+
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+#include <stdbool.h>
+#include <glad/glad.h>
+
+/**
+ * Asynchronous texture loading. Files are decoded on the shared thread pool and copied into a mapped
+ * pixel unpack buffer off the GL thread, texture_stream_poll then issues the upload from that buffer.
+ * The returned texture is usable right away, it holds a 1x1 placeholder until the image arrives.
+ * HDR loads of Radiance files never hold the whole image in host memory: rows are decoded and packed into a small
+ * persistently mapped ring while earlier chunks upload, so the texture fills in progressively over a few polls.
+ * Mip chains of whole images are filtered on the workers with mip_builder and kept with the decoded image in the
+ * texture_container next to the file, the same one gen_texture uses. Streamed Radiance files box filter theirs from
+ * the decoded rows and upload them through the same ring.
+ */
+
+/**
+ * Called on the GL thread from texture_stream_poll once the upload has completed on the GPU.
+ * @param loaded false if the file could not be decoded, the texture then keeps its placeholder.
+ */
+typedef void (*TextureStreamCallback)(GLuint texture, int width, int height, bool loaded, void* user);
+
+typedef struct {
+    bool hdr;              // decode as float RGB into hdrFormat, otherwise 8 bit with the file's channel count
+    GLenum hdrFormat;      // one of the hdr_pack formats, 0 defaults to GL_RGB32F
+    bool mipmaps;
+    GLint wrapS;           // 0 defaults to GL_REPEAT
+    GLint wrapT;           // 0 defaults to GL_REPEAT
+    GLint minFilter;       // 0 defaults to GL_LINEAR, or GL_LINEAR_MIPMAP_LINEAR with mipmaps
+    GLint magFilter;       // 0 defaults to GL_LINEAR
+    float placeholder[4];  // RGBA shown until the upload completes
+    TextureStreamCallback callback;
+    void* user;
+} TextureStreamDesc;
+
+/**
+ * Replaces the zero fields of desc with their defaults.
+ */
+void texture_stream_resolve_desc(TextureStreamDesc* desc);
+
+/**
+ * Starts loading a 2D texture. Must be called with a current context.
+ * The texture must stay alive until it is ready, see texture_stream_ready.
+ * @param desc Loading options, NULL for the defaults of an 8 bit texture.
+ * @return The texture holding the placeholder.
+ */
+GLuint texture_stream_load(const char* path, const TextureStreamDesc* desc);
+
+/**
+ * Advances the pending loads without blocking: starts uploads for decoded images and retires uploads
+ * whose fence has signaled. Call once per frame on the GL thread.
+ * @return The number of loads still in flight.
+ */
+int texture_stream_poll();
+
+/**
+ * @return true once the texture holds its final image, or failed to load. Textures that were never streamed
+ * are always ready.
+ */
+bool texture_stream_ready(GLuint texture);
+
+/**
+ * Blocks until every pending load has completed.
+ */
+void texture_stream_finish();
+
+/**
+ * Waits for the workers and drops the loads still pending, calling their callbacks with loaded false.
+ * The textures themselves stay owned by the caller.
+ */
+void texture_stream_shutdown();
+
+#endif //TEXTURE_STREAM_H
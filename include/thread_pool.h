@@ -0,0 +1,57 @@
+//
+// Created by marios on 3/2/26.
+//
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/**
+ * Fixed set of worker threads running tasks from a FIFO queue. Tasks must not touch GL,
+ * hand results back to the thread owning the context instead.
+ */
+
+typedef struct ThreadPool ThreadPool;
+
+typedef void (*ThreadTask)(void* arg);
+
+typedef void (*ThreadRangeTask)(void* ctx, int index);
+
+/**
+ * @param threadCount Number of workers, <= 0 uses one per online CPU.
+ * @return The pool, or NULL if no thread could be started.
+ */
+ThreadPool* thread_pool_create(int threadCount);
+
+/**
+ * Process wide pool sized to the CPU count, created on first use.
+ * NULL if no thread could be started, the functions below then run the work on the calling thread.
+ */
+ThreadPool* thread_pool_shared();
+
+/**
+ * @return The number of workers, 0 for a NULL pool.
+ */
+int thread_pool_size(ThreadPool* pool);
+
+/**
+ * Queues a task. Without a pool, or out of memory, the task runs before this returns.
+ */
+void thread_pool_submit(ThreadPool* pool, ThreadTask task, void* arg);
+
+/**
+ * Runs task(ctx, i) for every i in [0, count) spread over the workers and the calling thread,
+ * and returns once all of them finished. Items are handed out one at a time, so uneven items balance out.
+ */
+void thread_pool_parallel_for(ThreadPool* pool, int count, ThreadRangeTask task, void* ctx);
+
+/**
+ * Blocks until the queue is empty and every worker is idle.
+ */
+void thread_pool_wait(ThreadPool* pool);
+
+/**
+ * Finishes the queued tasks, then joins the workers.
+ */
+void thread_pool_destroy(ThreadPool* pool);
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,108 @@
+//
+// Created by marios on 3/16/26.
+//
+
+#ifndef UPLOAD_QUEUE_H
+#define UPLOAD_QUEUE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <glad/glad.h>
+
+/**
+ * Frame budgeted uploads. Texture regions and buffer ranges are queued instead of uploaded on the spot, and
+ * upload_queue_drain copies them into a persistently mapped staging ring and issues the GPU copies from it, stopping
+ * once the byte or time budget of the frame is spent. Large regions are split into bands of rows, so a single big
+ * mip level spreads over several frames instead of stalling one. Every drain ends with a fence, the staging memory
+ * of a drain is reused once its fence signals, and that is also when the uploads it finished are reported complete.
+ * texture_helper and mesh queue their uploads here while upload_queue_set_deferred is on.
+ * GL thread only.
+ */
+
+typedef enum {
+    UPLOAD_DATA_BORROWED, // stays valid until the upload completes, see UploadCallback
+    UPLOAD_DATA_COPY,     // copied on enqueue, the caller may free it right away
+    UPLOAD_DATA_OWNED,    // allocated with malloc, the queue frees it once staged
+} UploadDataMode;
+
+/**
+ * Runs from upload_queue_drain once the GPU has finished the copy.
+ */
+typedef void (*UploadCallback)(void* user);
+
+typedef struct {
+    size_t bytesPerFrame;  // staged per drain, 0 for 8 MB
+    double msPerFrame;     // CPU time spent per drain, 0 for 2 ms
+    size_t stagingSize;    // size of the staging ring, 0 for 32 MB. Only applies before the first upload.
+} UploadBudget;
+
+typedef struct {
+    GLuint texture;
+    GLint level;
+    GLint layer;      // cube face or array layer, -1 for 2D textures
+    int x;
+    int y;
+    int width;
+    int height;
+    GLenum format;    // pixel format and type of data
+    GLenum type;
+    const void* data;
+    size_t rowPitch;  // bytes from one row of data to the next, 0 if tightly packed
+} UploadTextureRegion;
+
+typedef struct {
+    unsigned int queued;     // uploads waiting for staging space or budget
+    size_t queuedBytes;
+    unsigned int inFlight;   // fully issued, waiting for their fence
+    uint64_t completed;
+    size_t lastFrameBytes;   // staged by the last drain
+    double lastFrameMs;
+    uint64_t stalls;         // drains that stopped early because the staging ring was full
+    double averageLatencyMs; // enqueue to completion
+    double maxLatencyMs;
+} UploadQueueStats;
+
+void upload_queue_set_budget(const UploadBudget* budget);
+
+/**
+ * Routes the uploads of texture_helper and mesh through the queue. Their textures and buffers are then allocated
+ * right away but filled over the next drains. Off by default.
+ */
+void upload_queue_set_deferred(bool deferred);
+
+bool upload_queue_deferred();
+
+/**
+ * Queues an upload into a region of a texture whose storage already exists.
+ * @param callback Optional, called once the region is on the GPU.
+ * @return false if the pixel format and type are not known to the queue or out of memory, nothing was queued.
+ */
+bool upload_queue_texture(const UploadTextureRegion* region, UploadDataMode mode, UploadCallback callback,
+                          void* user);
+
+/**
+ * Queues an upload into a range of a buffer whose storage already exists.
+ * @return false if out of memory, nothing was queued.
+ */
+bool upload_queue_buffer(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data, UploadDataMode mode,
+                         UploadCallback callback, void* user);
+
+/**
+ * Retires finished uploads and issues queued ones within the budget. Call once per frame.
+ * @return The number of uploads queued or in flight.
+ */
+unsigned int upload_queue_drain();
+
+/**
+ * Issues everything regardless of the budget and blocks until it is on the GPU.
+ */
+void upload_queue_finish();
+
+UploadQueueStats upload_queue_stats();
+
+/**
+ * Finishes every upload and releases the staging ring.
+ */
+void upload_queue_shutdown();
+
+#endif //UPLOAD_QUEUE_H
@@ -4,7 +4,21 @@
 
 #ifndef BLACKHOLE_UTILS_H
 #define BLACKHOLE_UTILS_H
+#include <stddef.h>
+#include <stdint.h>
 #include "GLFW/glfw3.h"
 
+#define FNV1A_SEED 0xcbf29ce484222325ULL
+
 void goFullscreen(GLFWwindow* window);
-#endif //BLACKHOLE_UTILS_H
\ No newline at end of file
+
+/**
+ * 64-bit FNV-1a hash. Hashes can be chained by passing the previous result as the seed.
+ * @param data The bytes to hash.
+ * @param size The number of bytes.
+ * @param seed FNV1A_SEED for a fresh hash, or a previous hash to continue from.
+ */
+uint64_t hash_fnv1a(const void* data, size_t size, uint64_t seed);
+
+uint64_t hash_string(const char* str, uint64_t seed);
+#endif //BLACKHOLE_UTILS_H
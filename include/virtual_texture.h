@@ -0,0 +1,74 @@
+//
+// Created by marios on 3/14/26.
+//
+
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <glad/glad.h>
+#include "shader.h"
+
+/**
+ * Virtual texturing for HDR maps too large to be resident. The image is stored on disk as a pyramid of fixed size
+ * tiles. Shaders sampling it through shaders/common/virtual_texture.glsl translate coordinates through a page table
+ * into a physical atlas of resident tiles, and record the tiles they wanted in a feedback buffer. vt_update reads
+ * that feedback a few frames later, streams the missing tiles in from worker threads and evicts the least recently
+ * wanted ones. Until a tile arrives the page table points at its nearest resident ancestor, so the image sharpens in.
+ * The atlas is sized from the screen, not from the image.
+ */
+
+#define VT_TILE_SIZE 128   // texels of content per tile edge
+#define VT_TILE_BORDER 1   // texels copied from the neighbours on each side, so bilinear filtering stays in the tile
+#define VT_MAX_LEVELS 16
+#define VT_FEEDBACK_BINDING 0
+
+typedef struct VirtualTexture VirtualTexture;
+
+typedef struct {
+    int levelCount;
+    int tileCount;       // tiles of every level in the file
+    int slotCount;       // tiles the atlas can hold
+    int residentTiles;
+    int requestedTiles;  // tiles the last feedback read back asked for
+    int loadsInFlight;
+    uint64_t loads;
+    uint64_t evictions;
+    size_t atlasBytes;
+} VirtualTextureStats;
+
+/**
+ * Writes an equirect Radiance file as a tiled pyramid. Rows are streamed through hdr_reader and the levels are box
+ * filtered on the way, so only a band of tile rows per level is ever in memory. Images whose size in tiles is not a
+ * power of two are padded by repeating their last row and column.
+ * @param format One of the hdr_pack formats the tiles are stored in.
+ * @return false if the source could not be read or the file could not be written.
+ */
+bool vt_build_from_hdr(const char* hdrPath, const char* tilePath, GLenum format);
+
+/**
+ * Opens a tile file and creates the page table and atlas. The coarsest level is loaded right away and stays resident.
+ * Must be called with a current context.
+ * @param screenWidth The resolution the texture is drawn at, which bounds how many tiles can be visible.
+ * @return NULL if the file is missing or corrupt.
+ */
+VirtualTexture* vt_open(const char* tilePath, int screenWidth, int screenHeight);
+
+/**
+ * Binds the page table and atlas to units firstUnit and firstUnit + 1 and the feedback buffer of this frame to
+ * VT_FEEDBACK_BINDING, and sets the uniforms of virtual_texture.glsl on the shader.
+ */
+void vt_bind(VirtualTexture* vt, Shader shader, GLuint firstUnit);
+
+/**
+ * Call once per frame after the draws sampling the texture. Reads back older feedback, starts loads of the missing
+ * tiles, uploads finished ones and refreshes the page table.
+ */
+void vt_update(VirtualTexture* vt);
+
+VirtualTextureStats vt_stats(const VirtualTexture* vt);
+
+void vt_close(VirtualTexture* vt);
+
+#endif //VIRTUAL_TEXTURE_H
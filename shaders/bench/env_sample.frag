@@ -0,0 +1,25 @@
+#version 460 core
+out vec4 FragColor;
+
+uniform vec2 resolution;
+uniform int samples;
+uniform float pixelAngle;
+
+#include "../common/env_map.glsl"
+
+// Each sample looks at the sky through a 90 degree view turned a golden angle further, so fetches are
+// coherent across neighbouring fragments like escaping rays are, but cover the whole sphere including the poles.
+void main()
+{
+    vec2 p = (2.0 * gl_FragCoord.xy - resolution) / resolution.x;
+    vec3 sum = vec3(0.0);
+    for (int i = 0; i < samples; i++) {
+        float yaw = float(i) * 2.3999632;
+        float pitch = 1.3 * sin(float(i) * 0.7);
+        vec3 forward = vec3(cos(pitch) * sin(yaw), cos(pitch) * cos(yaw), sin(pitch));
+        vec3 right = normalize(cross(forward, vec3(0.0, 0.0, 1.0)));
+        vec3 up = cross(right, forward);
+        sum += env_sample(normalize(forward + p.x * right + p.y * up), pixelAngle);
+    }
+    FragColor = vec4(sum / float(samples), 1.0);
+}
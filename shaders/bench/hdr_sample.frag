@@ -0,0 +1,22 @@
+#version 460 core
+out vec4 FragColor;
+
+uniform sampler2D equirectangularMap;
+uniform vec2 resolution;
+uniform int samples;
+
+const float PI = 3.14159265359;
+
+// Every fragment fetches the equirect map along scattered directions, the way bent rays near the hole do,
+// so the cost is dominated by texel bandwidth rather than arithmetic.
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / resolution;
+    vec3 sum = vec3(0.0);
+    for (int i = 0; i < samples; i++) {
+        float u = fract(uv.x + float(i) * 0.6180339);
+        float v = fract(uv.y + float(i) * 0.3819660);
+        sum += texture(equirectangularMap, vec2(u, v * 0.5 + 0.25 * sin(float(i) + uv.x * PI))).rgb;
+    }
+    FragColor = vec4(sum / float(samples), 1.0);
+}
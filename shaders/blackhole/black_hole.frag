@@ -5,21 +5,19 @@
 
 out vec4 FragColor;
 
-uniform sampler2D equirectangularMap;
-uniform vec3 cam_pos;
-uniform vec3 cam_x;
-uniform vec3 cam_y;
-uniform vec3 cam_z;
-uniform float fov;
-
-uniform float time;
-uniform vec2 resolution;
-
-const int MAX_STEPS = 1500;
-
-vec2 sphere_map(vec3 p) {
-    return vec2(atan(p.x,p.y)/M_PI*0.5+0.5, asin(p.z)/M_PI+0.5);
-}
+#include "../common/frame_data.glsl"
+#include "../common/env_map.glsl"
+
+// Quality knobs, overridden per variant through injected defines.
+#ifndef MAX_STEPS
+#define MAX_STEPS 1500
+#endif
+#ifndef ACC_DISK_R_IN
+#define ACC_DISK_R_IN 1.5
+#endif
+#ifndef ACC_DISK_R_OUT
+#define ACC_DISK_R_OUT 5.0
+#endif
 
 // Tanner-Halland algorithm
 vec3 get_blackbody_color(float Temp) {
@@ -52,48 +50,14 @@ vec3 get_blackbody_color(float Temp) {
     return clamp(vec3(r, g, b) / 255.0, 0.0, 1.0);
 }
 
-// Standard 2D Hash function
-float hash(vec2 p) {
-    p = fract(p * vec2(123.34, 456.21));
-    p += dot(p, p + 45.32);
-    return fract(p.x * p.y);
-}
-
-// 2D Value Noise (Smoothly interpolates between hashes)
-float noise(vec2 p) {
-    vec2 i = floor(p);
-    vec2 f = fract(p);
+#include "../common/noise.glsl"
+#include "geodesic.glsl"
 
-    // Smoothstep interpolation (Hermite curve)
-    vec2 u = f * f * (3.0 - 2.0 * f);
-
-    return mix(mix(hash(i + vec2(0.0, 0.0)),
-                   hash(i + vec2(1.0, 0.0)), u.x),
-               mix(hash(i + vec2(0.0, 1.0)),
-                   hash(i + vec2(1.0, 1.0)), u.x), u.y);
-}
-
-//Fractional Brownian Motion
-float fbm(vec2 p) {
-    float v = 0.0;
-    float amp = 0.5;
-    for (int i = 0; i < 3; i++) {
-        v += noise(p) * amp;
-        p *= 2.0;
-        amp *= 0.5;
-    }
-    return v;
-}
-
-float ddu(float u) {
-    return -u * (1.0 - 1.5 * u * u);
-}
-
-vec4 integrate(vec3 d0) {
+vec4 integrate(vec3 cam_pos, vec3 d0) {
     vec4 accDiskColor = vec4(0.0, 0.0, 0.0, 1.0);
     float accDiskOpacity = 0.0;
-    float accDiskRIn = 1.5;
-    float accDiskROut = 5;
+    float accDiskRIn = ACC_DISK_R_IN;
+    float accDiskROut = ACC_DISK_R_OUT;
     bool escaped = true;
 
     vec3 old_pos = cam_pos;
@@ -165,7 +129,7 @@ vec4 integrate(vec3 d0) {
 
                 //Differential Rotation speed
                 float rotationSpeed = pow(dist, -1.5) * 2.0;
-                vec2 noiseUV = vec2(dist * 0.5, (phi + time * rotationSpeed) * (2.0 / M_PI));
+                vec2 noiseUV = vec2(dist * 0.5, (phi + frame.time * rotationSpeed) * (2.0 / M_PI));
 
 
                 float beaming = pow(doppler * grav, 2.5); // Should be to the power of 4 but that doesn't look nice
@@ -187,22 +151,25 @@ vec4 integrate(vec3 d0) {
         v = du_half + 0.5 * dphi * ddu(u);
     }
 
-    vec2 uv = sphere_map(ROT_Y(radians(-45.0)) * normalize(ray_step));
     if (!escaped) return vec4(0.0, 0.0, 0.0, 1.0) * (1.0 - accDiskOpacity) + (accDiskColor);
-    return texture(equirectangularMap, uv).rgba * (1.0 - accDiskOpacity) + (accDiskColor);
+
+    // Derivatives are undefined after the divergent march and jump at the equirect seam, so the LOD comes from
+    // the angular size of a pixel instead. Lensing stretches that footprint, which this ignores.
+    float pixelAngle = 2.0 * tan(radians(frame.fov) * 0.5) / frame.resolution.x;
+    vec3 sky = env_sample(ROT_Y(radians(-45.0)) * normalize(ray_step), pixelAngle);
+    return vec4(sky, 1.0) * (1.0 - accDiskOpacity) + (accDiskColor);
 }
 
 void main() {
-    float fov_mult = 1.0/tan(radians(fov) * 0.5);
+    float fov_mult = 1.0/tan(radians(frame.fov) * 0.5);
 
-    vec2 p = -1.0 + 2.0 * gl_FragCoord.xy / resolution.xy;
-    p.y *= resolution.y / resolution.x;
+    vec2 p = -1.0 + 2.0 * gl_FragCoord.xy / frame.resolution.xy;
+    p.y *= frame.resolution.y / frame.resolution.x;
 
-    vec3 pos = cam_pos;
-    vec3 ray = normalize(p.x*cam_x + p.y*cam_y + fov_mult*cam_z);
+    vec3 pos = frame.cam_pos.xyz;
+    vec3 ray = normalize(p.x*frame.cam_x.xyz + p.y*frame.cam_y.xyz + fov_mult*frame.cam_z.xyz);
 
-    //vec2 uv = sphere_map(ray);
-    //vec3 color = texture(equirectangularMap, uv).rgb;
-    vec3 color = integrate(ray).rgb;
+    //vec3 color = env_sample(ray, 0.0);
+    vec3 color = integrate(pos, ray).rgb;
     FragColor = vec4(color, 1.0);
 }
\ No newline at end of file
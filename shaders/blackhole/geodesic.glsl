@@ -0,0 +1,4 @@
+// Acceleration of u = 1/r with respect to the orbit angle, used by the leapfrog integration of the photon paths.
+float ddu(float u) {
+    return -u * (1.0 - 1.5 * u * u);
+}
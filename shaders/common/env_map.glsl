@@ -0,0 +1,45 @@
+// Sky lookup for the layouts of env_map.h. ENV_CUBE, ENV_OCTAHEDRAL or ENV_VIRTUAL selects the layout, equirect
+// otherwise. The virtual layout samples through virtual_texture.glsl instead of environmentMap.
+// Directions use the equirect convention: longitude atan(x, y), latitude asin(z).
+#ifndef M_PI
+#define M_PI 3.141592653589793238462643383279
+#endif
+
+#ifdef ENV_VIRTUAL
+#define VIRTUAL_TEXTURE
+#endif
+#include "virtual_texture.glsl"
+
+#if defined(ENV_CUBE)
+uniform samplerCube environmentMap;
+#elif !defined(ENV_VIRTUAL)
+uniform sampler2D environmentMap;
+#endif
+
+vec2 sphere_map(vec3 p) {
+    return vec2(atan(p.x,p.y)/M_PI*0.5+0.5, asin(p.z)/M_PI+0.5);
+}
+
+vec2 octahedral_map(vec3 p) {
+    p /= abs(p.x) + abs(p.y) + abs(p.z);
+    vec2 q = p.xy;
+    if (p.z < 0.0) q = (1.0 - abs(p.yx)) * vec2(p.x < 0.0 ? -1.0 : 1.0, p.y < 0.0 ? -1.0 : 1.0);
+    return q * 0.5 + 0.5;
+}
+
+// pixelAngle is the angle a pixel spans, the LOD follows from it since derivatives are not always defined.
+vec3 env_sample(vec3 dir, float pixelAngle) {
+#if defined(ENV_VIRTUAL)
+    return vt_sample(sphere_map(dir), log2(pixelAngle * vtSize.x * vtImageScale.x / (2.0 * M_PI)));
+#else
+    float edge = float(textureSize(environmentMap, 0).x);
+#if defined(ENV_CUBE)
+    return textureLod(environmentMap, dir, log2(pixelAngle * edge / (0.5 * M_PI))).rgb;
+#elif defined(ENV_OCTAHEDRAL)
+    // The square covers 4 pi steradians.
+    return textureLod(environmentMap, octahedral_map(dir), log2(pixelAngle * edge / sqrt(4.0 * M_PI))).rgb;
+#else
+    return textureLod(environmentMap, sphere_map(dir), log2(pixelAngle * edge / (2.0 * M_PI))).rgb;
+#endif
+#endif
+}
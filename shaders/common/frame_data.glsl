@@ -0,0 +1,13 @@
+// Per-frame values shared by every program, see FrameData in frame_data.h.
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 cam_pos;
+    vec4 cam_x;
+    vec4 cam_y;
+    vec4 cam_z;
+    float time;
+    float fov;
+    vec2 resolution;
+} frame;
@@ -0,0 +1,36 @@
+#ifndef FBM_OCTAVES
+#define FBM_OCTAVES 3
+#endif
+
+// Standard 2D Hash function
+float hash(vec2 p) {
+    p = fract(p * vec2(123.34, 456.21));
+    p += dot(p, p + 45.32);
+    return fract(p.x * p.y);
+}
+
+// 2D Value Noise (Smoothly interpolates between hashes)
+float noise(vec2 p) {
+    vec2 i = floor(p);
+    vec2 f = fract(p);
+
+    // Smoothstep interpolation (Hermite curve)
+    vec2 u = f * f * (3.0 - 2.0 * f);
+
+    return mix(mix(hash(i + vec2(0.0, 0.0)),
+                   hash(i + vec2(1.0, 0.0)), u.x),
+               mix(hash(i + vec2(0.0, 1.0)),
+                   hash(i + vec2(1.0, 1.0)), u.x), u.y);
+}
+
+//Fractional Brownian Motion
+float fbm(vec2 p) {
+    float v = 0.0;
+    float amp = 0.5;
+    for (int i = 0; i < FBM_OCTAVES; i++) {
+        v += noise(p) * amp;
+        p *= 2.0;
+        amp *= 0.5;
+    }
+    return v;
+}
@@ -0,0 +1,50 @@
+// Lookup side of virtual_texture.h, compiled in when VIRTUAL_TEXTURE is defined. vt_bind sets the uniforms.
+#ifdef VIRTUAL_TEXTURE
+#ifndef VT_FEEDBACK_BINDING
+#define VT_FEEDBACK_BINDING 0
+#endif
+
+uniform usampler2D vtPageTable; // per tile: atlas slot, level of the resident tile, 255 once anything is resident
+uniform sampler2D vtAtlas;
+uniform vec2 vtSize;            // texels of level 0, padded to whole tiles
+uniform vec2 vtImageScale;      // the part of vtSize covered by the image
+uniform int vtTileSize;
+uniform int vtBorder;
+uniform int vtLevels;
+uniform int vtFrame;
+
+// One bit per tile of every level, read back by vt_update.
+layout(std430, binding = VT_FEEDBACK_BINDING) buffer VtFeedback {
+    uint vtWanted[];
+};
+
+// One fragment of every 4x4 block reports, a different one each frame, which keeps the atomics rare.
+void vt_record(ivec2 tile, int level) {
+    ivec2 cell = ivec2(gl_FragCoord.xy) & 3;
+    if (cell.x + cell.y * 4 != (vtFrame & 15)) return;
+    int index = 0;
+    for (int l = 0; l < level; l++) {
+        ivec2 grid = textureSize(vtPageTable, l);
+        index += grid.x * grid.y;
+    }
+    index += tile.y * textureSize(vtPageTable, level).x + tile.x;
+    atomicOr(vtWanted[index >> 5], 1u << uint(index & 31));
+}
+
+// uv in [0, 1] over the image, wrapping horizontally. lod is relative to the image's level 0.
+vec3 vt_sample(vec2 uv, float lod) {
+    int level = clamp(int(lod + 0.5), 0, vtLevels - 1);
+    vec2 levelSize = max(floor(vtSize / exp2(float(level))), vec2(1.0));
+    vec2 texel = vec2(fract(uv.x), clamp(uv.y, 0.0, 1.0)) * vtImageScale * levelSize;
+    texel = min(texel, levelSize - 0.001);
+    ivec2 tile = ivec2(texel) / vtTileSize;
+    vt_record(tile, level);
+
+    // A missing tile points at a coarser resident one, scale the texel into that level.
+    uvec4 entry = texelFetch(vtPageTable, tile, level);
+    vec2 entryTexel = texel * exp2(float(level) - float(entry.z));
+    vec2 inTile = entryTexel - vec2((ivec2(entryTexel) / vtTileSize) * vtTileSize);
+    vec2 physical = vec2(entry.xy) * float(vtTileSize + 2 * vtBorder) + float(vtBorder) + inTile;
+    return textureLod(vtAtlas, physical / vec2(textureSize(vtAtlas, 0)), 0.0).rgb;
+}
+#endif
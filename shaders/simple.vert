@@ -1,7 +1,12 @@
 #version 460 core
 layout (location = 0) in vec3 aPos;
 
+// Separable programs have to declare the built-in outputs they write.
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
 void main()
 {
     gl_Position = vec4(aPos, 1.0);
-}
\ No newline at end of file
+}
@@ -4,12 +4,24 @@ layout (location = 1) in vec2 aTexCoord;
 
 out vec2 texCoord;
 
+#include "common/frame_data.glsl"
+
+#ifdef INSTANCED
+#ifndef INSTANCE_DATA_BINDING
+#define INSTANCE_DATA_BINDING 1
+#endif
+// Per-instance model matrices written by mesh_draw_instanced.
+layout(std430, binding = INSTANCE_DATA_BINDING) readonly buffer InstanceData {
+    mat4 models[];
+};
+#define MODEL models[gl_InstanceID]
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#define MODEL model
+#endif
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = frame.view_projection * MODEL * vec4(aPos, 1.0);
     texCoord = aTexCoord;
-}
\ No newline at end of file
+}
@@ -0,0 +1,676 @@
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "bc_encode.h"
+#include "hdr_pack.h"
+#include "thread_pool.h"
+
+#if defined(__SSE2__)
+#define BC_ENCODE_SSE2 1
+#include <emmintrin.h>
+#else
+#define BC_ENCODE_SSE2 0
+#endif
+
+#define REFINE_PASSES 2
+
+// 4 bit index weights shared by BC6H and BC7, out of 64.
+static const int WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+#define W(x) ((float) (x) / 64.0f)
+static const float POSITIONS4[16] = {
+    W(0), W(4), W(9), W(13), W(17), W(21), W(26), W(30), W(34), W(38), W(43), W(47), W(51), W(55), W(60), W(64)
+};
+#undef W
+
+// Position of each BC1 index between the first and second endpoint.
+static const float BC1_POSITIONS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+/**
+ * The 16 texels of a block, channel major so the per texel loops vectorize.
+ */
+typedef struct {
+    float c[4][16];
+} Block;
+
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+    int pos;
+} Bits;
+
+static void put_bits(Bits* bits, uint32_t value, int count) {
+    const uint64_t v = value & ((1u << count) - 1);
+    if (bits->pos >= 64) {
+        bits->hi |= v << (bits->pos - 64);
+    } else {
+        bits->lo |= v << bits->pos;
+        if (bits->pos + count > 64) bits->hi |= v >> (64 - bits->pos);
+    }
+    bits->pos += count;
+}
+
+static uint32_t get_bits(Bits* bits, int count) {
+    uint64_t v;
+    if (bits->pos >= 64) {
+        v = bits->hi >> (bits->pos - 64);
+    } else {
+        v = bits->lo >> bits->pos;
+        if (bits->pos + count > 64) v |= bits->hi << (64 - bits->pos);
+    }
+    bits->pos += count;
+    return (uint32_t) v & ((1u << count) - 1);
+}
+
+// Blocks are little endian regardless of the host.
+static void store_le(uint8_t* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out[i] = (uint8_t) (value >> i * 8);
+}
+
+static uint64_t load_le(const uint8_t* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t) in[i] << i * 8;
+    return value;
+}
+
+static void store_bits(uint8_t* out, const Bits* bits) {
+    store_le(out, bits->lo, 8);
+    store_le(out + 8, bits->hi, 8);
+}
+
+static Bits load_bits(const uint8_t* in) {
+    return (Bits) {load_le(in, 8), load_le(in + 8, 8), 0};
+}
+
+static float clampf(float x, float lo, float hi) {
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+/*
+ * Endpoint fitting shared by every format.
+ */
+
+/**
+ * Fits a line through the texels along their principal axis, found by power iteration on the covariance,
+ * and returns the ends of the projected range.
+ */
+static void fit_line(const Block* b, int channels, float lo[4], float hi[4]) {
+    float mean[4] = {0};
+    for (int c = 0; c < channels; c++) {
+        for (int i = 0; i < 16; i++) mean[c] += b->c[c][i];
+        mean[c] /= 16.0f;
+    }
+
+    float cov[4][4] = {0};
+    for (int c = 0; c < channels; c++) {
+        for (int d = c; d < channels; d++) {
+            float sum = 0.0f;
+            for (int i = 0; i < 16; i++)
+                sum += (b->c[c][i] - mean[c]) * (b->c[d][i] - mean[d]);
+            cov[c][d] = cov[d][c] = sum;
+        }
+    }
+
+    // Starting from the widest channel range converges quickly and never starts orthogonal to the axis.
+    float axis[4] = {0};
+    float widest = -1.0f;
+    for (int c = 0; c < channels; c++) {
+        if (cov[c][c] > widest) {
+            widest = cov[c][c];
+            memset(axis, 0, sizeof(axis));
+            axis[c] = 1.0f;
+        }
+    }
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {0};
+        float length = 0.0f;
+        for (int c = 0; c < channels; c++) {
+            for (int d = 0; d < channels; d++) next[c] += cov[c][d] * axis[d];
+            length += next[c] * next[c];
+        }
+        if (length < 1e-12f) break; // flat block, any axis works
+        length = 1.0f / sqrtf(length);
+        for (int c = 0; c < channels; c++) axis[c] = next[c] * length;
+    }
+
+    float tmin = FLT_MAX, tmax = -FLT_MAX;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++) t += (b->c[c][i] - mean[c]) * axis[c];
+        if (t < tmin) tmin = t;
+        if (t > tmax) tmax = t;
+    }
+    for (int c = 0; c < channels; c++) {
+        lo[c] = mean[c] + axis[c] * tmin;
+        hi[c] = mean[c] + axis[c] * tmax;
+    }
+}
+
+/**
+ * Picks the nearest palette entry for every texel.
+ * @return The summed squared error.
+ */
+static float select_indices(const Block* b, int channels, const float palette[][4], int levels, uint8_t idx[16]) {
+    float error = 0.0f;
+#if BC_ENCODE_SSE2
+    for (int i = 0; i < 16; i += 4) {
+        __m128 best = _mm_set1_ps(FLT_MAX);
+        __m128i bestIndex = _mm_setzero_si128();
+        for (int p = 0; p < levels; p++) {
+            __m128 distance = _mm_setzero_ps();
+            for (int c = 0; c < channels; c++) {
+                const __m128 d = _mm_sub_ps(_mm_loadu_ps(&b->c[c][i]), _mm_set1_ps(palette[p][c]));
+                distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+            }
+            const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+            best = _mm_min_ps(distance, best);
+            bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestIndex));
+        }
+        float distances[4];
+        int32_t indices[4];
+        _mm_storeu_ps(distances, best);
+        _mm_storeu_si128((__m128i*) indices, bestIndex);
+        for (int j = 0; j < 4; j++) {
+            idx[i + j] = (uint8_t) indices[j];
+            error += distances[j];
+        }
+    }
+#else
+    for (int i = 0; i < 16; i++) {
+        float best = FLT_MAX;
+        for (int p = 0; p < levels; p++) {
+            float distance = 0.0f;
+            for (int c = 0; c < channels; c++) {
+                const float d = b->c[c][i] - palette[p][c];
+                distance += d * d;
+            }
+            if (distance < best) {
+                best = distance;
+                idx[i] = (uint8_t) p;
+            }
+        }
+        error += best;
+    }
+#endif
+    return error;
+}
+
+/**
+ * Solves for the endpoints minimizing the error of the given indices, each texel being
+ * (1 - t) * lo + t * hi with t = positions[idx].
+ * @return false if the indices do not determine both endpoints.
+ */
+static bool refine_endpoints(const Block* b, int channels, const uint8_t idx[16], const float* positions,
+                             float lo[4], float hi[4]) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {0}, bx[4] = {0};
+    for (int i = 0; i < 16; i++) {
+        const float t = positions[idx[i]];
+        const float s = 1.0f - t;
+        aa += s * s;
+        ab += s * t;
+        bb += t * t;
+        for (int c = 0; c < channels; c++) {
+            ax[c] += s * b->c[c][i];
+            bx[c] += t * b->c[c][i];
+        }
+    }
+
+    const float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) return false;
+    const float inv = 1.0f / det;
+    for (int c = 0; c < channels; c++) {
+        lo[c] = (bb * ax[c] - ab * bx[c]) * inv;
+        hi[c] = (aa * bx[c] - ab * ax[c]) * inv;
+    }
+    return true;
+}
+
+/*
+ * BC1 and BC3.
+ */
+
+static uint16_t pack565(const float c[4]) {
+    const uint32_t r = (uint32_t) lrintf(clampf(c[0], 0.0f, 255.0f) * 31.0f / 255.0f);
+    const uint32_t g = (uint32_t) lrintf(clampf(c[1], 0.0f, 255.0f) * 63.0f / 255.0f);
+    const uint32_t b = (uint32_t) lrintf(clampf(c[2], 0.0f, 255.0f) * 31.0f / 255.0f);
+    return (uint16_t) (r << 11 | g << 5 | b);
+}
+
+static void unpack565(uint16_t v, int out[3]) {
+    const int r = v >> 11 & 31, g = v >> 5 & 63, b = v & 31;
+    out[0] = r << 3 | r >> 2;
+    out[1] = g << 2 | g >> 4;
+    out[2] = b << 3 | b >> 2;
+}
+
+// Four colour palette, valid whenever c0 > c1 and always for the colour half of BC3.
+static void bc1_palette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+}
+
+typedef struct {
+    uint16_t c0, c1;
+    uint8_t idx[16];
+    float error;
+} Bc1Fit;
+
+static Bc1Fit bc1_try(const Block* b, const float lo[4], const float hi[4]) {
+    Bc1Fit fit;
+    fit.c0 = pack565(lo);
+    fit.c1 = pack565(hi);
+    // The four colour mode needs c0 > c1, swapping the endpoints swaps their meaning for the indices.
+    if (fit.c0 < fit.c1) {
+        const uint16_t t = fit.c0;
+        fit.c0 = fit.c1;
+        fit.c1 = t;
+    }
+
+    int ints[4][3];
+    bc1_palette(fit.c0, fit.c1, ints);
+    float palette[4][4];
+    for (int p = 0; p < 4; p++)
+        for (int c = 0; c < 3; c++) palette[p][c] = (float) ints[p][c];
+
+    // Equal endpoints read as the three colour mode, where only index 0 is still c0.
+    fit.error = select_indices(b, 3, palette, fit.c0 == fit.c1 ? 1 : 4, fit.idx);
+    return fit;
+}
+
+static Bc1Fit bc1_fit(const Block* b, BcQuality quality) {
+    float lo[4], hi[4];
+    fit_line(b, 3, lo, hi);
+    Bc1Fit best = bc1_try(b, lo, hi);
+
+    for (int pass = 0; quality == BC_QUALITY_HIGH && pass < REFINE_PASSES; pass++) {
+        if (best.c0 == best.c1 || !refine_endpoints(b, 3, best.idx, BC1_POSITIONS, lo, hi)) break;
+        const Bc1Fit refined = bc1_try(b, lo, hi);
+        if (refined.error >= best.error) break;
+        best = refined;
+    }
+    return best;
+}
+
+static void bc1_store(const Bc1Fit* fit, uint8_t* out) {
+    uint32_t indices = 0;
+    for (int i = 0; i < 16; i++)
+        indices |= (uint32_t) fit->idx[i] << i * 2;
+    store_le(out, fit->c0, 2);
+    store_le(out + 2, fit->c1, 2);
+    store_le(out + 4, indices, 4);
+}
+
+static void encode_bc1(const Block* b, BcQuality quality, uint8_t* out) {
+    const Bc1Fit fit = bc1_fit(b, quality);
+    bc1_store(&fit, out);
+}
+
+// Eight level alpha with a0 > a1, the block's extremes are the endpoints.
+static void encode_alpha(const Block* b, uint8_t* out) {
+    float amin = 255.0f, amax = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        amin = fminf(amin, b->c[3][i]);
+        amax = fmaxf(amax, b->c[3][i]);
+    }
+    const int a0 = (int) lrintf(amax), a1 = (int) lrintf(amin);
+
+    float palette[8][4] = {{(float) a0}, {(float) a1}};
+    for (int p = 2; p < 8; p++)
+        palette[p][0] = (float) (((8 - p) * a0 + (p - 1) * a1) / 7);
+
+    Block alpha;
+    memcpy(alpha.c[0], b->c[3], sizeof(alpha.c[0]));
+    uint8_t idx[16];
+    select_indices(&alpha, 1, palette, a0 == a1 ? 1 : 8, idx);
+
+    uint64_t bits = (uint64_t) a0 | (uint64_t) a1 << 8;
+    for (int i = 0; i < 16; i++)
+        bits |= (uint64_t) idx[i] << (16 + i * 3);
+    store_le(out, bits, 8);
+}
+
+static void encode_bc3(const Block* b, BcQuality quality, uint8_t* out) {
+    encode_alpha(b, out);
+    encode_bc1(b, quality, out + 8);
+}
+
+/*
+ * BC7 mode 6: 7 bit RGBA endpoints with a p-bit each, 4 bit indices.
+ */
+
+typedef struct {
+    int q[2][4]; // 7 bit endpoints
+    int p[2];
+    uint8_t idx[16];
+    float error;
+} Bc7Fit;
+
+// Picks the p-bit that brings the endpoint closest, it is shared by all four channels.
+static void bc7_quantize(const float v[4], int q[4], int* p) {
+    float bestError = FLT_MAX;
+    for (int bit = 0; bit < 2; bit++) {
+        int candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            candidate[c] = (int) clampf(lrintf((v[c] - (float) bit) * 0.5f), 0.0f, 127.0f);
+            const float d = (float) (candidate[c] << 1 | bit) - v[c];
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            memcpy(q, candidate, sizeof(candidate));
+            *p = bit;
+        }
+    }
+}
+
+static Bc7Fit bc7_try(const Block* b, const float lo[4], const float hi[4]) {
+    Bc7Fit fit;
+    bc7_quantize(lo, fit.q[0], &fit.p[0]);
+    bc7_quantize(hi, fit.q[1], &fit.p[1]);
+
+    float palette[16][4];
+    for (int c = 0; c < 4; c++) {
+        const int e0 = fit.q[0][c] << 1 | fit.p[0];
+        const int e1 = fit.q[1][c] << 1 | fit.p[1];
+        for (int i = 0; i < 16; i++)
+            palette[i][c] = (float) (((64 - WEIGHTS4[i]) * e0 + WEIGHTS4[i] * e1 + 32) >> 6);
+    }
+    fit.error = select_indices(b, 4, palette, 16, fit.idx);
+    return fit;
+}
+
+static void encode_bc7(const Block* b, BcQuality quality, uint8_t* out) {
+    float lo[4], hi[4];
+    fit_line(b, 4, lo, hi);
+    Bc7Fit fit = bc7_try(b, lo, hi);
+    for (int pass = 0; quality == BC_QUALITY_HIGH && pass < REFINE_PASSES; pass++) {
+        if (!refine_endpoints(b, 4, fit.idx, POSITIONS4, lo, hi)) break;
+        const Bc7Fit refined = bc7_try(b, lo, hi);
+        if (refined.error >= fit.error) break;
+        fit = refined;
+    }
+
+    // The first index is stored without its top bit, swapping the endpoints mirrors the weights exactly.
+    const int flip = fit.idx[0] >= 8;
+    const int first = flip, second = !flip;
+
+    Bits bits = {0};
+    put_bits(&bits, 1u << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        put_bits(&bits, (uint32_t) fit.q[first][c], 7);
+        put_bits(&bits, (uint32_t) fit.q[second][c], 7);
+    }
+    put_bits(&bits, (uint32_t) fit.p[first], 1);
+    put_bits(&bits, (uint32_t) fit.p[second], 1);
+    for (int i = 0; i < 16; i++) {
+        const uint32_t index = flip ? 15u - fit.idx[i] : fit.idx[i];
+        put_bits(&bits, index, i == 0 ? 3 : 4);
+    }
+    store_bits(out, &bits);
+}
+
+/*
+ * BC6H mode 11: unsigned, 10 bit endpoints without deltas, 4 bit indices.
+ * Fitting happens in the interpolation domain, where half float bits h sit at h * 64 / 31.
+ */
+
+static int bc6h_unquantize(int q) {
+    if (q == 0) return 0;
+    if (q == 1023) return 0xFFFF;
+    return q * 64 + 32;
+}
+
+static int bc6h_quantize(float v) {
+    return (int) clampf(lrintf((v - 32.0f) / 64.0f), 0.0f, 1023.0f);
+}
+
+static int bc6h_finish(int interpolated) {
+    return interpolated * 31 >> 6;
+}
+
+typedef struct {
+    int q[2][3];
+    uint8_t idx[16];
+    float error;
+} Bc6hFit;
+
+static Bc6hFit bc6h_try(const Block* b, const float lo[4], const float hi[4]) {
+    Bc6hFit fit;
+    float palette[16][4];
+    for (int c = 0; c < 3; c++) {
+        fit.q[0][c] = bc6h_quantize(lo[c]);
+        fit.q[1][c] = bc6h_quantize(hi[c]);
+        const int e0 = bc6h_unquantize(fit.q[0][c]), e1 = bc6h_unquantize(fit.q[1][c]);
+        for (int i = 0; i < 16; i++) {
+            const int half = bc6h_finish(((64 - WEIGHTS4[i]) * e0 + WEIGHTS4[i] * e1 + 32) >> 6);
+            palette[i][c] = (float) half * 64.0f / 31.0f;
+        }
+    }
+    fit.error = select_indices(b, 3, palette, 16, fit.idx);
+    return fit;
+}
+
+static void encode_bc6h(const Block* b, BcQuality quality, uint8_t* out) {
+    float lo[4], hi[4];
+    fit_line(b, 3, lo, hi);
+    Bc6hFit fit = bc6h_try(b, lo, hi);
+    for (int pass = 0; quality == BC_QUALITY_HIGH && pass < REFINE_PASSES; pass++) {
+        if (!refine_endpoints(b, 3, fit.idx, POSITIONS4, lo, hi)) break;
+        const Bc6hFit refined = bc6h_try(b, lo, hi);
+        if (refined.error >= fit.error) break;
+        fit = refined;
+    }
+
+    const int flip = fit.idx[0] >= 8;
+    const int first = flip, second = !flip;
+
+    Bits bits = {0};
+    put_bits(&bits, 0x03, 5);
+    for (int c = 0; c < 3; c++) put_bits(&bits, (uint32_t) fit.q[first][c], 10);
+    for (int c = 0; c < 3; c++) put_bits(&bits, (uint32_t) fit.q[second][c], 10);
+    for (int i = 0; i < 16; i++) {
+        const uint32_t index = flip ? 15u - fit.idx[i] : fit.idx[i];
+        put_bits(&bits, index, i == 0 ? 3 : 4);
+    }
+    store_bits(out, &bits);
+}
+
+/*
+ * Images.
+ */
+
+static void load_block(BcFormat format, const void* pixels, int width, int height, int bx, int by, Block* b) {
+    for (int i = 0; i < 16; i++) {
+        int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+        if (x >= width) x = width - 1;
+        if (y >= height) y = height - 1;
+        const size_t texel = (size_t) y * width + x;
+
+        if (format == BC_FORMAT_BC6H) {
+            const float* rgb = (const float*) pixels + texel * 3;
+            for (int c = 0; c < 3; c++)
+                b->c[c][i] = (float) hdr_half_from_float(rgb[c]) * 64.0f / 31.0f;
+            b->c[3][i] = 0.0f;
+        } else {
+            const uint8_t* rgba = (const uint8_t*) pixels + texel * 4;
+            for (int c = 0; c < 4; c++) b->c[c][i] = (float) rgba[c];
+        }
+    }
+}
+
+typedef struct {
+    BcFormat format;
+    BcQuality quality;
+    const void* pixels;
+    int width;
+    int height;
+    uint8_t* out;
+} EncodeJob;
+
+static void encode_row(void* ctx, int by) {
+    const EncodeJob* job = ctx;
+    const int blocksX = (job->width + 3) / 4;
+    const size_t blockSize = bc_block_size(job->format);
+    uint8_t* out = job->out + (size_t) by * blocksX * blockSize;
+
+    for (int bx = 0; bx < blocksX; bx++, out += blockSize) {
+        Block b;
+        load_block(job->format, job->pixels, job->width, job->height, bx, by, &b);
+        switch (job->format) {
+            case BC_FORMAT_BC1: encode_bc1(&b, job->quality, out); break;
+            case BC_FORMAT_BC3: encode_bc3(&b, job->quality, out); break;
+            case BC_FORMAT_BC6H: encode_bc6h(&b, job->quality, out); break;
+            case BC_FORMAT_BC7: encode_bc7(&b, job->quality, out); break;
+        }
+    }
+}
+
+size_t bc_block_size(BcFormat format) {
+    return format == BC_FORMAT_BC1 ? 8 : 16;
+}
+
+size_t bc_image_size(BcFormat format, int width, int height) {
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * bc_block_size(format);
+}
+
+bool bc_format_is_hdr(BcFormat format) {
+    return format == BC_FORMAT_BC6H;
+}
+
+const char* bc_format_name(BcFormat format) {
+    switch (format) {
+        case BC_FORMAT_BC1: return "BC1";
+        case BC_FORMAT_BC3: return "BC3";
+        case BC_FORMAT_BC6H: return "BC6H";
+        case BC_FORMAT_BC7: return "BC7";
+        default: return "unknown";
+    }
+}
+
+void bc_encode_image(BcFormat format, BcQuality quality, const void* pixels, int width, int height, void* out) {
+    EncodeJob job = {format, quality, pixels, width, height, out};
+    thread_pool_parallel_for(thread_pool_shared(), (height + 3) / 4, encode_row, &job);
+}
+
+/*
+ * Decoders, used to measure the encoders.
+ */
+
+static void decode_bc1(const uint8_t* in, bool forceFourColor, uint8_t texels[16][4]) {
+    const uint16_t c0 = (uint16_t) load_le(in, 2), c1 = (uint16_t) load_le(in + 2, 2);
+    const uint32_t indices = (uint32_t) load_le(in + 4, 4);
+
+    int palette[4][3];
+    bc1_palette(c0, c1, palette);
+    int alpha3 = 255;
+    if (c0 <= c1 && !forceFourColor) {
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+        alpha3 = 0;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        const int p = indices >> i * 2 & 3;
+        for (int c = 0; c < 3; c++) texels[i][c] = (uint8_t) palette[p][c];
+        texels[i][3] = (uint8_t) (p == 3 ? alpha3 : 255);
+    }
+}
+
+static void decode_alpha(const uint8_t* in, uint8_t texels[16][4]) {
+    const uint64_t bits = load_le(in, 8);
+    const int a0 = in[0], a1 = in[1];
+    int palette[8] = {a0, a1};
+    if (a0 > a1) {
+        for (int p = 2; p < 8; p++) palette[p] = ((8 - p) * a0 + (p - 1) * a1) / 7;
+    } else {
+        for (int p = 2; p < 6; p++) palette[p] = ((6 - p) * a0 + (p - 1) * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    for (int i = 0; i < 16; i++)
+        texels[i][3] = (uint8_t) palette[bits >> (16 + i * 3) & 7];
+}
+
+static void decode_bc7(const uint8_t* in, uint8_t texels[16][4]) {
+    Bits bits = load_bits(in);
+    if (get_bits(&bits, 7) != 1u << 6) {
+        memset(texels, 0, 16 * 4);
+        return;
+    }
+
+    int e[2][4];
+    for (int c = 0; c < 4; c++) {
+        e[0][c] = (int) get_bits(&bits, 7) << 1;
+        e[1][c] = (int) get_bits(&bits, 7) << 1;
+    }
+    const int p0 = (int) get_bits(&bits, 1), p1 = (int) get_bits(&bits, 1);
+    for (int c = 0; c < 4; c++) {
+        e[0][c] |= p0;
+        e[1][c] |= p1;
+    }
+    for (int i = 0; i < 16; i++) {
+        const int w = WEIGHTS4[get_bits(&bits, i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++)
+            texels[i][c] = (uint8_t) (((64 - w) * e[0][c] + w * e[1][c] + 32) >> 6);
+    }
+}
+
+static void decode_bc6h(const uint8_t* in, float texels[16][3]) {
+    Bits bits = load_bits(in);
+    if (get_bits(&bits, 5) != 0x03) {
+        memset(texels, 0, 16 * 3 * sizeof(float));
+        return;
+    }
+
+    int e[2][3];
+    for (int j = 0; j < 2; j++)
+        for (int c = 0; c < 3; c++) e[j][c] = bc6h_unquantize((int) get_bits(&bits, 10));
+    for (int i = 0; i < 16; i++) {
+        const int w = WEIGHTS4[get_bits(&bits, i == 0 ? 3 : 4)];
+        for (int c = 0; c < 3; c++) {
+            const int half = bc6h_finish(((64 - w) * e[0][c] + w * e[1][c] + 32) >> 6);
+            texels[i][c] = hdr_half_to_float((uint16_t) half);
+        }
+    }
+}
+
+void bc_decode_image(BcFormat format, const void* blocks, int width, int height, void* out) {
+    const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    const size_t blockSize = bc_block_size(format);
+    const uint8_t* in = blocks;
+
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++, in += blockSize) {
+            uint8_t ldr[16][4];
+            float hdr[16][3];
+            switch (format) {
+                case BC_FORMAT_BC1: decode_bc1(in, false, ldr); break;
+                case BC_FORMAT_BC3:
+                    decode_bc1(in + 8, true, ldr);
+                    decode_alpha(in, ldr);
+                    break;
+                case BC_FORMAT_BC6H: decode_bc6h(in, hdr); break;
+                case BC_FORMAT_BC7: decode_bc7(in, ldr); break;
+            }
+
+            for (int i = 0; i < 16; i++) {
+                const int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+                if (x >= width || y >= height) continue;
+                const size_t texel = (size_t) y * width + x;
+                if (format == BC_FORMAT_BC6H) memcpy((float*) out + texel * 3, hdr[i], sizeof(hdr[i]));
+                else memcpy((uint8_t*) out + texel * 4, ldr[i], sizeof(ldr[i]));
+            }
+        }
+    }
+}
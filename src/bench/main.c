@@ -0,0 +1,779 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <strings.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <cglm/cglm.h>
+
+#include "shader.h"
+#include "mesh.h"
+#include "hdr_pack.h"
+#include "bc_encode.h"
+#include "ktx2.h"
+#include "mip_builder.h"
+#include "env_map.h"
+#include "texture_helper.h"
+#include "texture_container.h"
+#include "texture_atlas.h"
+#include "gl_state.h"
+#include "thread_pool.h"
+#include "stb/stb_image.h"
+
+#define UNIFORM_SETS 100000
+
+// Half the resolution of the BlackHole star map in each direction.
+#define HDR_WIDTH 4096
+#define HDR_HEIGHT 2048
+#define HDR_FRAMES 20
+#define HDR_SAMPLES 16
+
+#define BC_IMAGE "../resources/container.jpg"
+#define BC_KTX2 "bench_container.ktx2"
+#define BC_LOADS 10
+
+#define MIP_ASSET "bench_mips.bin"
+
+#define ENV_FRAMES 20
+#define ENV_SAMPLES 16
+
+#define STARTUP_HDR "bench_sky.hdr"
+#define STARTUP_LOADS 3
+
+#define ATLAS_IMAGES 256
+
+// Every JPG, PNG and HDR file in COPENGL_BENCH_TEXTURES, or here, plus a synthetic HDR file.
+#define BATCH_DIR "../resources"
+#define BATCH_HDR "bench_batch.hdr"
+#define BATCH_MAX_FILES 256
+
+typedef struct {
+    const char* name;
+    void (*run)(void);
+} Benchmark;
+
+void bench_uniforms(void);
+
+void bench_hdr_formats(void);
+
+void bench_bc_compression(void);
+
+void bench_mipmaps(void);
+
+void bench_env_maps(void);
+
+void bench_texture_startup(void);
+
+void bench_atlas(void);
+
+void bench_batch_load(void);
+
+static const Benchmark BENCHMARKS[] = {
+    {"uniforms", bench_uniforms},
+    {"hdr_formats", bench_hdr_formats},
+    {"bc_compression", bench_bc_compression},
+    {"mipmaps", bench_mipmaps},
+    {"env_maps", bench_env_maps},
+    {"texture_startup", bench_texture_startup},
+    {"atlas", bench_atlas},
+    {"batch_load", bench_batch_load},
+};
+
+int main(int argc, char** argv) {
+    if (!glfwInit()) {
+        printf("Failed to initialize GLFW\n");
+        return -1;
+    }
+
+    // The benchmarks only need a context, so the window is never shown.
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "Benchmark", NULL, NULL);
+    if (!window) {
+        printf("Failed to create window\n");
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+
+    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+        printf("Failed to initialize GLAD\n");
+        return -1;
+    }
+
+    printf("OpenGL Version: %s\n", glGetString(GL_VERSION));
+    printf("Renderer: %s\n", glGetString(GL_RENDERER));
+
+    for (size_t i = 0; i < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); i++) {
+        if (argc > 1 && strcmp(argv[1], BENCHMARKS[i].name) != 0)
+            continue;
+        printf("\n== %s ==\n", BENCHMARKS[i].name);
+        BENCHMARKS[i].run();
+    }
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
+
+// Compares setting "model" through a driver lookup on every call with the link time table and a pre-resolved handle.
+void bench_uniforms(void) {
+    Shader shader = create_shader("../shaders/vertex_shader.vert", "../shaders/fragment_shader.frag");
+    shader_use(shader);
+
+    mat4 model = GLM_MAT4_IDENTITY_INIT;
+    glFinish();
+
+    double start = glfwGetTime();
+    for (int i = 0; i < UNIFORM_SETS; i++) {
+        model[3][0] = (float) i;
+        glUniformMatrix4fv(glGetUniformLocation(shader.id, "model"), 1, GL_FALSE, (float*) model);
+    }
+    glFinish();
+    const double lookup = glfwGetTime() - start;
+
+    start = glfwGetTime();
+    for (int i = 0; i < UNIFORM_SETS; i++) {
+        model[3][0] = (float) i;
+        shader_uMat4f(shader, "model", model);
+    }
+    glFinish();
+    const double table = glfwGetTime() - start;
+
+    const GLint location = shader_uniform_location(shader, "model");
+    start = glfwGetTime();
+    for (int i = 0; i < UNIFORM_SETS; i++) {
+        model[3][0] = (float) i;
+        shader_uMat4f_loc(shader, location, model);
+    }
+    glFinish();
+    const double handle = glfwGetTime() - start;
+
+    printf("%d sets of mat4 \"model\"\n", UNIFORM_SETS);
+    printf("  glGetUniformLocation per set: %8.3f ms (%6.1f ns/set)\n", lookup * 1e3, lookup * 1e9 / UNIFORM_SETS);
+    printf("  link time table by name:      %8.3f ms (%6.1f ns/set)\n", table * 1e3, table * 1e9 / UNIFORM_SETS);
+    printf("  pre-resolved handle:          %8.3f ms (%6.1f ns/set)\n", handle * 1e3, handle * 1e9 / UNIFORM_SETS);
+
+    shader_delete(&shader);
+}
+
+// A dim sky with sparse bright stars, deterministic so runs compare.
+static float* synthetic_hdr(int width, int height) {
+    float* rgb = malloc((size_t) width * height * 3 * sizeof(float));
+    if (!rgb) return NULL;
+
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < (size_t) width * height; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        const float sky = 0.02f + 0.05f * (float) (i / width) / (float) height;
+        const float star = (seed >> 24) == 0 ? (float) (seed & 0xFFFF) * 0.1f : 0.0f;
+        rgb[i * 3 + 0] = sky + star;
+        rgb[i * 3 + 1] = sky * 0.9f + star * 0.8f;
+        rgb[i * 3 + 2] = sky * 1.2f + star * 0.6f;
+    }
+    return rgb;
+}
+
+// Compares the CPU conversion kernels, then the GPU cost of sampling the map in each format.
+void bench_hdr_formats(void) {
+    static const GLenum FORMATS[] = {GL_RGB32F, GL_RGBA16F, GL_R11F_G11F_B10F, GL_RGB9_E5};
+    const size_t count = (size_t) HDR_WIDTH * HDR_HEIGHT;
+
+    float* rgb = synthetic_hdr(HDR_WIDTH, HDR_HEIGHT);
+    void* packed = malloc(count * 12);
+    if (!rgb || !packed) {
+        printf("Out of memory\n");
+        free(rgb);
+        free(packed);
+        return;
+    }
+
+    printf("Packing %dx%d float RGB texels\n", HDR_WIDTH, HDR_HEIGHT);
+    const HdrPackLevel best = hdr_pack_level();
+    for (size_t f = 1; f < sizeof(FORMATS) / sizeof(FORMATS[0]); f++) {
+        for (int level = HDR_PACK_SCALAR; level <= (int) best; level++) {
+            hdr_pack_set_level((HdrPackLevel) level);
+            double fastest = 1e9;
+            for (int run = 0; run < 3; run++) {
+                const double start = glfwGetTime();
+                hdr_pack(FORMATS[f], rgb, packed, count);
+                const double elapsed = glfwGetTime() - start;
+                if (elapsed < fastest) fastest = elapsed;
+            }
+            printf("  %-15s %-6s %8.2f ms (%5.2f GB/s read)\n", hdr_pack_format_name(FORMATS[f]),
+                   hdr_pack_level_name((HdrPackLevel) level), fastest * 1e3, count * 12 / fastest * 1e-9);
+        }
+    }
+    hdr_pack_set_level(best);
+
+    const int width = 1920, height = 1080;
+    GLuint target, fbo;
+    glCreateTextures(GL_TEXTURE_2D, 1, &target);
+    glTextureStorage2D(target, 1, GL_RGBA8, width, height);
+    glCreateFramebuffers(1, &fbo);
+    glNamedFramebufferTexture(fbo, GL_COLOR_ATTACHMENT0, target, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+
+    Shader shader = create_shader("../shaders/simple.vert", "../shaders/bench/hdr_sample.frag");
+    shader_use(shader);
+    shader_u1i(shader, "equirectangularMap", 0);
+    shader_u2f(shader, "resolution", (float) width, (float) height);
+    shader_u1i(shader, "samples", HDR_SAMPLES);
+    Mesh quad = shape_square();
+    mesh_bind(quad);
+
+    GLuint query;
+    glGenQueries(1, &query);
+
+    printf("Sampling at %dx%d, %d fetches per fragment, %d frames\n", width, height, HDR_SAMPLES, HDR_FRAMES);
+    for (size_t f = 0; f < sizeof(FORMATS) / sizeof(FORMATS[0]); f++) {
+        GLenum format, type;
+        hdr_pack_upload_format(FORMATS[f], &format, &type);
+        hdr_pack(FORMATS[f], rgb, packed, count);
+
+        GLuint texture;
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+        glTextureStorage2D(texture, 1, FORMATS[f], HDR_WIDTH, HDR_HEIGHT);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTextureSubImage2D(texture, 0, 0, 0, HDR_WIDTH, HDR_HEIGHT, format, type, packed);
+        glBindTextureUnit(0, texture);
+
+        // One warm up frame keeps the upload out of the measurement.
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glFinish();
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int i = 0; i < HDR_FRAMES; i++)
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+
+        const double megabytes = (double) count * hdr_pack_texel_size(FORMATS[f]) / (1024.0 * 1024.0);
+        printf("  %-15s %7.1f MB  %7.3f ms/frame\n", hdr_pack_format_name(FORMATS[f]), megabytes,
+               (double) elapsed * 1e-6 / HDR_FRAMES);
+        glDeleteTextures(1, &texture);
+    }
+
+    glDeleteQueries(1, &query);
+    mesh_destroy(&quad);
+    shader_delete(&shader);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &target);
+    free(packed);
+    free(rgb);
+}
+
+static double psnr_rgba8(const unsigned char* a, const unsigned char* b, size_t texels, int channels) {
+    double squared = 0.0;
+    for (size_t i = 0; i < texels; i++) {
+        for (int c = 0; c < channels; c++) {
+            const double d = (double) a[i * 4 + c] - b[i * 4 + c];
+            squared += d * d;
+        }
+    }
+    const double mse = squared / ((double) texels * channels);
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+// Relative error in stops, which is what the eye sees of an HDR image.
+static double rms_log2_rgb(const float* a, const float* b, size_t texels) {
+    double squared = 0.0;
+    for (size_t i = 0; i < texels * 3; i++) {
+        const double d = log2(a[i] + 1e-3) - log2(b[i] + 1e-3);
+        squared += d * d;
+    }
+    return sqrt(squared / ((double) texels * 3));
+}
+
+/*
+ * Encode time, quality and size of every block format and preset, then the cost of loading the
+ * texture through stb_image plus a CPU built chain against uploading a precompressed KTX2 chain.
+ */
+void bench_bc_compression(void) {
+    int width, height, channels;
+    unsigned char* rgba = stbi_load(BC_IMAGE, &width, &height, &channels, 4);
+    float* rgb = synthetic_hdr(HDR_WIDTH / 4, HDR_HEIGHT / 4);
+    if (!rgba || !rgb) {
+        printf("Failed to load %s\n", BC_IMAGE);
+        stbi_image_free(rgba);
+        free(rgb);
+        return;
+    }
+
+    static const BcFormat FORMATS[] = {BC_FORMAT_BC1, BC_FORMAT_BC3, BC_FORMAT_BC7, BC_FORMAT_BC6H};
+    static const char* QUALITY_NAMES[] = {"fast", "high"};
+    printf("%s (%dx%d) for BC1/3/7, synthetic %dx%d sky for BC6H\n", BC_IMAGE, width, height,
+           HDR_WIDTH / 4, HDR_HEIGHT / 4);
+
+    for (size_t f = 0; f < sizeof(FORMATS) / sizeof(FORMATS[0]); f++) {
+        const BcFormat format = FORMATS[f];
+        const bool hdr = bc_format_is_hdr(format);
+        const int w = hdr ? HDR_WIDTH / 4 : width, h = hdr ? HDR_HEIGHT / 4 : height;
+        const size_t texels = (size_t) w * h;
+        const size_t size = bc_image_size(format, w, h);
+        void* blocks = malloc(size);
+        void* decoded = malloc(texels * (hdr ? 3 * sizeof(float) : 4));
+        if (!blocks || !decoded) {
+            free(blocks);
+            free(decoded);
+            continue;
+        }
+
+        for (int quality = BC_QUALITY_FAST; quality <= BC_QUALITY_HIGH; quality++) {
+            const double start = glfwGetTime();
+            bc_encode_image(format, (BcQuality) quality, hdr ? (const void*) rgb : rgba, w, h, blocks);
+            const double elapsed = glfwGetTime() - start;
+            bc_decode_image(format, blocks, w, h, decoded);
+
+            printf("  %-5s %-4s %8.2f ms (%6.1f MTexel/s) %6.2f MB %4.1fx  ", bc_format_name(format),
+                   QUALITY_NAMES[quality], elapsed * 1e3, texels / elapsed * 1e-6, size / (1024.0 * 1024.0),
+                   (double) texels * (hdr ? 8 : 4) / size);
+            if (hdr) printf("rms %.4f stops\n", rms_log2_rgb(rgb, decoded, texels));
+            else printf("PSNR %.2f dB\n", psnr_rgba8(rgba, decoded, texels, format == BC_FORMAT_BC1 ? 3 : 4));
+        }
+        free(blocks);
+        free(decoded);
+    }
+
+    // Full BC7 chain for the load comparison, box filtered in gamma space like glGenerateMipmap.
+    const MipDesc mipDesc = {4, false, false, MIP_FILTER_BOX};
+    MipChain chain;
+    const bool built = mip_build(&mipDesc, rgba, width, height, &chain);
+    const int levelCount = built ? chain.levelCount : 0;
+    void* levels[KTX2_MAX_LEVELS] = {0};
+    for (int level = 0; level < levelCount; level++) {
+        levels[level] = malloc(bc_image_size(BC_FORMAT_BC7, chain.widths[level], chain.heights[level]));
+        if (!levels[level]) break;
+        bc_encode_image(BC_FORMAT_BC7, BC_QUALITY_FAST, chain.levels[level], chain.widths[level],
+                        chain.heights[level], levels[level]);
+    }
+    mip_chain_free(&chain);
+    bool written = built;
+    for (int level = 0; level < levelCount; level++) written = written && levels[level];
+    written = written && ktx2_write(BC_KTX2, BC_FORMAT_BC7, false, width, height, levelCount,
+                                    (const void* const*) levels);
+    for (int level = 0; level < levelCount; level++) free(levels[level]);
+
+    if (written) {
+        GLuint textures[BC_LOADS];
+        int w, h, c;
+        glFinish();
+        double start = glfwGetTime();
+        for (int i = 0; i < BC_LOADS; i++) textures[i] = gen_texture_whcf(BC_IMAGE, &w, &h, &c, GL_RGB);
+        glFinish();
+        const double plain = (glfwGetTime() - start) / BC_LOADS;
+        glDeleteTextures(BC_LOADS, textures);
+
+        start = glfwGetTime();
+        for (int i = 0; i < BC_LOADS; i++) textures[i] = gen_texture_ktx2(BC_KTX2, &w, &h);
+        glFinish();
+        const double compressed = (glfwGetTime() - start) / BC_LOADS;
+        glDeleteTextures(BC_LOADS, textures);
+
+        printf("Load with mips, average of %d\n", BC_LOADS);
+        printf("  stb_image + cached chain:     %8.2f ms, %6.2f MB VRAM\n", plain * 1e3,
+               width * height * 4 * 4.0 / 3.0 / (1024.0 * 1024.0));
+        printf("  KTX2 BC7 chain:               %8.2f ms, %6.2f MB VRAM\n", compressed * 1e3,
+               width * height * 4.0 / 3.0 / (1024.0 * 1024.0));
+        remove(BC_KTX2);
+    }
+
+    stbi_image_free(rgba);
+    free(rgb);
+}
+
+static double time_mip_build(const MipDesc* desc, const void* pixels, int width, int height) {
+    double fastest = 1e9;
+    for (int run = 0; run < 3; run++) {
+        MipChain chain;
+        const double start = glfwGetTime();
+        const bool ok = mip_build(desc, pixels, width, height, &chain);
+        const double elapsed = glfwGetTime() - start;
+        mip_chain_free(&chain);
+        if (!ok) return -1.0;
+        if (elapsed < fastest) fastest = elapsed;
+    }
+    return fastest;
+}
+
+/*
+ * glGenerateMipmap against the CPU builder with each filter, for 8 bit sRGB and float images at half the size
+ * of the star map, then the cost of reading a chain back from the texture container the loaders keep.
+ */
+void bench_mipmaps(void) {
+    const size_t count = (size_t) HDR_WIDTH * HDR_HEIGHT;
+    float* rgb = synthetic_hdr(HDR_WIDTH, HDR_HEIGHT);
+    unsigned char* rgba = malloc(count * 4);
+    if (!rgb || !rgba) {
+        printf("Out of memory\n");
+        free(rgb);
+        free(rgba);
+        return;
+    }
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < count * 4; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        rgba[i] = (unsigned char) (seed >> 24);
+    }
+
+    GLuint texture;
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture, mip_level_count(HDR_WIDTH, HDR_HEIGHT), GL_SRGB8_ALPHA8, HDR_WIDTH, HDR_HEIGHT);
+    glTextureSubImage2D(texture, 0, 0, 0, HDR_WIDTH, HDR_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    glFinish();
+    double start = glfwGetTime();
+    glGenerateTextureMipmap(texture);
+    glFinish();
+    const double gpu = glfwGetTime() - start;
+    glDeleteTextures(1, &texture);
+
+    printf("%dx%d, %d levels, best of 3\n", HDR_WIDTH, HDR_HEIGHT, mip_level_count(HDR_WIDTH, HDR_HEIGHT));
+    printf("  glGenerateMipmap SRGB8_A8 %8.2f ms\n", gpu * 1e3);
+    static const char* FILTER_NAMES[] = {"box", "kaiser"};
+    for (int filter = MIP_FILTER_BOX; filter <= MIP_FILTER_KAISER; filter++) {
+        const MipDesc srgb = {4, false, true, (MipFilter) filter};
+        const MipDesc hdr = {3, true, false, (MipFilter) filter};
+        printf("  CPU %-6s sRGB RGBA8    %8.2f ms\n", FILTER_NAMES[filter],
+               time_mip_build(&srgb, rgba, HDR_WIDTH, HDR_HEIGHT) * 1e3);
+        printf("  CPU %-6s float RGB     %8.2f ms\n", FILTER_NAMES[filter],
+               time_mip_build(&hdr, rgb, HDR_WIDTH, HDR_HEIGHT) * 1e3);
+    }
+
+    // The container is keyed on the asset's size and time stamp, so any file stands in for it.
+    FILE* asset = fopen(MIP_ASSET, "wb");
+    if (asset) {
+        fwrite(rgba, 1, 4096, asset);
+        fclose(asset);
+
+        const MipDesc desc = {4, false, true, MIP_FILTER_KAISER};
+        const uint64_t key = texture_container_key(MIP_ASSET, &desc, true);
+        MipChain chain;
+        start = glfwGetTime();
+        bool ok = key && mip_build(&desc, rgba, HDR_WIDTH, HDR_HEIGHT, &chain);
+        if (ok) {
+            ok = texture_container_write(MIP_ASSET TEXTURE_CONTAINER_EXTENSION, key, GL_SRGB8_ALPHA8, GL_RGBA,
+                                         GL_UNSIGNED_BYTE, desc.channels, mip_texel_size(&desc), &chain);
+            mip_chain_free(&chain);
+        }
+        const double stored = glfwGetTime() - start;
+        TextureContainer container;
+        start = glfwGetTime();
+        ok = ok && texture_container_open(MIP_ASSET TEXTURE_CONTAINER_EXTENSION, key, &container);
+        const double loaded = glfwGetTime() - start;
+        if (ok) texture_container_close(&container);
+
+        if (ok) {
+            printf("  Kaiser sRGB, build + store %8.2f ms\n", stored * 1e3);
+            printf("  Kaiser sRGB, container read %7.2f ms\n", loaded * 1e3);
+        }
+        remove(MIP_ASSET);
+        remove(MIP_ASSET TEXTURE_CONTAINER_EXTENSION);
+    }
+
+    free(rgba);
+    free(rgb);
+}
+
+/*
+ * CPU cost of converting the synthetic sky into each layout, then the GPU cost of sampling it along view rays
+ * that sweep the whole sphere. Every layout is stored as RGB9_E5 with a Kaiser filtered chain.
+ */
+void bench_env_maps(void) {
+    static const EnvMapLayout LAYOUTS[] = {ENV_MAP_EQUIRECT, ENV_MAP_CUBE, ENV_MAP_OCTAHEDRAL};
+    static const char* LAYOUT_NAMES[] = {"equirect", "cube", "octahedral"};
+    float* rgb = synthetic_hdr(HDR_WIDTH, HDR_HEIGHT);
+    if (!rgb) {
+        printf("Out of memory\n");
+        return;
+    }
+
+    const int width = 1920, height = 1080;
+    GLuint target, fbo;
+    glCreateTextures(GL_TEXTURE_2D, 1, &target);
+    glTextureStorage2D(target, 1, GL_RGBA8, width, height);
+    glCreateFramebuffers(1, &fbo);
+    glNamedFramebufferTexture(fbo, GL_COLOR_ATTACHMENT0, target, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    Mesh quad = shape_square();
+    mesh_bind(quad);
+    GLuint query;
+    glGenQueries(1, &query);
+
+    printf("%dx%d sky, sampled at %dx%d, %d fetches per fragment, %d frames\n", HDR_WIDTH, HDR_HEIGHT, width,
+           height, ENV_SAMPLES, ENV_FRAMES);
+    for (size_t l = 0; l < sizeof(LAYOUTS) / sizeof(LAYOUTS[0]); l++) {
+        EnvMap map;
+        const double start = glfwGetTime();
+        if (!env_map_from_equirect(rgb, HDR_WIDTH, HDR_HEIGHT, LAYOUTS[l], 0, MIP_FILTER_KAISER, &map)) {
+            printf("  %-10s out of memory\n", LAYOUT_NAMES[l]);
+            continue;
+        }
+        const double convert = glfwGetTime() - start;
+        const GLuint texture = gen_env_map_texture(&map, GL_RGB9_E5);
+        const double megabytes = (double) map.faces[0].widths[0] * map.faces[0].heights[0] * map.faceCount *
+                                 hdr_pack_texel_size(GL_RGB9_E5) / (1024.0 * 1024.0);
+        const int size = map.size, faceCount = map.faceCount;
+        env_map_free(&map);
+
+        const Shader shader = shader_variant("../shaders/simple.vert", "../shaders/bench/env_sample.frag",
+                                             env_map_define(LAYOUTS[l]));
+        shader_use(shader);
+        shader_u1i(shader, "environmentMap", 0);
+        shader_u2f(shader, "resolution", (float) width, (float) height);
+        shader_u1i(shader, "samples", ENV_SAMPLES);
+        shader_u1f(shader, "pixelAngle", 2.0f / (float) width);
+        glBindTextureUnit(0, texture);
+
+        // One warm up frame keeps the upload out of the measurement.
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glFinish();
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int i = 0; i < ENV_FRAMES; i++)
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+
+        printf("  %-10s %5d x %d  %6.1f MB  converted in %7.1f ms  %7.3f ms/frame\n", LAYOUT_NAMES[l], size,
+               faceCount, megabytes, convert * 1e3, (double) elapsed * 1e-6 / ENV_FRAMES);
+        glDeleteTextures(1, &texture);
+    }
+
+    glDeleteQueries(1, &query);
+    mesh_destroy(&quad);
+    shader_variants_clear();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &target);
+    free(rgb);
+}
+
+// Flat RGBE scanlines, which every Radiance reader takes.
+static bool write_hdr(const char* path, const float* rgb, int width, int height) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    fprintf(file, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+    bool ok = true;
+    for (size_t i = 0; i < (size_t) width * height && ok; i++) {
+        const float* p = rgb + i * 3;
+        const float v = p[0] > p[1] ? (p[0] > p[2] ? p[0] : p[2]) : (p[1] > p[2] ? p[1] : p[2]);
+        unsigned char rgbe[4] = {0, 0, 0, 0};
+        if (v > 1e-32f) {
+            int exponent;
+            const float scale = frexpf(v, &exponent) * 256.0f / v;
+            rgbe[0] = (unsigned char) (p[0] * scale);
+            rgbe[1] = (unsigned char) (p[1] * scale);
+            rgbe[2] = (unsigned char) (p[2] * scale);
+            rgbe[3] = (unsigned char) (exponent + 128);
+        }
+        ok = fwrite(rgbe, 4, 1, file) == 1;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+static double time_texture_load(const char* path, bool hdr, GLint format) {
+    int width, height, channels;
+    const double start = glfwGetTime();
+    GLuint texture = hdr ? gen_skybox_texture((char*) path)
+                         : gen_texture_whcf((char*) path, &width, &height, &channels, format);
+    glFinish();
+    const double elapsed = glfwGetTime() - start;
+    glDeleteTextures(1, &texture);
+    return elapsed;
+}
+
+/*
+ * Time from file to usable texture for each source format: stb_image decoding alone, the first load that decodes,
+ * builds the Kaiser chain and writes the container, and later loads that map the container instead.
+ * The files are in the page cache for every load, so this measures CPU work rather than the disk.
+ */
+void bench_texture_startup(void) {
+    float* rgb = synthetic_hdr(HDR_WIDTH, HDR_HEIGHT);
+    const bool hdrWritten = rgb && write_hdr(STARTUP_HDR, rgb, HDR_WIDTH, HDR_HEIGHT);
+    free(rgb);
+    if (!hdrWritten) printf("Could not write %s, skipping HDR\n", STARTUP_HDR);
+
+    static const char* SOURCES[] = {"../resources/container.jpg", "../resources/eso0932a.jpg", "../resources/yay.png",
+                                    STARTUP_HDR};
+    printf("%-28s %11s %8s %10s %12s %12s %8s\n", "source", "size", "channels", "decode", "first load",
+           "container", "speedup");
+    for (size_t i = 0; i < sizeof(SOURCES) / sizeof(SOURCES[0]); i++) {
+        const char* path = SOURCES[i];
+        const bool hdr = stbi_is_hdr(path);
+        int width, height, channels;
+        if ((hdr && !hdrWritten) || !stbi_info(path, &width, &height, &channels)) continue;
+
+        char containerPath[1024];
+        snprintf(containerPath, sizeof(containerPath), "%s" TEXTURE_CONTAINER_EXTENSION, path);
+        remove(containerPath);
+
+        double start = glfwGetTime();
+        void* pixels = hdr ? (void*) stbi_loadf(path, &width, &height, &channels, 3)
+                           : (void*) stbi_load(path, &width, &height, &channels, 0);
+        const double decode = glfwGetTime() - start;
+        stbi_image_free(pixels);
+
+        const GLint format = get_image_format(channels);
+        const double first = time_texture_load(path, hdr, format);
+        double mapped = 1e9;
+        for (int run = 0; run < STARTUP_LOADS; run++) {
+            const double elapsed = time_texture_load(path, hdr, format);
+            if (elapsed < mapped) mapped = elapsed;
+        }
+
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", width, height);
+        printf("%-28s %11s %8d %7.1f ms %9.1f ms %9.1f ms %7.1fx\n", path, size, hdr ? 3 : channels, decode * 1e3,
+               first * 1e3, mapped * 1e3, first / mapped);
+        remove(containerPath);
+    }
+    remove(STARTUP_HDR);
+}
+
+/*
+ * Packs material sized images of random sizes into an atlas and into an array, against a texture per image.
+ * Occupancy counts image texels only, the gutters and the unused space are what it leaves out.
+ */
+void bench_atlas(void) {
+    AtlasImage images[ATLAS_IMAGES];
+    unsigned int seed = 12345;
+    for (int i = 0; i < ATLAS_IMAGES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        const int width = 16 << (seed >> 28) % 4, height = 16 << (seed >> 24) % 4;
+        unsigned char* pixels = malloc((size_t) width * height * 4);
+        if (!pixels) {
+            printf("Out of memory\n");
+            for (int j = 0; j < i; j++) free((void*) images[j].pixels);
+            return;
+        }
+        for (size_t t = 0; t < (size_t) width * height * 4; t++) {
+            seed = seed * 1664525u + 1013904223u;
+            pixels[t] = (unsigned char) (seed >> 24);
+        }
+        images[i] = (AtlasImage) {pixels, width, height};
+    }
+
+    double start = glfwGetTime();
+    GLuint textures[ATLAS_IMAGES];
+    for (int i = 0; i < ATLAS_IMAGES; i++)
+        textures[i] = gen_texture_data((unsigned char*) images[i].pixels, images[i].width, images[i].height, 4);
+    glFinish();
+    const double separate = glfwGetTime() - start;
+    for (int i = 0; i < ATLAS_IMAGES; i++)
+        gl_state_forget_texture(textures[i]);
+    glDeleteTextures(ATLAS_IMAGES, textures);
+
+    printf("%d images of 16 to 128 texels\n", ATLAS_IMAGES);
+    printf("  %-22s %8.2f ms  %d textures\n", "texture per image", separate * 1e3, ATLAS_IMAGES);
+    static const AtlasTarget TARGETS[] = {ATLAS_TEXTURE_2D, ATLAS_TEXTURE_ARRAY};
+    static const char* TARGET_NAMES[] = {"atlas, 4 levels", "array, 4 levels"};
+    for (int i = 0; i < 2; i++) {
+        const AtlasDesc desc = {.target = TARGETS[i]};
+        TextureAtlas atlas;
+        start = glfwGetTime();
+        const bool ok = texture_atlas_pack(images, ATLAS_IMAGES, &desc, &atlas);
+        glFinish();
+        const double packed = glfwGetTime() - start;
+        if (!ok) continue;
+        printf("  %-22s %8.2f ms  %dx%d x %d, %.0f%% occupied\n", TARGET_NAMES[i], packed * 1e3, atlas.width,
+               atlas.height, atlas.layers, atlas.occupancy * 100.0);
+        texture_atlas_free(&atlas);
+    }
+
+    for (int i = 0; i < ATLAS_IMAGES; i++)
+        free((void*) images[i].pixels);
+}
+
+static bool batch_file(const char* name) {
+    const char* extension = strrchr(name, '.');
+    return extension && (strcasecmp(extension, ".jpg") == 0 || strcasecmp(extension, ".jpeg") == 0 ||
+                         strcasecmp(extension, ".png") == 0 || strcasecmp(extension, ".hdr") == 0);
+}
+
+static void remove_containers(char** paths, int count) {
+    for (int i = 0; i < count; i++) {
+        char containerPath[1024];
+        snprintf(containerPath, sizeof(containerPath), "%s" TEXTURE_CONTAINER_EXTENSION, paths[i]);
+        remove(containerPath);
+    }
+}
+
+static void delete_textures(GLuint* textures, int count) {
+    for (int i = 0; i < count; i++)
+        gl_state_forget_texture(textures[i]);
+    glDeleteTextures(count, textures);
+}
+
+/*
+ * Loads a directory of mixed files one gen_texture call after another, then with a single gen_textures call.
+ * Containers are removed before each pass, so both decode every file and build every chain.
+ */
+void bench_batch_load(void) {
+    const char* dir = getenv("COPENGL_BENCH_TEXTURES") ? getenv("COPENGL_BENCH_TEXTURES") : BATCH_DIR;
+    char* paths[BATCH_MAX_FILES];
+    int count = 0;
+    DIR* listing = opendir(dir);
+    for (struct dirent* entry; listing && (entry = readdir(listing)) && count < BATCH_MAX_FILES - 1;) {
+        if (!batch_file(entry->d_name)) continue;
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if ((paths[count] = strdup(path))) count++;
+    }
+    if (listing) closedir(listing);
+
+    float* rgb = synthetic_hdr(HDR_WIDTH / 2, HDR_HEIGHT / 2);
+    if (rgb && write_hdr(BATCH_HDR, rgb, HDR_WIDTH / 2, HDR_HEIGHT / 2)) paths[count++] = strdup(BATCH_HDR);
+    free(rgb);
+    if (count == 0) {
+        printf("No images in %s\n", dir);
+        return;
+    }
+
+    GLuint* textures = calloc(count, sizeof(GLuint));
+    if (!textures) {
+        printf("Out of memory\n");
+        return;
+    }
+
+    remove_containers(paths, count);
+    double start = glfwGetTime();
+    for (int i = 0; i < count; i++) {
+        int width, height, channels;
+        if (stbi_is_hdr(paths[i])) textures[i] = gen_skybox_texture(paths[i]);
+        else if (stbi_info(paths[i], &width, &height, &channels))
+            textures[i] = gen_texture_whcf(paths[i], &width, &height, &channels, get_image_format(channels));
+    }
+    glFinish();
+    const double sequential = glfwGetTime() - start;
+    delete_textures(textures, count);
+
+    remove_containers(paths, count);
+    start = glfwGetTime();
+    const int loaded = gen_textures((const char* const*) paths, count, textures);
+    glFinish();
+    const double batched = glfwGetTime() - start;
+    delete_textures(textures, count);
+
+    printf("%d of %d files from %s and %s, %d threads\n", loaded, count, dir, BATCH_HDR,
+           thread_pool_size(thread_pool_shared()) + 1);
+    printf("  gen_texture per file %9.1f ms\n", sequential * 1e3);
+    printf("  gen_textures         %9.1f ms  %.1fx\n", batched * 1e3, sequential / batched);
+
+    remove_containers(paths, count);
+    remove(BATCH_HDR);
+    for (int i = 0; i < count; i++)
+        free(paths[i]);
+    free(textures);
+}
@@ -1,19 +1,61 @@
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <cglm/cglm.h>
 
 #include "mesh.h"
 #include "shader.h"
+#include "texture_stream.h"
 #include "texture_helper.h"
+#include "env_map.h"
+#include "virtual_texture.h"
+#include "texture_residency.h"
+#include "thread_pool.h"
+#include "hdr_pack.h"
 #include "camera.h"
+#include "gl_state.h"
+#include "shader_cache.h"
 #include "utils.h"
 
 #define INITIAL_WIDTH 800
 #define INITIAL_HEIGHT 500
 #define SCREEN_CAPTURE 0
 
+#define VERTEX_SHADER "simple.vert"
+#define BLACK_HOLE_SHADER "blackhole/black_hole.frag"
+#define SKYBOX_PATH "../resources/starmap_2020_8k_gal.hdr"
+// 4 bytes per texel instead of 12 for GL_RGB32F, the star map has no use for more precision.
+#define SKYBOX_FORMAT GL_RGB9_E5
+// A cube map saves the atan and asin per ray and spends its texels evenly instead of piling them up at the poles.
+// It is converted on the thread pool and appears at once, an equirect map streams in row by row.
+// ENV_MAP_VIRTUAL keeps only the tiles in view resident, built once into SKYBOX_TILES next to the source.
+#define SKYBOX_LAYOUT ENV_MAP_CUBE
+#define SKYBOX_TILES "../resources/starmap_2020_8k_gal.vtex"
+// Textures not bound for a frame lose their top mips once texture memory exceeds this.
+#define TEXTURE_BUDGET_MB 1024
+
+typedef enum {
+    QUALITY_LOW,
+    QUALITY_MEDIUM,
+    QUALITY_HIGH,
+} Quality;
+
+// Defines injected into black_hole.frag per quality level, high uses the defaults of the shader.
+static const char* QUALITY_DEFINES[] = {
+    [QUALITY_LOW] = "MAX_STEPS=300;FBM_OCTAVES=1",
+    [QUALITY_MEDIUM] = "MAX_STEPS=700;FBM_OCTAVES=2",
+    [QUALITY_HIGH] = NULL,
+};
+
+typedef struct {
+    EnvMap map; // unused by the virtual layout, whose tiles are read from SKYBOX_TILES
+    bool ok;
+    _Atomic bool done;
+} SkyboxConversion;
+
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
 void key_input(GLFWwindow *window);
@@ -24,12 +66,19 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 
 void focus_callback(GLFWwindow *window, int focused);
 
+void report_first_frame(double startup_time);
+
+void skybox_loaded(GLuint texture, int width, int height, bool loaded, void* user);
+
+void convert_skybox(void* arg);
+
 FILE* ffmpeg();
 
 unsigned int WIN_WIDTH = INITIAL_WIDTH;
 unsigned int WIN_HEIGHT = INITIAL_HEIGHT;
 float ASPECT_RATIO = (float) INITIAL_WIDTH / (float) INITIAL_HEIGHT;
 bool is_fullscreen = false;
+Quality quality = QUALITY_HIGH;
 
 Camera camera;
 double delta_time = 0.0f;
@@ -44,6 +93,13 @@ int main() {
         printf("Failed to initialize GLFW\n");
         return -1;
     }
+    const double startup_time = glfwGetTime();
+    bool first_frame = true;
+
+    // DSA and glProgramUniform need 4.5, the shaders are written against 4.6.
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -75,11 +131,65 @@ int main() {
 
     printf("OpenGL Version: %s\n", glGetString(GL_VERSION));
 
-    unsigned int skybox_tex = gen_skybox_texture("../resources/starmap_2020_8k_gal.hdr");
+    // Shaders are compiled into the binary, COPENGL_SHADER_DIR points at the source tree to edit them live.
+    shader_embed_register(EMBEDDED_SHADERS, EMBEDDED_SHADER_COUNT);
+    shader_source_override(getenv("COPENGL_SHADER_DIR"));
+    shader_cache_init("shader_cache");
+
+    // Every quality also selects the lookup of the skybox layout.
+    char stage_defines[3][128];
+    for (int i = 0; i < 3; i++) {
+        snprintf(stage_defines[i], sizeof(stage_defines[i]), "%s;%s", env_map_define(SKYBOX_LAYOUT),
+                 QUALITY_DEFINES[i] ? QUALITY_DEFINES[i] : "");
+    }
 
-    Shader shader = create_shader("../shaders/simple.vert", "../shaders/blackhole/black_hole.frag");
+    // Submit the shaders first, so the driver compiles them while the skybox decodes.
+    // The skybox loads on worker threads, frames render against a black placeholder until it arrives.
+    // Both stages are separable, quality changes only swap the fragment stage of the pipeline.
+    Shader stages[2];
+    const ShaderDesc stage_descs[2] = {
+        {VERTEX_SHADER, NULL, NULL},
+        {NULL, BLACK_HOLE_SHADER, stage_defines[QUALITY_HIGH]},
+    };
+    ShaderBatch* batch = shader_create_batch(stage_descs, 2, stages);
+
+    const TextureStreamDesc skybox_desc = {
+        .hdr = true,
+        .hdrFormat = SKYBOX_FORMAT,
+        .mipmaps = true,
+        .wrapS = GL_REPEAT,
+        .wrapT = GL_CLAMP_TO_EDGE,
+        .placeholder = {0.0f, 0.0f, 0.0f, 1.0f},
+        .callback = skybox_loaded,
+        .user = (void*) &startup_time,
+    };
+    const GLenum skybox_target = SKYBOX_LAYOUT == ENV_MAP_CUBE ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+    GLuint skybox_tex = 0;
+    VirtualTexture* skybox_vt = NULL;
+    SkyboxConversion* conversion = NULL;
+    if (SKYBOX_LAYOUT == ENV_MAP_EQUIRECT) {
+        skybox_tex = texture_stream_load(SKYBOX_PATH, &skybox_desc);
+    } else {
+        conversion = calloc(1, sizeof(SkyboxConversion));
+        if (conversion) thread_pool_submit(thread_pool_shared(), convert_skybox, conversion);
+    }
+
+    if (batch) {
+        shader_batch_wait(batch);
+        shader_batch_free(batch);
+    } else {
+        printf("Failed to create the shader batch, compiling the stages one by one\n");
+        for (int i = 0; i < 2; i++)
+            stages[i] = create_shader_desc(&stage_descs[i]);
+    }
+    shader_watch(&stages[0], VERTEX_SHADER, NULL);
+    shader_watch_defines(&stages[1], NULL, BLACK_HOLE_SHADER, stage_defines[QUALITY_HIGH]);
+    ShaderPipeline pipeline = shader_pipeline_create(stages[0], stages[1]);
     Mesh quad = shape_square();
 
+    frame_data_init();
+    FrameData frame = {0};
+
     float cam_angle = 0;
     float cam_dist = 10.0f;
     camera = camera_init(cam_dist * sinf(cam_angle), 1.0f, cam_dist * cosf(cam_angle));
@@ -96,8 +206,11 @@ int main() {
 
 
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
+    const ResidencyBudget texture_budget = {(size_t) TEXTURE_BUDGET_MB << 20, RESIDENCY_DROP_MIPS, 0};
+    texture_residency_set_budget(&texture_budget);
+
+    gl_state_enable(GL_DEPTH_TEST);
+    gl_state_enable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     while (!glfwWindowShouldClose(window)) {
@@ -107,6 +220,27 @@ int main() {
 
         key_input(window);
 
+        shader_reload_poll();
+        texture_stream_poll();
+        if (conversion && atomic_load_explicit(&conversion->done, memory_order_acquire)) {
+            if (conversion->ok && SKYBOX_LAYOUT == ENV_MAP_VIRTUAL) {
+                skybox_vt = vt_open(SKYBOX_TILES, (int) WIN_WIDTH, (int) WIN_HEIGHT);
+                if (skybox_vt) {
+                    const VirtualTextureStats stats = vt_stats(skybox_vt);
+                    printf("Virtual skybox opened after %.1f ms, %d tiles in %d levels, %.1f MB atlas for %d of them\n",
+                           (glfwGetTime() - startup_time) * 1e3, stats.tileCount, stats.levelCount,
+                           (double) stats.atlasBytes / (1024.0 * 1024.0), stats.slotCount);
+                }
+            } else if (conversion->ok) {
+                skybox_tex = gen_env_map_texture(&conversion->map, SKYBOX_FORMAT);
+                skybox_loaded(skybox_tex, conversion->map.size, conversion->map.size * conversion->map.faceCount,
+                              skybox_tex != 0, (void*) &startup_time);
+            }
+            env_map_free(&conversion->map);
+            free(conversion);
+            conversion = NULL;
+        }
+
         cam_angle += - 0.1f * delta_time;
         camera.position[0] = cam_dist * sinf(cam_angle) - 1.5;
         camera.position[2] = cam_dist * cosf(cam_angle);
@@ -118,20 +252,33 @@ int main() {
         glClearColor(26.0f/255.0f, 26.0f/255.0f, 30.0f/255.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        shader_use(shader);
-        shader_u1f(shader, "time", current_frame);
-        shader_u2f(shader, "resolution", WIN_WIDTH, WIN_HEIGHT);
-        shader_u3f(shader, "cam_pos", camera.position);
-        shader_u3f(shader, "cam_x", camera.right);
-        shader_u3f(shader, "cam_y", camera.up);
-        shader_u3f(shader, "cam_z", camera.front);
-        shader_u1f(shader, "fov", camera.fov);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, skybox_tex);
-        shader_u1i(shader, "equirectangularMap", 0);
+        camera_frame_data(camera, ASPECT_RATIO, &frame);
+        frame.time = (float) current_frame;
+        frame.resolution[0] = (float) WIN_WIDTH;
+        frame.resolution[1] = (float) WIN_HEIGHT;
+        frame_data_update(&frame);
+
+        // Lower qualities are cheaper permutations of the same shader, built once on first use.
+        // Stages are set every frame since a hot reload may have replaced either program.
+        const Shader fragment = quality == QUALITY_HIGH
+            ? stages[1]
+            : shader_variant(NULL, BLACK_HOLE_SHADER, stage_defines[quality]);
+
+        shader_pipeline_set_stage(pipeline, GL_VERTEX_SHADER, stages[0]);
+        shader_pipeline_set_stage(pipeline, GL_FRAGMENT_SHADER, fragment);
+        shader_pipeline_bind(pipeline);
+        if (SKYBOX_LAYOUT == ENV_MAP_VIRTUAL) {
+            // Until the tiles are open the shader reads an unbound page table, which samples black.
+            if (skybox_vt) vt_bind(skybox_vt, fragment, 0);
+        } else {
+            gl_state_bind_texture_unit(0, skybox_target, skybox_tex);
+            shader_u1i(fragment, "environmentMap", 0);
+        }
 
         mesh_bind(quad);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        if (skybox_vt) vt_update(skybox_vt);
+        texture_residency_update();
 
 #if SCREEN_CAPTURE == 1
         unsigned char *buffer = malloc(WIN_WIDTH * WIN_HEIGHT * 3);
@@ -143,6 +290,11 @@ int main() {
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (first_frame) {
+            report_first_frame(startup_time);
+            first_frame = false;
+        }
     }
 
 #if SCREEN_CAPTURE == 1
@@ -150,7 +302,38 @@ int main() {
 #endif
 
 
-    shader_delete(&shader);
+    const ResidencyStats residency = texture_residency_stats();
+    printf("Texture memory: %.1f of %.1f MB resident in %u textures, %u shrunk, %lu evictions, %lu mip drops, "
+           "%lu reloads\n", (double) residency.residentBytes / (1024.0 * 1024.0),
+           (double) residency.fullBytes / (1024.0 * 1024.0), residency.textures, residency.shrunk,
+           (unsigned long) residency.evictions, (unsigned long) residency.mipDrops, (unsigned long) residency.reloads);
+    for (int i = 0; i < residency.formatCount; i++) {
+        printf("    %-16s %3u textures %8.1f MB\n", texture_residency_format_name(residency.formats[i].internalFormat),
+               residency.formats[i].textures, (double) residency.formats[i].bytes / (1024.0 * 1024.0));
+    }
+
+    texture_stream_shutdown();
+    if (conversion) {
+        thread_pool_wait(thread_pool_shared());
+        env_map_free(&conversion->map);
+        free(conversion);
+    }
+    gl_state_forget_texture(skybox_tex);
+    glDeleteTextures(1, &skybox_tex);
+    if (skybox_vt) {
+        const VirtualTextureStats stats = vt_stats(skybox_vt);
+        printf("Virtual skybox: %d of %d tiles resident, %lu loads, %lu evictions\n", stats.residentTiles,
+               stats.tileCount, (unsigned long) stats.loads, (unsigned long) stats.evictions);
+        vt_close(skybox_vt);
+    }
+    shader_pipeline_delete(&pipeline);
+    shader_delete(&stages[0]);
+    shader_delete(&stages[1]);
+    shader_variants_clear();
+    frame_data_delete();
+
+    const GLStateStats gl_stats = gl_state_stats();
+    printf("GL state calls: %lu issued, %lu skipped as redundant\n", gl_stats.issued, gl_stats.skipped);
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -175,6 +358,12 @@ void key_input(GLFWwindow *window) {
             is_fullscreen = true;
         }
     }
+    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+        quality = QUALITY_LOW;
+    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+        quality = QUALITY_MEDIUM;
+    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+        quality = QUALITY_HIGH;
 
 
     camera_process_input(&camera, window, delta_time);
@@ -217,6 +406,37 @@ void focus_callback(GLFWwindow *window, int focused) {
     }
 }
 
+void report_first_frame(double startup_time) {
+    const ShaderCacheStats stats = shader_cache_stats();
+    printf("Time to first frame: %.1f ms (%s start, shader cache: %u hits, %u misses, %u rejected)\n",
+           (glfwGetTime() - startup_time) * 1e3, stats.misses == 0 && stats.hits > 0 ? "warm" : "cold",
+           stats.hits, stats.misses, stats.rejected);
+}
+
+void convert_skybox(void* arg) {
+    SkyboxConversion* conversion = arg;
+    if (SKYBOX_LAYOUT == ENV_MAP_VIRTUAL) {
+        // The tile file is built once, later starts only open it.
+        FILE* tiles = fopen(SKYBOX_TILES, "rb");
+        conversion->ok = tiles != NULL || vt_build_from_hdr(SKYBOX_PATH, SKYBOX_TILES, SKYBOX_FORMAT);
+        if (tiles) fclose(tiles);
+    } else {
+        conversion->ok = env_map_load(SKYBOX_PATH, SKYBOX_LAYOUT, 0, MIP_FILTER_KAISER, &conversion->map);
+    }
+    atomic_store_explicit(&conversion->done, true, memory_order_release);
+}
+
+void skybox_loaded(GLuint texture, int width, int height, bool loaded, void* user) {
+    if (!loaded) return;
+    const double startup_time = *(const double*) user;
+    const double megabytes = (double) width * height / (1024.0 * 1024.0);
+    printf("Skybox %dx%d (%s) loaded after %.1f ms as %s (%s kernels), %.1f MB instead of %.1f MB as RGB32F\n",
+           width, height, SKYBOX_LAYOUT == ENV_MAP_CUBE ? "cube faces" :
+                          SKYBOX_LAYOUT == ENV_MAP_OCTAHEDRAL ? "octahedral" : "equirect", (glfwGetTime() - startup_time) * 1e3, hdr_pack_format_name(SKYBOX_FORMAT),
+           hdr_pack_level_name(hdr_pack_level()), megabytes * hdr_pack_texel_size(SKYBOX_FORMAT),
+           megabytes * hdr_pack_texel_size(GL_RGB32F));
+}
+
 FILE* ffmpeg() {
     char* string;
     // TODO: Error checking for malloc
@@ -40,13 +40,16 @@ void camera_projection_matrix(const Camera camera, const float aspect_ratio, mat
     glm_perspective(glm_rad(camera.fov), aspect_ratio, 0.1f, 100.0f, projection);
 }
 
-void camera_to_shader(const Camera camera, const Shader shader, const float aspect_ratio) {
-    mat4 tmp;
-    camera_view_matrix(camera, tmp);
-    shader_uMat4f(shader, "view", tmp);
-
-    camera_projection_matrix(camera, aspect_ratio, tmp);
-    shader_uMat4f(shader, "projection", tmp);
+void camera_frame_data(Camera camera, const float aspect_ratio, FrameData* data) {
+    camera_view_matrix(camera, data->view);
+    camera_projection_matrix(camera, aspect_ratio, data->projection);
+    glm_mat4_mul(data->projection, data->view, data->view_projection);
+
+    glm_vec3_copy(camera.position, data->cam_pos);
+    glm_vec3_copy(camera.right, data->cam_x);
+    glm_vec3_copy(camera.up, data->cam_y);
+    glm_vec3_copy(camera.front, data->cam_z);
+    data->fov = camera.fov;
 }
 
 void camera_process_input(Camera *camera, GLFWwindow *window, float delta_time) {
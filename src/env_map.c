@@ -0,0 +1,182 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "env_map.h"
+#include "thread_pool.h"
+#include "stb/stb_image.h"
+
+// Destination rows per parallel work item.
+#define BAND_ROWS 16
+
+// Samples per texel along each axis.
+#define SUPERSAMPLE 2
+
+#define PI 3.14159265358979f
+
+typedef struct {
+    const float* src;
+    int srcWidth;
+    int srcHeight;
+    EnvMapLayout layout;
+    int size;
+    int bandsPerFace;
+    float* faces[6];
+} ResampleJob;
+
+int env_map_default_size(EnvMapLayout layout, int equirectWidth) {
+    // The equator spans 4 cube faces, and the diagonal of the octahedral square.
+    switch (layout) {
+        case ENV_MAP_CUBE: return equirectWidth / 4 > 1 ? equirectWidth / 4 : 1;
+        case ENV_MAP_OCTAHEDRAL: return equirectWidth / 2 > 1 ? equirectWidth / 2 : 1;
+        default: return equirectWidth;
+    }
+}
+
+const char* env_map_define(EnvMapLayout layout) {
+    switch (layout) {
+        case ENV_MAP_CUBE: return "ENV_CUBE";
+        case ENV_MAP_OCTAHEDRAL: return "ENV_OCTAHEDRAL";
+        case ENV_MAP_VIRTUAL: return "ENV_VIRTUAL";
+        default: return "";
+    }
+}
+
+/**
+ * Direction through a point of a face, s and t in [-1, 1] along the texel columns and rows.
+ * Cube faces follow the GL face selection rules, so row 0 of an uploaded face is t = -1.
+ */
+static void face_direction(EnvMapLayout layout, int face, float s, float t, float* d) {
+    if (layout == ENV_MAP_OCTAHEDRAL) {
+        d[0] = s;
+        d[1] = t;
+        d[2] = 1.0f - fabsf(s) - fabsf(t);
+        if (d[2] < 0.0f) {
+            // The lower hemisphere is folded out over the corners.
+            d[0] = (1.0f - fabsf(t)) * (s < 0.0f ? -1.0f : 1.0f);
+            d[1] = (1.0f - fabsf(s)) * (t < 0.0f ? -1.0f : 1.0f);
+        }
+        return;
+    }
+
+    switch (face) {
+        case 0: d[0] = 1.0f; d[1] = -t; d[2] = -s; break;
+        case 1: d[0] = -1.0f; d[1] = -t; d[2] = s; break;
+        case 2: d[0] = s; d[1] = 1.0f; d[2] = t; break;
+        case 3: d[0] = s; d[1] = -1.0f; d[2] = -t; break;
+        case 4: d[0] = s; d[1] = -t; d[2] = 1.0f; break;
+        default: d[0] = -s; d[1] = -t; d[2] = -1.0f; break;
+    }
+}
+
+// Bilinear fetch along a direction, wrapping around in longitude and clamped at the poles.
+static void sample_equirect(const ResampleJob* job, const float* d, float* out) {
+    const float length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    float z = d[2] / length;
+    z = z > 1.0f ? 1.0f : z < -1.0f ? -1.0f : z;
+    const float u = atan2f(d[0], d[1]) * (0.5f / PI) + 0.5f;
+    const float v = asinf(z) / PI + 0.5f;
+
+    const float fx = u * (float) job->srcWidth - 0.5f, fy = v * (float) job->srcHeight - 0.5f;
+    const float floorX = floorf(fx), floorY = floorf(fy);
+    const float tx = fx - floorX, ty = fy - floorY;
+    int x0 = (int) floorX % job->srcWidth;
+    if (x0 < 0) x0 += job->srcWidth;
+    const int x1 = x0 + 1 < job->srcWidth ? x0 + 1 : 0;
+    int y0 = (int) floorY, y1 = y0 + 1;
+    y0 = y0 < 0 ? 0 : y0 >= job->srcHeight ? job->srcHeight - 1 : y0;
+    y1 = y1 < 0 ? 0 : y1 >= job->srcHeight ? job->srcHeight - 1 : y1;
+
+    const float* r0 = job->src + (size_t) y0 * job->srcWidth * 3;
+    const float* r1 = job->src + (size_t) y1 * job->srcWidth * 3;
+    for (int c = 0; c < 3; c++) {
+        const float top = r0[x0 * 3 + c] + (r0[x1 * 3 + c] - r0[x0 * 3 + c]) * tx;
+        const float bottom = r1[x0 * 3 + c] + (r1[x1 * 3 + c] - r1[x0 * 3 + c]) * tx;
+        out[c] = top + (bottom - top) * ty;
+    }
+}
+
+static void resample_band(void* ctx, int index) {
+    const ResampleJob* job = ctx;
+    const int face = index / job->bandsPerFace;
+    const int firstRow = index % job->bandsPerFace * BAND_ROWS;
+    const int lastRow = firstRow + BAND_ROWS < job->size ? firstRow + BAND_ROWS : job->size;
+    const float step = 2.0f / (float) (job->size * SUPERSAMPLE);
+    const float weight = 1.0f / (SUPERSAMPLE * SUPERSAMPLE);
+
+    for (int y = firstRow; y < lastRow; y++) {
+        float* dst = job->faces[face] + (size_t) y * job->size * 3;
+        for (int x = 0; x < job->size; x++) {
+            float sum[3] = {0.0f, 0.0f, 0.0f};
+            for (int sy = 0; sy < SUPERSAMPLE; sy++) {
+                const float t = ((float) (y * SUPERSAMPLE + sy) + 0.5f) * step - 1.0f;
+                for (int sx = 0; sx < SUPERSAMPLE; sx++) {
+                    const float s = ((float) (x * SUPERSAMPLE + sx) + 0.5f) * step - 1.0f;
+                    float d[3], texel[3];
+                    face_direction(job->layout, face, s, t, d);
+                    sample_equirect(job, d, texel);
+                    sum[0] += texel[0];
+                    sum[1] += texel[1];
+                    sum[2] += texel[2];
+                }
+            }
+            dst[x * 3 + 0] = sum[0] * weight;
+            dst[x * 3 + 1] = sum[1] * weight;
+            dst[x * 3 + 2] = sum[2] * weight;
+        }
+    }
+}
+
+bool env_map_from_equirect(const float* rgb, int width, int height, EnvMapLayout layout, int size, MipFilter filter,
+                           EnvMap* map) {
+    memset(map, 0, sizeof(*map));
+    if (layout == ENV_MAP_VIRTUAL) return false;
+    if (size <= 0 || layout == ENV_MAP_EQUIRECT) size = env_map_default_size(layout, width);
+    const int faceCount = layout == ENV_MAP_CUBE ? 6 : 1;
+    const int faceHeight = layout == ENV_MAP_EQUIRECT ? height : size;
+
+    const size_t faceFloats = (size_t) size * faceHeight * 3;
+    map->storage = malloc(faceFloats * faceCount * sizeof(float));
+    if (!map->storage) return false;
+    map->layout = layout;
+    map->size = size;
+    map->faceCount = faceCount;
+
+    ResampleJob job = {rgb, width, height, layout, size, (size + BAND_ROWS - 1) / BAND_ROWS, {NULL}};
+    for (int face = 0; face < faceCount; face++)
+        job.faces[face] = map->storage + faceFloats * face;
+    if (layout == ENV_MAP_EQUIRECT) memcpy(map->storage, rgb, faceFloats * sizeof(float));
+    else thread_pool_parallel_for(thread_pool_shared(), faceCount * job.bandsPerFace, resample_band, &job);
+
+    // Faces are filtered on their own, seamless cube sampling hides the difference at the edges.
+    const MipDesc desc = {3, true, false, filter};
+    for (int face = 0; face < faceCount; face++) {
+        if (!mip_build(&desc, job.faces[face], size, faceHeight, &map->faces[face])) {
+            env_map_free(map);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool env_map_load(const char* path, EnvMapLayout layout, int size, MipFilter filter, EnvMap* map) {
+    int width, height, channels;
+    float* rgb = stbi_loadf(path, &width, &height, &channels, 3);
+    if (!rgb) {
+        printf("Failed to load environment map %s: %s\n", path, stbi_failure_reason());
+        memset(map, 0, sizeof(*map));
+        return false;
+    }
+
+    const bool ok = env_map_from_equirect(rgb, width, height, layout, size, filter, map);
+    stbi_image_free(rgb);
+    if (!ok) printf("Failed to convert environment map %s\n", path);
+    return ok;
+}
+
+void env_map_free(EnvMap* map) {
+    for (int face = 0; face < 6; face++)
+        mip_chain_free(&map->faces[face]);
+    free(map->storage);
+    memset(map, 0, sizeof(*map));
+}
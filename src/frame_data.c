@@ -0,0 +1,25 @@
+#include <stddef.h>
+#include "frame_data.h"
+
+_Static_assert(offsetof(FrameData, cam_pos) == 192, "FrameData must match the std140 layout");
+_Static_assert(offsetof(FrameData, time) == 256, "FrameData must match the std140 layout");
+_Static_assert(offsetof(FrameData, resolution) == 264, "FrameData must match the std140 layout");
+
+static GLuint frame_ubo = 0;
+
+void frame_data_init() {
+    if (frame_ubo) return;
+
+    glCreateBuffers(1, &frame_ubo);
+    glNamedBufferStorage(frame_ubo, sizeof(FrameData), NULL, GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frame_ubo);
+}
+
+void frame_data_update(const FrameData* data) {
+    glNamedBufferSubData(frame_ubo, 0, sizeof(FrameData), data);
+}
+
+void frame_data_delete() {
+    glDeleteBuffers(1, &frame_ubo);
+    frame_ubo = 0;
+}
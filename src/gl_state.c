@@ -0,0 +1,216 @@
+#include <string.h>
+#include "gl_state.h"
+#include "texture_residency.h"
+
+// Sentinel for "unknown", which no GL name or enum can take.
+#define UNKNOWN 0xFFFFFFFFu
+
+typedef enum {
+    SLOT_2D,
+    SLOT_CUBE_MAP,
+    SLOT_2D_ARRAY,
+    SLOT_3D,
+    SLOT_COUNT,
+} TextureSlot;
+
+static const GLenum CAPS[] = {
+    GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST,
+    GL_FRAMEBUFFER_SRGB, GL_MULTISAMPLE, GL_TEXTURE_CUBE_MAP_SEAMLESS, GL_PROGRAM_POINT_SIZE,
+};
+#define CAP_COUNT (sizeof(CAPS) / sizeof(CAPS[0]))
+
+static struct {
+    GLuint program;
+    GLuint pipeline;
+    GLuint stagePipeline;    // the pipeline the stage programs below belong to
+    GLuint stagePrograms[2]; // vertex, fragment
+    GLuint vao;
+    GLuint activeUnit;
+    GLuint textures[GL_STATE_MAX_TEXTURE_UNITS][SLOT_COUNT];
+    GLuint caps[CAP_COUNT]; // GL_TRUE, GL_FALSE or UNKNOWN
+    bool initialized;
+} state;
+
+static GLStateStats stats = {0};
+
+void gl_state_reset() {
+    memset(&state, 0xFF, sizeof(state));
+    state.initialized = true;
+}
+
+static void ensure_initialized() {
+    if (!state.initialized)
+        gl_state_reset();
+}
+
+void gl_state_count(bool issued) {
+    if (issued) stats.issued++;
+    else stats.skipped++;
+}
+
+static int texture_slot(const GLenum target) {
+    switch (target) {
+        case GL_TEXTURE_2D: return SLOT_2D;
+        case GL_TEXTURE_CUBE_MAP: return SLOT_CUBE_MAP;
+        case GL_TEXTURE_2D_ARRAY: return SLOT_2D_ARRAY;
+        case GL_TEXTURE_3D: return SLOT_3D;
+        default: return -1;
+    }
+}
+
+static int cap_index(const GLenum cap) {
+    for (unsigned int i = 0; i < CAP_COUNT; i++)
+        if (CAPS[i] == cap) return (int) i;
+    return -1;
+}
+
+void gl_state_use_program(GLuint program) {
+    ensure_initialized();
+    if (state.program == program) {
+        gl_state_count(false);
+        return;
+    }
+    glUseProgram(program);
+    state.program = program;
+    gl_state_count(true);
+}
+
+void gl_state_bind_program_pipeline(GLuint pipeline) {
+    gl_state_use_program(0);
+
+    if (state.pipeline == pipeline) {
+        gl_state_count(false);
+        return;
+    }
+    glBindProgramPipeline(pipeline);
+    state.pipeline = pipeline;
+    gl_state_count(true);
+}
+
+void gl_state_use_program_stages(GLuint pipeline, GLbitfield stages, GLuint program) {
+    ensure_initialized();
+    if (state.stagePipeline != pipeline) {
+        state.stagePipeline = pipeline;
+        state.stagePrograms[0] = state.stagePrograms[1] = UNKNOWN;
+    }
+
+    const bool vertex = stages & GL_VERTEX_SHADER_BIT;
+    const bool fragment = stages & GL_FRAGMENT_SHADER_BIT;
+    if ((!vertex || state.stagePrograms[0] == program) && (!fragment || state.stagePrograms[1] == program) &&
+        (stages & ~(GL_VERTEX_SHADER_BIT | GL_FRAGMENT_SHADER_BIT)) == 0) {
+        gl_state_count(false);
+        return;
+    }
+
+    glUseProgramStages(pipeline, stages, program);
+    if (vertex) state.stagePrograms[0] = program;
+    if (fragment) state.stagePrograms[1] = program;
+    gl_state_count(true);
+}
+
+void gl_state_bind_vertex_array(GLuint vao) {
+    ensure_initialized();
+    if (state.vao == vao) {
+        gl_state_count(false);
+        return;
+    }
+    glBindVertexArray(vao);
+    state.vao = vao;
+    gl_state_count(true);
+}
+
+void gl_state_active_texture(GLuint unit) {
+    ensure_initialized();
+    if (state.activeUnit == unit) {
+        gl_state_count(false);
+        return;
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    state.activeUnit = unit;
+    gl_state_count(true);
+}
+
+void gl_state_bind_texture(GLenum target, GLuint texture) {
+    ensure_initialized();
+    texture_residency_touch(texture);
+    const int slot = texture_slot(target);
+    const bool tracked = slot >= 0 && state.activeUnit < GL_STATE_MAX_TEXTURE_UNITS;
+    if (tracked && state.textures[state.activeUnit][slot] == texture) {
+        gl_state_count(false);
+        return;
+    }
+    glBindTexture(target, texture);
+    if (tracked)
+        state.textures[state.activeUnit][slot] = texture;
+    gl_state_count(true);
+}
+
+void gl_state_bind_texture_unit(GLuint unit, GLenum target, GLuint texture) {
+    ensure_initialized();
+    texture_residency_touch(texture);
+    const int slot = texture_slot(target);
+    if (slot >= 0 && unit < GL_STATE_MAX_TEXTURE_UNITS && state.textures[unit][slot] == texture) {
+        gl_state_count(false);
+        return;
+    }
+    gl_state_active_texture(unit);
+    gl_state_bind_texture(target, texture);
+}
+
+static void set_cap(GLenum cap, GLuint enabled) {
+    ensure_initialized();
+    const int i = cap_index(cap);
+    if (i >= 0 && state.caps[i] == enabled) {
+        gl_state_count(false);
+        return;
+    }
+    if (enabled) glEnable(cap);
+    else glDisable(cap);
+    if (i >= 0)
+        state.caps[i] = enabled;
+    gl_state_count(true);
+}
+
+void gl_state_enable(GLenum cap) {
+    set_cap(cap, GL_TRUE);
+}
+
+void gl_state_disable(GLenum cap) {
+    set_cap(cap, GL_FALSE);
+}
+
+void gl_state_forget_program(GLuint program) {
+    if (state.program == program)
+        state.program = UNKNOWN;
+    for (int i = 0; i < 2; i++)
+        if (state.stagePrograms[i] == program)
+            state.stagePrograms[i] = UNKNOWN;
+}
+
+void gl_state_forget_program_pipeline(GLuint pipeline) {
+    if (state.pipeline == pipeline)
+        state.pipeline = UNKNOWN;
+    if (state.stagePipeline == pipeline)
+        state.stagePipeline = UNKNOWN;
+}
+
+void gl_state_forget_vertex_array(GLuint vao) {
+    if (state.vao == vao)
+        state.vao = UNKNOWN;
+}
+
+void gl_state_forget_texture(GLuint texture) {
+    texture_residency_untrack(texture);
+    for (int unit = 0; unit < GL_STATE_MAX_TEXTURE_UNITS; unit++)
+        for (int slot = 0; slot < SLOT_COUNT; slot++)
+            if (state.textures[unit][slot] == texture)
+                state.textures[unit][slot] = UNKNOWN;
+}
+
+GLStateStats gl_state_stats() {
+    return stats;
+}
+
+void gl_state_stats_reset() {
+    stats = (GLStateStats) {0};
+}
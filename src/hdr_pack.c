@@ -0,0 +1,422 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include "hdr_pack.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HDR_PACK_X86 1
+#include <immintrin.h>
+#else
+#define HDR_PACK_X86 0
+#endif
+
+#define RGB9E5_MAX 65408.0f // (511 / 512) * 2^16
+#define F11_MAX 65024.0f    // (1 + 63 / 64) * 2^15
+#define F10_MAX 64512.0f    // (1 + 31 / 32) * 2^15
+#define HALF_MAX 65504.0f   // (1 + 1023 / 1024) * 2^15
+#define MIN_NORMAL 0x1p-14f // smallest normal of the 5 bit exponent formats
+#define REBIAS ((127u - 15u) << 23)
+#define HALF_ONE 0x3C00u
+
+/*
+ * Scalar reference. The SIMD kernels below perform the same operations in the same order,
+ * so every level produces bit identical output.
+ */
+
+static uint32_t float_bits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// NaN fails the comparison and maps to 0 like the negatives.
+static float clamp_range(float x, float maxValue) {
+    return x > 0.0f ? (x < maxValue ? x : maxValue) : 0.0f;
+}
+
+/**
+ * Converts to an unsigned float with a 5 bit exponent (bias 15) and the given mantissa width.
+ * Normals round half up by adding below the kept mantissa bits, a carry correctly bumps the exponent.
+ * Denormals are scaled to integers, rounding to nearest even like the SIMD conversion.
+ */
+static uint32_t small_float(float x, float maxValue, int mantissaBits) {
+    x = clamp_range(x, maxValue);
+    if (x < MIN_NORMAL)
+        return (uint32_t) lrintf(x * bits_float((uint32_t) (141 + mantissaBits) << 23));
+    const int shift = 23 - mantissaBits;
+    return (float_bits(x) + (1u << (shift - 1)) - REBIAS) >> shift;
+}
+
+// Shared exponent encoding from EXT_texture_shared_exponent.
+static uint32_t rgb9e5(float r, float g, float b) {
+    r = clamp_range(r, RGB9E5_MAX);
+    g = clamp_range(g, RGB9E5_MAX);
+    b = clamp_range(b, RGB9E5_MAX);
+
+    float maxc = fmaxf(r, fmaxf(g, b));
+    if (maxc < 0x1p-16f) maxc = 0x1p-16f;
+    // floor(log2(maxc)) + 1 + bias, read from the float exponent.
+    int e = (int) (float_bits(maxc) >> 23) - 111;
+    float scale = bits_float((uint32_t) (151 - e) << 23); // 2^(bias + mantissa bits - e)
+    if ((uint32_t) (maxc * scale + 0.5f) == 512) {
+        e++;
+        scale = bits_float((uint32_t) (151 - e) << 23);
+    }
+
+    const uint32_t rm = (uint32_t) (r * scale + 0.5f);
+    const uint32_t gm = (uint32_t) (g * scale + 0.5f);
+    const uint32_t bm = (uint32_t) (b * scale + 0.5f);
+    return rm | gm << 9 | bm << 18 | (uint32_t) e << 27;
+}
+
+static void pack_rgb9e5_scalar(const float* rgb, void* out, size_t count) {
+    uint32_t* dst = out;
+    for (size_t i = 0; i < count; i++, rgb += 3)
+        dst[i] = rgb9e5(rgb[0], rgb[1], rgb[2]);
+}
+
+static void pack_r11g11b10_scalar(const float* rgb, void* out, size_t count) {
+    uint32_t* dst = out;
+    for (size_t i = 0; i < count; i++, rgb += 3) {
+        dst[i] = small_float(rgb[0], F11_MAX, 6) |
+                 small_float(rgb[1], F11_MAX, 6) << 11 |
+                 small_float(rgb[2], F10_MAX, 5) << 22;
+    }
+}
+
+static void pack_rgba16f_scalar(const float* rgb, void* out, size_t count) {
+    uint16_t* dst = out;
+    for (size_t i = 0; i < count; i++, rgb += 3, dst += 4) {
+        dst[0] = (uint16_t) small_float(rgb[0], HALF_MAX, 10);
+        dst[1] = (uint16_t) small_float(rgb[1], HALF_MAX, 10);
+        dst[2] = (uint16_t) small_float(rgb[2], HALF_MAX, 10);
+        dst[3] = HALF_ONE;
+    }
+}
+
+#if HDR_PACK_X86
+
+/*
+ * SSE2, 4 texels per step.
+ */
+
+// (r0 g0 b0 r1) (g1 b1 r2 g2) (b2 r3 g3 b3) -> (r0 r1 r2 r3) (g0 g1 g2 g3) (b0 b1 b2 b3)
+static inline void deinterleave_sse2(const float* rgb, __m128* r, __m128* g, __m128* b) {
+    const __m128 a = _mm_loadu_ps(rgb);
+    const __m128 m = _mm_loadu_ps(rgb + 4);
+    const __m128 c = _mm_loadu_ps(rgb + 8);
+
+    *r = _mm_shuffle_ps(_mm_shuffle_ps(a, m, _MM_SHUFFLE(2, 2, 3, 0)),
+                        _mm_shuffle_ps(m, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0));
+    *g = _mm_shuffle_ps(_mm_shuffle_ps(a, m, _MM_SHUFFLE(0, 0, 1, 1)),
+                        _mm_shuffle_ps(m, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    *b = _mm_shuffle_ps(_mm_shuffle_ps(a, m, _MM_SHUFFLE(1, 1, 2, 2)),
+                        _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static inline __m128 clamp_range_sse2(__m128 x, float maxValue) {
+    // maxps returns its second operand for NaN.
+    return _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(maxValue));
+}
+
+static inline __m128i small_float_sse2(__m128 x, float maxValue, int mantissaBits) {
+    x = clamp_range_sse2(x, maxValue);
+    const int shift = 23 - mantissaBits;
+    const __m128i normal = _mm_srl_epi32(
+        _mm_add_epi32(_mm_castps_si128(x), _mm_set1_epi32((int) ((1u << (shift - 1)) - REBIAS))),
+        _mm_cvtsi32_si128(shift));
+    const __m128i denormal = _mm_cvtps_epi32(
+        _mm_mul_ps(x, _mm_castsi128_ps(_mm_set1_epi32((141 + mantissaBits) << 23))));
+    const __m128i isDenormal = _mm_castps_si128(_mm_cmplt_ps(x, _mm_set1_ps(MIN_NORMAL)));
+    return _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+}
+
+static inline __m128i rgb9e5_sse2(__m128 r, __m128 g, __m128 b) {
+    r = clamp_range_sse2(r, RGB9E5_MAX);
+    g = clamp_range_sse2(g, RGB9E5_MAX);
+    b = clamp_range_sse2(b, RGB9E5_MAX);
+
+    const __m128 maxc = _mm_max_ps(_mm_max_ps(_mm_max_ps(r, g), b), _mm_set1_ps(0x1p-16f));
+    __m128i e = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(maxc), 23), _mm_set1_epi32(111));
+    __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(151), e), 23));
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i maxm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(maxc, scale), half));
+    // The comparison yields -1 where the mantissa overflowed.
+    e = _mm_sub_epi32(e, _mm_cmpeq_epi32(maxm, _mm_set1_epi32(512)));
+    scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(151), e), 23));
+
+    const __m128i rm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+    const __m128i gm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+    const __m128i bm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+    return _mm_or_si128(_mm_or_si128(rm, _mm_slli_epi32(gm, 9)),
+                        _mm_or_si128(_mm_slli_epi32(bm, 18), _mm_slli_epi32(e, 27)));
+}
+
+static void pack_rgb9e5_sse2(const float* rgb, void* out, size_t count) {
+    uint32_t* dst = out;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, rgb += 12) {
+        __m128 r, g, b;
+        deinterleave_sse2(rgb, &r, &g, &b);
+        _mm_storeu_si128((__m128i*) (dst + i), rgb9e5_sse2(r, g, b));
+    }
+    pack_rgb9e5_scalar(rgb, dst + i, count - i);
+}
+
+static void pack_r11g11b10_sse2(const float* rgb, void* out, size_t count) {
+    uint32_t* dst = out;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, rgb += 12) {
+        __m128 r, g, b;
+        deinterleave_sse2(rgb, &r, &g, &b);
+        const __m128i packed = _mm_or_si128(
+            _mm_or_si128(small_float_sse2(r, F11_MAX, 6), _mm_slli_epi32(small_float_sse2(g, F11_MAX, 6), 11)),
+            _mm_slli_epi32(small_float_sse2(b, F10_MAX, 5), 22));
+        _mm_storeu_si128((__m128i*) (dst + i), packed);
+    }
+    pack_r11g11b10_scalar(rgb, dst + i, count - i);
+}
+
+static void pack_rgba16f_sse2(const float* rgb, void* out, size_t count) {
+    uint16_t* dst = out;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, rgb += 12) {
+        __m128 r, g, b;
+        deinterleave_sse2(rgb, &r, &g, &b);
+        // Two 32 bit words per texel, (r | g << 16) and (b | 1.0 << 16), interleaved into texel order.
+        const __m128i rg = _mm_or_si128(small_float_sse2(r, HALF_MAX, 10),
+                                        _mm_slli_epi32(small_float_sse2(g, HALF_MAX, 10), 16));
+        const __m128i ba = _mm_or_si128(small_float_sse2(b, HALF_MAX, 10), _mm_set1_epi32(HALF_ONE << 16));
+        _mm_storeu_si128((__m128i*) (dst + i * 4), _mm_unpacklo_epi32(rg, ba));
+        _mm_storeu_si128((__m128i*) (dst + i * 4 + 8), _mm_unpackhi_epi32(rg, ba));
+    }
+    pack_rgba16f_scalar(rgb, dst + i * 4, count - i);
+}
+
+/*
+ * AVX2, 8 texels per step.
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 void deinterleave_avx2(const float* rgb, __m256* r, __m256* g, __m256* b) {
+    __m128 r0, g0, b0, r1, g1, b1;
+    deinterleave_sse2(rgb, &r0, &g0, &b0);
+    deinterleave_sse2(rgb + 12, &r1, &g1, &b1);
+    *r = _mm256_insertf128_ps(_mm256_castps128_ps256(r0), r1, 1);
+    *g = _mm256_insertf128_ps(_mm256_castps128_ps256(g0), g1, 1);
+    *b = _mm256_insertf128_ps(_mm256_castps128_ps256(b0), b1, 1);
+}
+
+static inline AVX2 __m256 clamp_range_avx2(__m256 x, float maxValue) {
+    return _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(maxValue));
+}
+
+static inline AVX2 __m256i small_float_avx2(__m256 x, float maxValue, int mantissaBits) {
+    x = clamp_range_avx2(x, maxValue);
+    const int shift = 23 - mantissaBits;
+    const __m256i normal = _mm256_srl_epi32(
+        _mm256_add_epi32(_mm256_castps_si256(x), _mm256_set1_epi32((int) ((1u << (shift - 1)) - REBIAS))),
+        _mm_cvtsi32_si128(shift));
+    const __m256i denormal = _mm256_cvtps_epi32(
+        _mm256_mul_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32((141 + mantissaBits) << 23))));
+    const __m256 isDenormal = _mm256_cmp_ps(x, _mm256_set1_ps(MIN_NORMAL), _CMP_LT_OQ);
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(normal), _mm256_castsi256_ps(denormal),
+                                                isDenormal));
+}
+
+static inline AVX2 __m256i rgb9e5_avx2(__m256 r, __m256 g, __m256 b) {
+    r = clamp_range_avx2(r, RGB9E5_MAX);
+    g = clamp_range_avx2(g, RGB9E5_MAX);
+    b = clamp_range_avx2(b, RGB9E5_MAX);
+
+    const __m256 maxc = _mm256_max_ps(_mm256_max_ps(_mm256_max_ps(r, g), b), _mm256_set1_ps(0x1p-16f));
+    __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(maxc), 23), _mm256_set1_epi32(111));
+    __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_sub_epi32(_mm256_set1_epi32(151), e), 23));
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256i maxm = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(maxc, scale), half));
+    e = _mm256_sub_epi32(e, _mm256_cmpeq_epi32(maxm, _mm256_set1_epi32(512)));
+    scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_sub_epi32(_mm256_set1_epi32(151), e), 23));
+
+    const __m256i rm = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(r, scale), half));
+    const __m256i gm = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(g, scale), half));
+    const __m256i bm = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(b, scale), half));
+    return _mm256_or_si256(_mm256_or_si256(rm, _mm256_slli_epi32(gm, 9)),
+                           _mm256_or_si256(_mm256_slli_epi32(bm, 18), _mm256_slli_epi32(e, 27)));
+}
+
+static AVX2 void pack_rgb9e5_avx2(const float* rgb, void* out, size_t count) {
+    uint32_t* dst = out;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, rgb += 24) {
+        __m256 r, g, b;
+        deinterleave_avx2(rgb, &r, &g, &b);
+        _mm256_storeu_si256((__m256i*) (dst + i), rgb9e5_avx2(r, g, b));
+    }
+    pack_rgb9e5_sse2(rgb, dst + i, count - i);
+}
+
+static AVX2 void pack_r11g11b10_avx2(const float* rgb, void* out, size_t count) {
+    uint32_t* dst = out;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, rgb += 24) {
+        __m256 r, g, b;
+        deinterleave_avx2(rgb, &r, &g, &b);
+        const __m256i packed = _mm256_or_si256(
+            _mm256_or_si256(small_float_avx2(r, F11_MAX, 6), _mm256_slli_epi32(small_float_avx2(g, F11_MAX, 6), 11)),
+            _mm256_slli_epi32(small_float_avx2(b, F10_MAX, 5), 22));
+        _mm256_storeu_si256((__m256i*) (dst + i), packed);
+    }
+    pack_r11g11b10_sse2(rgb, dst + i, count - i);
+}
+
+static AVX2 void pack_rgba16f_avx2(const float* rgb, void* out, size_t count) {
+    uint16_t* dst = out;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, rgb += 24) {
+        __m256 r, g, b;
+        deinterleave_avx2(rgb, &r, &g, &b);
+        const __m256i rg = _mm256_or_si256(small_float_avx2(r, HALF_MAX, 10),
+                                           _mm256_slli_epi32(small_float_avx2(g, HALF_MAX, 10), 16));
+        const __m256i ba = _mm256_or_si256(small_float_avx2(b, HALF_MAX, 10), _mm256_set1_epi32(HALF_ONE << 16));
+        // The unpacks work per 128 bit lane, texels 0,1,4,5 and 2,3,6,7, the permutes restore the order.
+        const __m256i lo = _mm256_unpacklo_epi32(rg, ba);
+        const __m256i hi = _mm256_unpackhi_epi32(rg, ba);
+        _mm256_storeu_si256((__m256i*) (dst + i * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*) (dst + i * 4 + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    pack_rgba16f_sse2(rgb, dst + i * 4, count - i);
+}
+
+#endif
+
+typedef void (*PackKernel)(const float* rgb, void* out, size_t count);
+
+typedef enum {
+    PACK_RGB9E5,
+    PACK_R11G11B10,
+    PACK_RGBA16F,
+} PackFormat;
+
+static const PackKernel KERNELS[][3] = {
+    [HDR_PACK_SCALAR] = {pack_rgb9e5_scalar, pack_r11g11b10_scalar, pack_rgba16f_scalar},
+#if HDR_PACK_X86
+    [HDR_PACK_SSE2] = {pack_rgb9e5_sse2, pack_r11g11b10_sse2, pack_rgba16f_sse2},
+    [HDR_PACK_AVX2] = {pack_rgb9e5_avx2, pack_r11g11b10_avx2, pack_rgba16f_avx2},
+#endif
+};
+
+static _Atomic int selected = -1;
+
+static HdrPackLevel supported_level() {
+#if HDR_PACK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return HDR_PACK_AVX2;
+    if (__builtin_cpu_supports("sse2")) return HDR_PACK_SSE2;
+#endif
+    return HDR_PACK_SCALAR;
+}
+
+HdrPackLevel hdr_pack_level() {
+    int level = atomic_load(&selected);
+    if (level < 0) {
+        level = supported_level();
+        atomic_store(&selected, level);
+    }
+    return (HdrPackLevel) level;
+}
+
+void hdr_pack_set_level(HdrPackLevel level) {
+    const HdrPackLevel supported = supported_level();
+    atomic_store(&selected, level < supported ? level : supported);
+}
+
+const char* hdr_pack_level_name(HdrPackLevel level) {
+    switch (level) {
+        case HDR_PACK_SSE2: return "SSE2";
+        case HDR_PACK_AVX2: return "AVX2";
+        default: return "scalar";
+    }
+}
+
+uint16_t hdr_half_from_float(float x) {
+    return (uint16_t) small_float(x, HALF_MAX, 10);
+}
+
+float hdr_half_to_float(uint16_t h) {
+    const uint32_t exponent = h >> 10 & 0x1F;
+    const uint32_t mantissa = h & 0x3FF;
+    if (exponent == 0) return (float) mantissa * 0x1p-24f;
+    if (exponent == 31) return mantissa ? NAN : INFINITY;
+    return bits_float((exponent + 112) << 23 | mantissa << 13);
+}
+
+bool hdr_pack_supported(GLenum internalFormat) {
+    return hdr_pack_texel_size(internalFormat) != 0;
+}
+
+size_t hdr_pack_texel_size(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_RGB9_E5:
+        case GL_R11F_G11F_B10F: return 4;
+        case GL_RGBA16F: return 8;
+        case GL_RGB32F: return 12;
+        default: return 0;
+    }
+}
+
+void hdr_pack_upload_format(GLenum internalFormat, GLenum* format, GLenum* type) {
+    switch (internalFormat) {
+        case GL_RGB9_E5:
+            *format = GL_RGB;
+            *type = GL_UNSIGNED_INT_5_9_9_9_REV;
+            break;
+        case GL_R11F_G11F_B10F:
+            *format = GL_RGB;
+            *type = GL_UNSIGNED_INT_10F_11F_11F_REV;
+            break;
+        case GL_RGBA16F:
+            *format = GL_RGBA;
+            *type = GL_HALF_FLOAT;
+            break;
+        default:
+            *format = GL_RGB;
+            *type = GL_FLOAT;
+            break;
+    }
+}
+
+const char* hdr_pack_format_name(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_RGB9_E5: return "RGB9_E5";
+        case GL_R11F_G11F_B10F: return "R11F_G11F_B10F";
+        case GL_RGBA16F: return "RGBA16F";
+        case GL_RGB32F: return "RGB32F";
+        default: return "unknown";
+    }
+}
+
+void hdr_pack(GLenum internalFormat, const float* rgb, void* out, size_t count) {
+    const HdrPackLevel level = hdr_pack_level();
+    switch (internalFormat) {
+        case GL_RGB9_E5:
+            KERNELS[level][PACK_RGB9E5](rgb, out, count);
+            break;
+        case GL_R11F_G11F_B10F:
+            KERNELS[level][PACK_R11G11B10](rgb, out, count);
+            break;
+        case GL_RGBA16F:
+            KERNELS[level][PACK_RGBA16F](rgb, out, count);
+            break;
+        default:
+            memcpy(out, rgb, count * 3 * sizeof(float));
+            break;
+    }
+}
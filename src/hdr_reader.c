@@ -0,0 +1,201 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hdr_reader.h"
+#include "hdr_pack.h"
+
+#define HDR_READ_BUFFER (64 * 1024)
+#define HDR_HEADER_LINE 512
+
+struct HdrReader {
+    FILE* file;
+    int width;
+    int height;
+    int rowsRead;
+
+    unsigned char* buffer; // file bytes not yet consumed
+    size_t pos;
+    size_t len;
+
+    unsigned char* scanline; // RGBE of one row
+    float* row;              // the same row as float RGB
+};
+
+// Byte wise input over a fixed buffer, the run length decoding consumes single bytes.
+static int next_byte(HdrReader* r) {
+    if (r->pos == r->len) {
+        r->len = fread(r->buffer, 1, HDR_READ_BUFFER, r->file);
+        r->pos = 0;
+        if (r->len == 0) return EOF;
+    }
+    return r->buffer[r->pos++];
+}
+
+static bool read_bytes(HdrReader* r, unsigned char* dst, size_t n) {
+    while (n > 0) {
+        if (r->pos == r->len) {
+            r->len = fread(r->buffer, 1, HDR_READ_BUFFER, r->file);
+            r->pos = 0;
+            if (r->len == 0) return false;
+        }
+        size_t chunk = r->len - r->pos;
+        if (chunk > n) chunk = n;
+        memcpy(dst, r->buffer + r->pos, chunk);
+        r->pos += chunk;
+        dst += chunk;
+        n -= chunk;
+    }
+    return true;
+}
+
+static bool read_line(HdrReader* r, char* line, size_t size) {
+    size_t n = 0;
+    for (;;) {
+        const int c = next_byte(r);
+        if (c == EOF) return false;
+        if (c == '\n') break;
+        if (n + 1 < size) line[n++] = (char) c;
+    }
+    line[n] = '\0';
+    return true;
+}
+
+static bool parse_header(HdrReader* r) {
+    char line[HDR_HEADER_LINE];
+    if (!read_line(r, line, sizeof(line))) return false;
+    if (strcmp(line, "#?RADIANCE") != 0 && strcmp(line, "#?RGBE") != 0) return false;
+
+    // Variables up to the empty line, only the pixel format matters.
+    for (;;) {
+        if (!read_line(r, line, sizeof(line))) return false;
+        if (line[0] == '\0') break;
+        if (strncmp(line, "FORMAT=", 7) == 0 && strcmp(line + 7, "32-bit_rle_rgbe") != 0) {
+            printf("Unsupported Radiance pixel format %s\n", line + 7);
+            return false;
+        }
+    }
+
+    if (!read_line(r, line, sizeof(line))) return false;
+    if (sscanf(line, "-Y %d +X %d", &r->height, &r->width) != 2) {
+        printf("Unsupported Radiance orientation %s\n", line);
+        return false;
+    }
+    return r->width > 0 && r->height > 0;
+}
+
+HdrReader* hdr_reader_open(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    HdrReader* r = calloc(1, sizeof(HdrReader));
+    if (!r) {
+        fclose(file);
+        return NULL;
+    }
+    r->file = file;
+    r->buffer = malloc(HDR_READ_BUFFER);
+    if (!r->buffer || !parse_header(r)) {
+        hdr_reader_close(r);
+        return NULL;
+    }
+
+    r->scanline = malloc((size_t) r->width * 4);
+    r->row = malloc((size_t) r->width * 3 * sizeof(float));
+    if (!r->scanline || !r->row) {
+        hdr_reader_close(r);
+        return NULL;
+    }
+    return r;
+}
+
+int hdr_reader_width(const HdrReader* reader) {
+    return reader->width;
+}
+
+int hdr_reader_height(const HdrReader* reader) {
+    return reader->height;
+}
+
+/**
+ * Reads one scanline into r->scanline. New style run length encoding stores the four components in separate
+ * planes, each a sequence of runs (count > 128, one byte repeated count - 128 times) and literals.
+ */
+static bool read_scanline(HdrReader* r) {
+    unsigned char* s = r->scanline;
+    const int width = r->width;
+    if (!read_bytes(r, s, 4)) return false;
+
+    const bool encoded = width >= 8 && width < 32768 && s[0] == 2 && s[1] == 2 && !(s[2] & 0x80);
+    if (!encoded) {
+        // Flat pixels, the 4 bytes already read are the first of them.
+        return read_bytes(r, s + 4, (size_t) (width - 1) * 4);
+    }
+    if ((s[2] << 8 | s[3]) != width) {
+        printf("Corrupt Radiance scanline width\n");
+        return false;
+    }
+
+    for (int c = 0; c < 4; c++) {
+        int x = 0;
+        while (x < width) {
+            int count = next_byte(r);
+            if (count == EOF) return false;
+
+            if (count > 128) {
+                count -= 128;
+                const int value = next_byte(r);
+                if (value == EOF || x + count > width) return false;
+                for (int i = 0; i < count; i++, x++)
+                    s[x * 4 + c] = (unsigned char) value;
+            } else {
+                if (count == 0 || x + count > width) return false;
+                for (int i = 0; i < count; i++, x++) {
+                    const int value = next_byte(r);
+                    if (value == EOF) return false;
+                    s[x * 4 + c] = (unsigned char) value;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Same conversion as stbi_loadf, so both paths produce identical texels.
+static void rgbe_to_float(const unsigned char* rgbe, float* rgb, int width) {
+    for (int x = 0; x < width; x++, rgbe += 4, rgb += 3) {
+        if (rgbe[3] == 0) {
+            rgb[0] = rgb[1] = rgb[2] = 0.0f;
+            continue;
+        }
+        const float f = ldexpf(1.0f, rgbe[3] - (128 + 8));
+        rgb[0] = rgbe[0] * f;
+        rgb[1] = rgbe[1] * f;
+        rgb[2] = rgbe[2] * f;
+    }
+}
+
+bool hdr_reader_read_rows(HdrReader* reader, GLenum internalFormat, void* out, int rows) {
+    const size_t rowBytes = (size_t) reader->width * hdr_pack_texel_size(internalFormat);
+    unsigned char* dst = out;
+
+    for (int i = 0; i < rows; i++, dst += rowBytes) {
+        if (reader->rowsRead == reader->height || !read_scanline(reader)) {
+            printf("Corrupt or truncated Radiance file at row %d\n", reader->rowsRead);
+            return false;
+        }
+        reader->rowsRead++;
+        rgbe_to_float(reader->scanline, reader->row, reader->width);
+        hdr_pack(internalFormat, reader->row, dst, reader->width);
+    }
+    return true;
+}
+
+void hdr_reader_close(HdrReader* reader) {
+    if (!reader) return;
+    if (reader->file) fclose(reader->file);
+    free(reader->buffer);
+    free(reader->scanline);
+    free(reader->row);
+    free(reader);
+}
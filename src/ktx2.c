@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ktx2.h"
+
+#define HEADER_SIZE 80      // identifier, header and index
+#define LEVEL_ENTRY_SIZE 24 // byteOffset, byteLength, uncompressedByteLength
+#define WRITER "COpenGLLib TextureCompressor"
+
+static const unsigned char IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// VkFormat values of the block formats.
+enum {
+    VK_BC1_RGB_UNORM = 131,
+    VK_BC1_RGB_SRGB = 132,
+    VK_BC3_UNORM = 137,
+    VK_BC3_SRGB = 138,
+    VK_BC6H_UFLOAT = 143,
+    VK_BC7_UNORM = 145,
+    VK_BC7_SRGB = 146,
+};
+
+// Data format descriptor colour models and channel ids, from the Khronos Data Format specification.
+enum {
+    DF_MODEL_BC1A = 128,
+    DF_MODEL_BC3 = 130,
+    DF_MODEL_BC6H = 133,
+    DF_MODEL_BC7 = 134,
+    DF_CHANNEL_COLOR = 0,
+    DF_CHANNEL_BC3_ALPHA = 15,
+    DF_SAMPLE_FLOAT = 0x80,
+    DF_PRIMARIES_BT709 = 1,
+    DF_TRANSFER_LINEAR = 1,
+    DF_TRANSFER_SRGB = 2,
+};
+
+uint32_t ktx2_vk_format(BcFormat format, bool srgb) {
+    switch (format) {
+        case BC_FORMAT_BC1: return srgb ? VK_BC1_RGB_SRGB : VK_BC1_RGB_UNORM;
+        case BC_FORMAT_BC3: return srgb ? VK_BC3_SRGB : VK_BC3_UNORM;
+        case BC_FORMAT_BC6H: return VK_BC6H_UFLOAT;
+        case BC_FORMAT_BC7: return srgb ? VK_BC7_SRGB : VK_BC7_UNORM;
+        default: return 0;
+    }
+}
+
+GLenum ktx2_gl_format(uint32_t vkFormat) {
+    switch (vkFormat) {
+        case VK_BC1_RGB_UNORM: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case VK_BC1_RGB_SRGB: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case VK_BC3_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case VK_BC3_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        case VK_BC6H_UFLOAT: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+        case VK_BC7_UNORM: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case VK_BC7_SRGB: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+        default: return 0;
+    }
+}
+
+static bool block_format(uint32_t vkFormat, BcFormat* format) {
+    switch (vkFormat) {
+        case VK_BC1_RGB_UNORM:
+        case VK_BC1_RGB_SRGB: *format = BC_FORMAT_BC1; return true;
+        case VK_BC3_UNORM:
+        case VK_BC3_SRGB: *format = BC_FORMAT_BC3; return true;
+        case VK_BC6H_UFLOAT: *format = BC_FORMAT_BC6H; return true;
+        case VK_BC7_UNORM:
+        case VK_BC7_SRGB: *format = BC_FORMAT_BC7; return true;
+        default: return false;
+    }
+}
+
+static int level_extent(int size, int level) {
+    const int extent = size >> level;
+    return extent > 0 ? extent : 1;
+}
+
+static void put32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char) (v >> i * 8);
+}
+
+static void put64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char) (v >> i * 8);
+}
+
+static uint32_t get32(const unsigned char* p) {
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint64_t get64(const unsigned char* p) {
+    return (uint64_t) get32(p) | (uint64_t) get32(p + 4) << 32;
+}
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * Writes the basic data format descriptor, one sample per 64 bit half the format is made of.
+ * @return The bytes written.
+ */
+static size_t write_dfd(unsigned char* p, BcFormat format, bool srgb) {
+    const int samples = format == BC_FORMAT_BC3 ? 2 : 1;
+    const uint32_t blockSize = (uint32_t) (24 + 16 * samples);
+    const uint32_t model = format == BC_FORMAT_BC1 ? DF_MODEL_BC1A
+                           : format == BC_FORMAT_BC3 ? DF_MODEL_BC3
+                           : format == BC_FORMAT_BC6H ? DF_MODEL_BC6H
+                           : DF_MODEL_BC7;
+    const uint32_t transfer = srgb ? DF_TRANSFER_SRGB : DF_TRANSFER_LINEAR;
+
+    put32(p, 4 + blockSize); // dfdTotalSize
+    unsigned char* block = p + 4;
+    memset(block, 0, blockSize);
+    put32(block + 0, 0); // vendor Khronos, basic descriptor type
+    put32(block + 4, 2 | blockSize << 16); // version 1.3
+    put32(block + 8, model | DF_PRIMARIES_BT709 << 8 | transfer << 16);
+    put32(block + 12, 3 | 3 << 8); // 4x4x1x1 texel block, stored minus one
+    put32(block + 16, (uint32_t) bc_block_size(format)); // bytesPlane0
+
+    unsigned char* sample = block + 24;
+    if (format == BC_FORMAT_BC3) {
+        put32(sample, 0 | 63 << 16 | (uint32_t) DF_CHANNEL_BC3_ALPHA << 24);
+        put32(sample + 12, UINT32_MAX);
+        sample += 16;
+        put32(sample, 64 | 63 << 16 | (uint32_t) DF_CHANNEL_COLOR << 24);
+        put32(sample + 12, UINT32_MAX);
+    } else if (format == BC_FORMAT_BC6H) {
+        put32(sample, 0 | 127 << 16 | (uint32_t) (DF_CHANNEL_COLOR | DF_SAMPLE_FLOAT) << 24);
+        put32(sample + 12, 0x3F800000); // 1.0f
+    } else {
+        const uint32_t bits = format == BC_FORMAT_BC1 ? 63 : 127;
+        put32(sample, 0 | bits << 16 | (uint32_t) DF_CHANNEL_COLOR << 24);
+        put32(sample + 12, UINT32_MAX);
+    }
+    return 4 + blockSize;
+}
+
+// A single KTXwriter entry, padded to 4 bytes.
+static size_t write_kvd(unsigned char* p) {
+    static const char KEY[] = "KTXwriter";
+    const uint32_t length = (uint32_t) (sizeof(KEY) + sizeof(WRITER));
+    if (p) {
+        put32(p, length);
+        memcpy(p + 4, KEY, sizeof(KEY));
+        memcpy(p + 4 + sizeof(KEY), WRITER, sizeof(WRITER));
+        memset(p + 4 + length, 0, align_up(4 + length, 4) - (4 + length));
+    }
+    return align_up(4 + length, 4);
+}
+
+bool ktx2_write(const char* path, BcFormat format, bool srgb, int width, int height, int levelCount,
+                const void* const* levels) {
+    if (levelCount < 1 || levelCount > KTX2_MAX_LEVELS) return false;
+
+    // The level data is stored smallest first, each level aligned to the block size.
+    const size_t alignment = bc_block_size(format);
+    const size_t dfdOffset = HEADER_SIZE + (size_t) levelCount * LEVEL_ENTRY_SIZE;
+    const size_t dfdSize = 4 + 24 + 16 * (format == BC_FORMAT_BC3 ? 2 : 1);
+    const size_t kvdOffset = dfdOffset + dfdSize;
+    const size_t kvdSize = write_kvd(NULL);
+
+    size_t offsets[KTX2_MAX_LEVELS];
+    size_t end = kvdOffset + kvdSize;
+    for (int level = levelCount - 1; level >= 0; level--) {
+        offsets[level] = align_up(end, alignment);
+        end = offsets[level] + bc_image_size(format, level_extent(width, level), level_extent(height, level));
+    }
+
+    unsigned char* file = calloc(1, end);
+    if (!file) return false;
+
+    memcpy(file, IDENTIFIER, sizeof(IDENTIFIER));
+    put32(file + 12, ktx2_vk_format(format, srgb));
+    put32(file + 16, 1); // typeSize
+    put32(file + 20, (uint32_t) width);
+    put32(file + 24, (uint32_t) height);
+    put32(file + 28, 0); // pixelDepth
+    put32(file + 32, 0); // layerCount
+    put32(file + 36, 1); // faceCount
+    put32(file + 40, (uint32_t) levelCount);
+    put32(file + 44, 0); // supercompressionScheme
+    put32(file + 48, (uint32_t) dfdOffset);
+    put32(file + 52, (uint32_t) dfdSize);
+    put32(file + 56, (uint32_t) kvdOffset);
+    put32(file + 60, (uint32_t) kvdSize);
+    put64(file + 64, 0); // no supercompression global data
+    put64(file + 72, 0);
+
+    for (int level = 0; level < levelCount; level++) {
+        const size_t size = bc_image_size(format, level_extent(width, level), level_extent(height, level));
+        unsigned char* entry = file + HEADER_SIZE + (size_t) level * LEVEL_ENTRY_SIZE;
+        put64(entry, offsets[level]);
+        put64(entry + 8, size);
+        put64(entry + 16, size);
+        memcpy(file + offsets[level], levels[level], size);
+    }
+    write_dfd(file + dfdOffset, format, srgb);
+    write_kvd(file + kvdOffset);
+
+    FILE* out = fopen(path, "wb");
+    bool written = out && fwrite(file, 1, end, out) == end;
+    if (out && fclose(out) != 0) written = false;
+    free(file);
+    if (!written) printf("Failed to write %s\n", path);
+    return written;
+}
+
+bool ktx2_is_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    unsigned char identifier[sizeof(IDENTIFIER)];
+    const bool match = fread(identifier, 1, sizeof(identifier), file) == sizeof(identifier) &&
+                       memcmp(identifier, IDENTIFIER, sizeof(IDENTIFIER)) == 0;
+    fclose(file);
+    return match;
+}
+
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    unsigned char* data = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        const long length = ftell(file);
+        if (length > 0 && fseek(file, 0, SEEK_SET) == 0) {
+            data = malloc((size_t) length);
+            if (data && fread(data, 1, (size_t) length, file) != (size_t) length) {
+                free(data);
+                data = NULL;
+            }
+            *size = (size_t) length;
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+bool ktx2_read(const char* path, Ktx2Texture* texture) {
+    memset(texture, 0, sizeof(*texture));
+    size_t size = 0;
+    unsigned char* data = read_file(path, &size);
+    if (!data) {
+        printf("Failed to read %s\n", path);
+        return false;
+    }
+
+    if (size < HEADER_SIZE || memcmp(data, IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+        printf("Failed to load %s: not a KTX2 file\n", path);
+        free(data);
+        return false;
+    }
+
+    const char* error = NULL;
+    BcFormat format = BC_FORMAT_BC1;
+    const int width = (int) get32(data + 20), height = (int) get32(data + 24);
+    int levelCount = (int) get32(data + 40);
+    if (levelCount == 0) levelCount = 1; // 0 asks the loader to generate the mips, the file holds only level 0
+
+    if (!block_format(get32(data + 12), &format)) error = "unsupported format";
+    else if (get32(data + 28) != 0 || get32(data + 32) != 0 || get32(data + 36) != 1)
+        error = "only single 2D textures are supported";
+    else if (get32(data + 44) != 0) error = "supercompression is not supported";
+    else if (width <= 0 || height <= 0 || levelCount > KTX2_MAX_LEVELS ||
+             size < HEADER_SIZE + (size_t) levelCount * LEVEL_ENTRY_SIZE)
+        error = "corrupt header";
+
+    for (int level = 0; !error && level < levelCount; level++) {
+        const unsigned char* entry = data + HEADER_SIZE + (size_t) level * LEVEL_ENTRY_SIZE;
+        const uint64_t offset = get64(entry), length = get64(entry + 8);
+        const size_t expected = bc_image_size(format, level_extent(width, level), level_extent(height, level));
+        if (length != expected || offset > size || length > size - offset) {
+            error = "corrupt level index";
+            break;
+        }
+        texture->levels[level] = data + offset;
+        texture->levelSizes[level] = (size_t) length;
+    }
+
+    if (error) {
+        printf("Failed to load %s: %s\n", path, error);
+        free(data);
+        memset(texture, 0, sizeof(*texture));
+        return false;
+    }
+    texture->vkFormat = get32(data + 12);
+    texture->width = width;
+    texture->height = height;
+    texture->levelCount = levelCount;
+    texture->data = data;
+    return true;
+}
+
+void ktx2_free(Ktx2Texture* texture) {
+    free(texture->data);
+    memset(texture, 0, sizeof(*texture));
+}
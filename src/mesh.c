@@ -2,11 +2,19 @@
 // Created by User on 5/5/2025.
 //
 
+#include <stdio.h>
+#include <stdlib.h>
 #include "mesh.h"
+#include "gl_state.h"
+#include "upload_queue.h"
 
 const Attribute ATTRIB_POSITION = { 3, GL_FLOAT };
 const Attribute ATTRIB_UV = { 2, GL_FLOAT };
 
+static GLuint instance_ssbo = 0;
+static mat4* instance_matrices = NULL;
+static int instance_matrix_capacity = 0;
+
 int gl_type_size(const GLenum type) {
     switch (type) {
         case GL_FLOAT: return sizeof(GLfloat);
@@ -34,14 +42,20 @@ Mesh mesh_init(const float* data, const unsigned int dataSize,
         .indices = indicesSize,
     };
 
-    glBindVertexArray(VAO);
+    gl_state_bind_vertex_array(VAO);
 
+    // Deferred uploads allocate the buffers now and fill them from the upload queue, see upload_queue.h.
+    const bool deferred = upload_queue_deferred();
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, dataSize, data, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, dataSize, deferred ? NULL : data, GL_STATIC_DRAW);
+    if (deferred && !upload_queue_buffer(VBO, 0, dataSize, data, UPLOAD_DATA_COPY, NULL, NULL))
+        glBufferSubData(GL_ARRAY_BUFFER, 0, dataSize, data);
 
     if (indicesSize > 0) {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesSize, indices, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesSize, deferred ? NULL : indices, GL_STATIC_DRAW);
+        if (deferred && !upload_queue_buffer(EBO, 0, indicesSize, indices, UPLOAD_DATA_COPY, NULL, NULL))
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indicesSize, indices);
     }
 
     return vao;
@@ -56,6 +70,10 @@ Mesh mesh_init_ptr(const float* data, const unsigned int dataSize,
         glVertexAttribPointer(i, attribSizes[i], GL_FLOAT, GL_FALSE, attribStrides[i], (void*)attribOffsets[i]);
         glEnableVertexAttribArray(i);
     }
+    if (attribCount > 0) {
+        const GLsizei stride = attribStrides[0] ? attribStrides[0] : attribSizes[0] * (GLsizei) sizeof(GLfloat);
+        vao.vertices = dataSize / stride;
+    }
 
     return vao;
 }
@@ -75,21 +93,68 @@ Mesh mesh_init_attrib(float* data, unsigned int dataSize,
         glVertexAttribPointer(i, attributes[i].size, attributes[i].type, GL_FALSE, stride, (void*)offset);
         glEnableVertexAttribArray(i);
     }
+    if (stride > 0)
+        vao.vertices = dataSize / stride;
 
     return vao;
 }
 
 void mesh_bind(Mesh mesh) {
-    glBindVertexArray(mesh.vao);
+    gl_state_bind_vertex_array(mesh.vao);
 }
 
 void mesh_destroy(Mesh *m) {
     glDeleteBuffers(1, &m->ebo);
     glDeleteBuffers(1, &m->vbo);
+    gl_state_forget_vertex_array(m->vao);
     glDeleteVertexArrays(1, &m->vao);
 
     m->vao = m->vbo = m->ebo = 0;
     m->indices = 0;
+    m->vertices = 0;
+}
+
+static bool instance_data_reserve(int count) {
+    if (count > instance_matrix_capacity) {
+        int capacity = instance_matrix_capacity ? instance_matrix_capacity : 64;
+        while (capacity < count) capacity *= 2;
+        mat4* grown = realloc(instance_matrices, capacity * sizeof(mat4));
+        if (!grown) {
+            printf("Failed to allocate %d instance matrices\n", capacity);
+            return false;
+        }
+        instance_matrices = grown;
+        instance_matrix_capacity = capacity;
+    }
+    if (!instance_ssbo)
+        glCreateBuffers(1, &instance_ssbo);
+    return true;
+}
+
+void mesh_draw_instanced(Mesh mesh, const Model* models, int count) {
+    if (count <= 0 || !instance_data_reserve(count)) return;
+
+    for (int i = 0; i < count; i++)
+        model_to_matrix(models[i], instance_matrices[i]);
+
+    // Orphan the previous contents instead of waiting for the draws still reading them.
+    glNamedBufferData(instance_ssbo, (GLsizeiptr) instance_matrix_capacity * sizeof(mat4), NULL, GL_STREAM_DRAW);
+    glNamedBufferSubData(instance_ssbo, 0, (GLsizeiptr) count * sizeof(mat4), instance_matrices);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_BINDING, instance_ssbo);
+
+    mesh_bind(mesh);
+    if (mesh.ebo)
+        glDrawElementsInstanced(GL_TRIANGLES, mesh.indices / (GLsizei) sizeof(GLuint), GL_UNSIGNED_INT, 0, count);
+    else
+        glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.vertices, count);
+}
+
+void mesh_instance_data_delete() {
+    glDeleteBuffers(1, &instance_ssbo);
+    instance_ssbo = 0;
+    free(instance_matrices);
+    instance_matrices = NULL;
+    instance_matrix_capacity = 0;
 }
 
 Model model_init(float x, float y, float z) {
@@ -131,11 +196,16 @@ void model_scale(Model *m, float x, float y, float z) {
     m->scale[2] = z;
 }
 
+void model_to_matrix(Model m, mat4 dest) {
+    glm_mat4_identity(dest);
+    glm_translate(dest, m.position);
+    glm_quat_rotate_at(dest, m.orientation, (vec3){0,0,0});
+    glm_scale(dest, m.scale);
+}
+
 void model_to_shader(Model m, Shader shader) {
-    mat4 model = GLM_MAT4_IDENTITY_INIT;
-    glm_translate(model, m.position);
-    glm_quat_rotate_at(model, m.orientation, (vec3){0,0,0});
-    glm_scale(model, m.scale);
+    mat4 model;
+    model_to_matrix(m, model);
 
     shader_uMat4f(shader, "model", model);
 }
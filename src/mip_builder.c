@@ -0,0 +1,371 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mip_builder.h"
+#include "thread_pool.h"
+
+#if defined(__SSE2__)
+#define MIP_BUILDER_SSE2 1
+#include <emmintrin.h>
+#else
+#define MIP_BUILDER_SSE2 0
+#endif
+
+// Destination rows per parallel work item.
+#define BAND_ROWS 16
+
+// Kaiser window: half width in destination texels and shape parameter.
+#define KAISER_RADIUS 2.0f
+#define KAISER_ALPHA 4.0f
+#define PI 3.14159265358979f
+
+/**
+ * Separable filter along one axis, every destination texel reads taps source texels.
+ * Taps past the edge are clamped onto the border texel.
+ */
+typedef struct {
+    int taps;
+    int* index;
+    float* weight;
+} AxisFilter;
+
+typedef struct {
+    const MipDesc* desc;
+    const void* src;      // level 0 in the caller's format, or float linear
+    bool srcIsFloat;
+    int srcWidth;
+    int srcHeight;
+    int dstWidth;
+    int dstHeight;
+    AxisFilter fx;
+    AxisFilter fy;
+    float* dstFloat;      // linear result, the source of the next level
+    void* dstOut;         // the result in the chain's format, the same buffer as dstFloat for HDR
+    const float* decode;  // 8 bit to linear per channel
+} LevelJob;
+
+static float srgb_decode[256];
+static float unorm_decode[256];
+static float srgb_thresholds[256]; // linear value where each code starts, rounding in sRGB space
+
+static float srgb_to_linear(float c) {
+    return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static void init_tables(void) {
+    for (int i = 0; i < 256; i++) {
+        unorm_decode[i] = (float) i / 255.0f;
+        srgb_decode[i] = srgb_to_linear((float) i / 255.0f);
+        srgb_thresholds[i] = i == 0 ? 0.0f : srgb_to_linear(((float) i - 0.5f) / 255.0f);
+    }
+}
+
+// Binary search over the code thresholds, exact and much cheaper than a pow per channel.
+static uint8_t encode_srgb(float v) {
+    int code = 0;
+    for (int step = 128; step > 0; step >>= 1) {
+        if (srgb_thresholds[code + step] <= v) code += step;
+    }
+    return (uint8_t) code;
+}
+
+static float bessel_i0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 20; k++) {
+        term *= (x * 0.5f / (float) k) * (x * 0.5f / (float) k);
+        sum += term;
+    }
+    return sum;
+}
+
+static float kaiser_sinc(float x) {
+    if (fabsf(x) >= KAISER_RADIUS) return 0.0f;
+    const float t = x / KAISER_RADIUS;
+    const float window = bessel_i0(KAISER_ALPHA * sqrtf(1.0f - t * t)) / bessel_i0(KAISER_ALPHA);
+    const float sinc = x == 0.0f ? 1.0f : sinf(PI * x) / (PI * x);
+    return sinc * window;
+}
+
+static bool axis_filter_init(AxisFilter* f, MipFilter filter, int srcSize, int dstSize) {
+    const float scale = (float) srcSize / (float) dstSize;
+    if (srcSize == dstSize) f->taps = 1;
+    else if (filter == MIP_FILTER_BOX) f->taps = srcSize % dstSize == 0 ? srcSize / dstSize : (int) ceilf(scale) + 1;
+    else f->taps = (int) ceilf(2.0f * KAISER_RADIUS * scale) + 1;
+
+    f->index = malloc((size_t) dstSize * f->taps * sizeof(int));
+    f->weight = malloc((size_t) dstSize * f->taps * sizeof(float));
+    if (!f->index || !f->weight) return false;
+
+    for (int i = 0; i < dstSize; i++) {
+        int* index = f->index + (size_t) i * f->taps;
+        float* weight = f->weight + (size_t) i * f->taps;
+        if (f->taps == 1) {
+            index[0] = i;
+            weight[0] = 1.0f;
+            continue;
+        }
+
+        const float center = ((float) i + 0.5f) * scale;
+        const float radius = filter == MIP_FILTER_BOX ? scale * 0.5f : KAISER_RADIUS * scale;
+        const int first = (int) floorf(center - radius);
+        float sum = 0.0f;
+        for (int t = 0; t < f->taps; t++) {
+            const int j = first + t;
+            float w;
+            if (filter == MIP_FILTER_BOX) {
+                // Coverage of source texel j by the destination footprint.
+                const float lo = fmaxf((float) j, center - radius), hi = fminf((float) j + 1.0f, center + radius);
+                w = hi > lo ? hi - lo : 0.0f;
+            } else {
+                w = kaiser_sinc(((float) j + 0.5f - center) / scale);
+            }
+            index[t] = j < 0 ? 0 : (j >= srcSize ? srcSize - 1 : j);
+            weight[t] = w;
+            sum += w;
+        }
+        for (int t = 0; t < f->taps; t++) weight[t] /= sum;
+    }
+    return true;
+}
+
+static void axis_filter_free(AxisFilter* f) {
+    free(f->index);
+    free(f->weight);
+}
+
+// One source row as linear floats, 8 bit rows are decoded into scratch.
+static const float* load_row(const LevelJob* job, int y, float* scratch) {
+    const int channels = job->desc->channels;
+    const size_t count = (size_t) job->srcWidth * channels;
+    if (job->srcIsFloat) return (const float*) job->src + (size_t) y * count;
+
+    const uint8_t* src = (const uint8_t*) job->src + (size_t) y * count;
+    for (size_t i = 0; i < count; i += channels) {
+        for (int c = 0; c < channels; c++) scratch[i + c] = job->decode[c * 256 + src[i + c]];
+    }
+    return scratch;
+}
+
+// The channel count is a constant in every inlined copy, so the inner loops unroll.
+static inline void filter_row_channels(const LevelJob* job, const float* row, float* out, int channels) {
+    const AxisFilter* f = &job->fx;
+    for (int x = 0; x < job->dstWidth; x++) {
+        const int* index = f->index + (size_t) x * f->taps;
+        const float* weight = f->weight + (size_t) x * f->taps;
+        float sum[4] = {0};
+        for (int t = 0; t < f->taps; t++) {
+            const float* texel = row + (size_t) index[t] * channels;
+            for (int c = 0; c < channels; c++) sum[c] += weight[t] * texel[c];
+        }
+        for (int c = 0; c < channels; c++) out[(size_t) x * channels + c] = sum[c];
+    }
+}
+
+static void filter_row(const LevelJob* job, const float* row, float* out) {
+    switch (job->desc->channels) {
+        case 1: filter_row_channels(job, row, out, 1); break;
+        case 2: filter_row_channels(job, row, out, 2); break;
+        case 3: filter_row_channels(job, row, out, 3); break;
+        default: {
+#if MIP_BUILDER_SSE2
+            // A texel fills a register.
+            const AxisFilter* f = &job->fx;
+            for (int x = 0; x < job->dstWidth; x++) {
+                const int* index = f->index + (size_t) x * f->taps;
+                const float* weight = f->weight + (size_t) x * f->taps;
+                __m128 sum = _mm_setzero_ps();
+                for (int t = 0; t < f->taps; t++)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight[t]), _mm_loadu_ps(row + (size_t) index[t] * 4)));
+                _mm_storeu_ps(out + (size_t) x * 4, sum);
+            }
+#else
+            filter_row_channels(job, row, out, 4);
+#endif
+            break;
+        }
+    }
+}
+
+// acc += w * row, the vertical pass.
+static void accumulate(float* acc, const float* row, float w, size_t count) {
+    size_t i = 0;
+#if MIP_BUILDER_SSE2
+    const __m128 wv = _mm_set1_ps(w);
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(wv, _mm_loadu_ps(row + i))));
+#endif
+    for (; i < count; i++) acc[i] += w * row[i];
+}
+
+static void store_row(const LevelJob* job, int y, float* acc) {
+    const MipDesc* desc = job->desc;
+    const size_t count = (size_t) job->dstWidth * desc->channels;
+    // The negative lobes of the Kaiser filter can ring below zero next to bright texels.
+    for (size_t i = 0; i < count; i++) acc[i] = acc[i] > 0.0f ? acc[i] : 0.0f;
+
+    if (job->dstFloat) memcpy(job->dstFloat + (size_t) y * count, acc, count * sizeof(float));
+    if (desc->hdr) return;
+
+    uint8_t* out = (uint8_t*) job->dstOut + (size_t) y * count;
+    const int srgbChannels = desc->srgb ? (desc->channels < 3 ? desc->channels : 3) : 0;
+    for (size_t i = 0; i < count; i += desc->channels) {
+        for (int c = 0; c < desc->channels; c++) {
+            out[i + c] = c < srgbChannels ? encode_srgb(acc[i + c])
+                                          : (uint8_t) ((acc[i + c] < 1.0f ? acc[i + c] : 1.0f) * 255.0f + 0.5f);
+        }
+    }
+}
+
+static void build_band(void* ctx, int band) {
+    const LevelJob* job = ctx;
+    const int channels = job->desc->channels;
+    const int y0 = band * BAND_ROWS;
+    const int y1 = y0 + BAND_ROWS < job->dstHeight ? y0 + BAND_ROWS : job->dstHeight;
+
+    // Source rows this band reads, each is filtered horizontally once.
+    int lo = job->srcHeight, hi = 0;
+    for (int i = y0 * job->fy.taps; i < y1 * job->fy.taps; i++) {
+        if (job->fy.index[i] < lo) lo = job->fy.index[i];
+        if (job->fy.index[i] > hi) hi = job->fy.index[i];
+    }
+
+    const size_t dstCount = (size_t) job->dstWidth * channels;
+    float* row = malloc((size_t) job->srcWidth * channels * sizeof(float));
+    float* filtered = malloc((size_t) (hi - lo + 1) * dstCount * sizeof(float));
+    float* acc = malloc(dstCount * sizeof(float));
+    if (!row || !filtered || !acc) {
+        // Out of memory, the band stays black rather than crashing a worker.
+        const size_t outBytes = dstCount * (job->desc->hdr ? sizeof(float) : 1);
+        memset((char*) job->dstOut + (size_t) y0 * outBytes, 0, (size_t) (y1 - y0) * outBytes);
+        if (job->dstFloat && !job->desc->hdr)
+            memset(job->dstFloat + (size_t) y0 * dstCount, 0, (size_t) (y1 - y0) * dstCount * sizeof(float));
+        free(row);
+        free(filtered);
+        free(acc);
+        return;
+    }
+
+    for (int y = lo; y <= hi; y++) {
+        filter_row(job, load_row(job, y, row), filtered + (size_t) (y - lo) * dstCount);
+    }
+    for (int y = y0; y < y1; y++) {
+        memset(acc, 0, dstCount * sizeof(float));
+        for (int t = 0; t < job->fy.taps; t++) {
+            const size_t tap = (size_t) y * job->fy.taps + t;
+            accumulate(acc, filtered + (size_t) (job->fy.index[tap] - lo) * dstCount, job->fy.weight[tap], dstCount);
+        }
+        store_row(job, y, acc);
+    }
+
+    free(row);
+    free(filtered);
+    free(acc);
+}
+
+int mip_level_count(int width, int height) {
+    int count = 1;
+    for (int size = width > height ? width : height; size > 1 && count < MIP_MAX_LEVELS; size /= 2)
+        count++;
+    return count;
+}
+
+size_t mip_texel_size(const MipDesc* desc) {
+    return (size_t) desc->channels * (desc->hdr ? sizeof(float) : 1);
+}
+
+// Fills in the level sizes and offsets of up to levelCount levels, storage holds levels 1 and up back to back.
+static size_t chain_layout(const MipDesc* desc, const void* pixels, int width, int height, int levelCount,
+                           MipChain* chain) {
+    memset(chain, 0, sizeof(*chain));
+    chain->levelCount = mip_level_count(width, height);
+    if (levelCount >= 1 && levelCount < chain->levelCount) chain->levelCount = levelCount;
+    size_t total = 0;
+    for (int level = 0; level < chain->levelCount; level++) {
+        chain->widths[level] = width >> level > 0 ? width >> level : 1;
+        chain->heights[level] = height >> level > 0 ? height >> level : 1;
+        chain->sizes[level] = (size_t) chain->widths[level] * chain->heights[level] * mip_texel_size(desc);
+        if (level > 0) total += chain->sizes[level];
+    }
+    chain->levels[0] = pixels;
+    return total;
+}
+
+static void chain_attach(MipChain* chain, void* storage) {
+    chain->storage = storage;
+    char* p = storage;
+    for (int level = 1; level < chain->levelCount; level++) {
+        chain->levels[level] = p;
+        p += chain->sizes[level];
+    }
+}
+
+bool mip_build(const MipDesc* desc, const void* pixels, int width, int height, MipChain* chain) {
+    return mip_build_levels(desc, pixels, width, height, MIP_MAX_LEVELS, chain);
+}
+
+bool mip_build_levels(const MipDesc* desc, const void* pixels, int width, int height, int levelCount,
+                      MipChain* chain) {
+    static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+    pthread_once(&tablesOnce, init_tables);
+
+    const size_t total = chain_layout(desc, pixels, width, height, levelCount, chain);
+    if (chain->levelCount == 1) return true;
+
+    void* storage = malloc(total);
+    // 8 bit chains keep the previous level in float next to the quantized one.
+    float* scratch[2] = {NULL, NULL};
+    float decode[4 * 256];
+    if (!desc->hdr) {
+        const size_t floats = (size_t) chain->widths[1] * chain->heights[1] * desc->channels;
+        scratch[0] = malloc(floats * sizeof(float));
+        scratch[1] = malloc(floats * sizeof(float));
+        for (int c = 0; c < 4; c++)
+            memcpy(decode + c * 256, desc->srgb && c < 3 ? srgb_decode : unorm_decode, sizeof(srgb_decode));
+    }
+    if (!storage || (!desc->hdr && (!scratch[0] || !scratch[1]))) {
+        free(storage);
+        free(scratch[0]);
+        free(scratch[1]);
+        memset(chain, 0, sizeof(*chain));
+        return false;
+    }
+    chain_attach(chain, storage);
+
+    bool ok = true;
+    for (int level = 1; level < chain->levelCount && ok; level++) {
+        LevelJob job = {
+            .desc = desc,
+            .src = level == 1 ? pixels : (desc->hdr ? chain->levels[level - 1] : scratch[(level - 1) & 1]),
+            .srcIsFloat = desc->hdr || level > 1,
+            .srcWidth = chain->widths[level - 1],
+            .srcHeight = chain->heights[level - 1],
+            .dstWidth = chain->widths[level],
+            .dstHeight = chain->heights[level],
+            .dstOut = (void*) chain->levels[level],
+            .dstFloat = desc->hdr ? (float*) chain->levels[level] : scratch[level & 1],
+            .decode = decode,
+        };
+        ok = axis_filter_init(&job.fx, desc->filter, job.srcWidth, job.dstWidth) &&
+             axis_filter_init(&job.fy, desc->filter, job.srcHeight, job.dstHeight);
+        if (ok) {
+            // The float result of the last level is not needed, skip writing it.
+            if (!desc->hdr && level == chain->levelCount - 1) job.dstFloat = NULL;
+            const int bands = (job.dstHeight + BAND_ROWS - 1) / BAND_ROWS;
+            thread_pool_parallel_for(thread_pool_shared(), bands, build_band, &job);
+        }
+        axis_filter_free(&job.fx);
+        axis_filter_free(&job.fy);
+    }
+
+    free(scratch[0]);
+    free(scratch[1]);
+    if (!ok) mip_chain_free(chain);
+    return ok;
+}
+
+void mip_chain_free(MipChain* chain) {
+    free(chain->storage);
+    memset(chain, 0, sizeof(*chain));
+}
@@ -1,21 +1,53 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <glad/glad.h>
 #include <cglm/cglm.h>
+#include <GLFW/glfw3.h>
 #include "shader.h"
+#include "shader_internal.h"
+#include "frame_data.h"
+#include "gl_state.h"
+#include "shader_cache.h"
+#include "utils.h"
 
-void checkCompileErrors(const GLuint shader, const GLenum type) {
+typedef struct {
+    char* name;
+    uint32_t hash;
+    GLint location;
+    GLenum type;
+    GLint size;
+} UniformEntry;
+
+// The last value written to a location, so that writes of an unchanged value can be skipped.
+typedef struct {
+    uint32_t data[16];
+    uint32_t size; // bytes in data, 0 until the first write
+} UniformValue;
+
+struct UniformTable {
+    GLuint program;        // follows hot reloads, so every copy of a Shader uses the current program
+    UniformEntry* entries;
+    unsigned int capacity; // always a power of two, 0 for an empty table
+    unsigned int count;
+    UniformValue* values;  // indexed by location
+    GLint valueCount;
+};
+
+bool checkCompileErrors(const GLuint shader, const GLenum type) {
     int success;
     char infoLog[1024];
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-        printf("ERROR::PROGRAM_COMPILATION_ERROR of type: %s \n %s \n -- --------------------------------------------------- -- \n", glGetString(type), infoLog);
+        glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+        printf("ERROR::PROGRAM_COMPILATION_ERROR of type: %s \n %s \n -- --------------------------------------------------- -- \n",
+               type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT", infoLog);
     }
+    return success;
 }
 
-void checkLinkingErrors(const GLuint program) {
+bool checkLinkingErrors(const GLuint program) {
     int success;
     char infoLog[1024];
     glGetProgramiv(program, GL_LINK_STATUS, &success);
@@ -24,6 +56,7 @@ void checkLinkingErrors(const GLuint program) {
         glGetProgramInfoLog(program, 1024, NULL, infoLog);
         printf("ERROR::SHADER_LINKING_ERROR of type: PROGRAM \n %s \n -- --------------------------------------------------- -- \n", infoLog);
     }
+    return success;
 }
 
 /**
@@ -31,7 +64,7 @@ void checkLinkingErrors(const GLuint program) {
  * @param path A string of the path of the shader file.
  * @return The file pointed to by the path
  */
-char* loadShaderSource(const char* path) {
+char* readShaderFile(const char* path) {
     FILE* file = fopen(path, "rb");
     if (!file) {
         printf("Error opening file: %s\n", path);
@@ -57,19 +90,35 @@ char* loadShaderSource(const char* path) {
     return buffer;
 }
 
-GLuint compileShaderSource(const GLenum type, const char* source) {
-    int shader = glCreateShader(type);
+GLuint compileShader(const GLenum type, const char* source) {
+    const GLuint shader = glCreateShader(type);
     glShaderSource(shader, 1, &source, NULL);
     glCompileShader(shader);
+    return shader;
+}
+
+GLuint compileShaderSource(const GLenum type, const char* source) {
+    const GLuint shader = compileShader(type, source);
     checkCompileErrors(shader, type);
     return shader;
 }
 
-GLuint linkProgram(const GLuint vertexShader, const GLuint fragmentShader) {
+GLuint startLinkProgram(const GLuint vertexShader, const GLuint fragmentShader) {
     const GLuint program = glCreateProgram();
-    glAttachShader(program, vertexShader);
-    glAttachShader(program, fragmentShader);
+    if (vertexShader)
+        glAttachShader(program, vertexShader);
+    if (fragmentShader)
+        glAttachShader(program, fragmentShader);
+    if (!vertexShader || !fragmentShader)
+        glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+    if (shader_cache_enabled())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
+    return program;
+}
+
+GLuint linkProgram(const GLuint vertexShader, const GLuint fragmentShader) {
+    const GLuint program = startLinkProgram(vertexShader, fragmentShader);
     checkLinkingErrors(program);
 
     glDeleteShader(vertexShader);
@@ -77,49 +126,405 @@ GLuint linkProgram(const GLuint vertexShader, const GLuint fragmentShader) {
     return program;
 }
 
+static uint32_t uniform_hash(const char* name) {
+    return (uint32_t) hash_string(name, FNV1A_SEED);
+}
+
+static void uniform_table_insert(UniformTable* table, const char* name, size_t length, GLint location, GLenum type, GLint size) {
+    char* key = malloc(length + 1);
+    if (!key) return;
+    memcpy(key, name, length);
+    key[length] = '\0';
+
+    const uint32_t hash = uniform_hash(key);
+    unsigned int i = hash & (table->capacity - 1);
+    while (table->entries[i].name) {
+        if (table->entries[i].hash == hash && strcmp(table->entries[i].name, key) == 0) {
+            free(key);
+            return;
+        }
+        i = (i + 1) & (table->capacity - 1);
+    }
+
+    table->entries[i] = (UniformEntry) {
+        .name = key, .hash = hash, .location = location, .type = type, .size = size
+    };
+    table->count++;
+}
+
+/**
+ * Enumerates the active uniforms of a linked program and stores their locations in an open addressing hash table.
+ * Arrays are registered as "name[0]", the way the driver reports them, as plain "name", and as "name[i]" for every
+ * other element, since their locations are not guaranteed to be consecutive.
+ */
+UniformTable* uniform_table_build(const GLuint program) {
+    UniformTable* table = calloc(1, sizeof(UniformTable));
+    if (!table) return NULL;
+    table->program = program;
+    if (!program) return table;
+
+    GLint active = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &active);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    if (active <= 0) return table;
+
+    GLuint* indices = malloc(active * sizeof(GLuint));
+    GLint* sizes = malloc(active * sizeof(GLint));
+    // Room for the longest name plus an element index.
+    char* name = malloc(maxLength + 16);
+    if (!indices || !sizes || !name) {
+        free(indices);
+        free(sizes);
+        free(name);
+        return table;
+    }
+
+    // One key per array element plus the plain name, kept below half load.
+    for (GLint i = 0; i < active; i++)
+        indices[i] = i;
+    glGetActiveUniformsiv(program, active, indices, GL_UNIFORM_SIZE, sizes);
+    unsigned int keys = 0;
+    for (GLint i = 0; i < active; i++)
+        keys += (unsigned int) sizes[i] + 1;
+
+    unsigned int capacity = 8;
+    while (capacity < keys * 2) capacity <<= 1;
+    table->entries = calloc(capacity, sizeof(UniformEntry));
+    if (table->entries)
+        table->capacity = capacity;
+
+    for (GLint i = 0; i < active && table->entries; i++) {
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program, i, maxLength + 1, &length, &size, &type, name);
+
+        const GLint location = glGetUniformLocation(program, name);
+        if (location < 0) continue; // uniform block members have no location
+
+        uniform_table_insert(table, name, length, location, type, size);
+        if (location >= table->valueCount)
+            table->valueCount = location + 1;
+        if (length <= 3 || strcmp(name + length - 3, "[0]") != 0)
+            continue;
+
+        const GLsizei baseLength = length - 3;
+        uniform_table_insert(table, name, baseLength, location, type, size);
+        for (GLint element = 1; element < size; element++) {
+            const int elementLength = baseLength + sprintf(name + baseLength, "[%d]", element);
+            const GLint elementLocation = glGetUniformLocation(program, name);
+            if (elementLocation < 0) continue;
+            uniform_table_insert(table, name, elementLength, elementLocation, type, size - element);
+            if (elementLocation >= table->valueCount)
+                table->valueCount = elementLocation + 1;
+        }
+    }
+
+    free(indices);
+    free(sizes);
+    free(name);
+    table->values = calloc(table->valueCount, sizeof(UniformValue));
+    if (!table->values) table->valueCount = 0;
+    return table;
+}
+
+static void uniform_table_clear(UniformTable* table) {
+    for (unsigned int i = 0; i < table->capacity; i++)
+        free(table->entries[i].name);
+    free(table->entries);
+    free(table->values);
+}
+
+void uniform_table_free(UniformTable* table) {
+    if (!table) return;
+    uniform_table_clear(table);
+    free(table);
+}
+
+void uniform_table_replace(UniformTable* dst, UniformTable* src) {
+    if (!dst || !src) return;
+    uniform_table_clear(dst);
+    *dst = *src;
+    free(src);
+}
+
+static const UniformEntry* uniform_table_find(const UniformTable* table, const char* name) {
+    if (!table || table->capacity == 0) return NULL;
+
+    const uint32_t hash = uniform_hash(name);
+    unsigned int i = hash & (table->capacity - 1);
+    while (table->entries[i].name) {
+        if (table->entries[i].hash == hash && strcmp(table->entries[i].name, name) == 0)
+            return &table->entries[i];
+        i = (i + 1) & (table->capacity - 1);
+    }
+    return NULL;
+}
+
+bool loadProgramSources(const char* vertexPath, const char* fragmentPath, const char* defines, ProgramSources* out) {
+    *out = (ProgramSources) {0};
+    const char* paths[] = {vertexPath, fragmentPath};
+    for (int i = 0; i < 2; i++) {
+        if (!paths[i]) continue;
+        out->sources[i] = loadShaderSource(paths[i], defines, &out->files);
+        if (!out->sources[i]) {
+            freeProgramSources(out);
+            return false;
+        }
+    }
+
+    if (shader_cache_enabled()) {
+        // An absent stage hashes like an empty one, which can never compile on its own.
+        const char* sources[] = {
+            out->sources[0] ? out->sources[0] : "",
+            out->sources[1] ? out->sources[1] : "",
+        };
+        out->key = shader_cache_key(sources, 2);
+    }
+    return true;
+}
+
+void freeProgramSources(ProgramSources* sources) {
+    free(sources->sources[0]);
+    free(sources->sources[1]);
+    sources->sources[0] = sources->sources[1] = NULL;
+    shader_file_set_free(&sources->files);
+}
+
+GLuint startBuildProgram(const ProgramSources* sources, GLuint shaders[2]) {
+    shaders[0] = sources->sources[0] ? compileShader(GL_VERTEX_SHADER, sources->sources[0]) : 0;
+    shaders[1] = sources->sources[1] ? compileShader(GL_FRAGMENT_SHADER, sources->sources[1]) : 0;
+    return startLinkProgram(shaders[0], shaders[1]);
+}
+
+bool finishBuildProgram(const GLuint program, GLuint shaders[2], const uint64_t key) {
+    bool ok = true;
+    if (shaders[0]) ok &= checkCompileErrors(shaders[0], GL_VERTEX_SHADER);
+    if (shaders[1]) ok &= checkCompileErrors(shaders[1], GL_FRAGMENT_SHADER);
+    ok = ok && checkLinkingErrors(program);
+
+    glDeleteShader(shaders[0]);
+    glDeleteShader(shaders[1]);
+    shaders[0] = shaders[1] = 0;
+
+    if (!ok) {
+        glDeleteProgram(program);
+        return false;
+    }
+
+    if (shader_cache_enabled())
+        shader_cache_store(key, program);
+    return true;
+}
+
+GLuint createShaderProgramDefines(const char* vertexPath, const char* fragmentPath, const char* defines) {
+    ProgramSources sources;
+    if (!loadProgramSources(vertexPath, fragmentPath, defines, &sources))
+        return 0;
+
+    if (shader_cache_enabled()) {
+        const GLuint cached = shader_cache_load(sources.key);
+        if (cached) {
+            freeProgramSources(&sources);
+            return cached;
+        }
+    }
+
+    GLuint shaders[2];
+    const GLuint program = startBuildProgram(&sources, shaders);
+    freeProgramSources(&sources);
+
+    return finishBuildProgram(program, shaders, sources.key) ? program : 0;
+}
+
 GLuint create_shader_program(const char* vertexPath, const char* fragmentPath) {
-    char* vertexSource = loadShaderSource(vertexPath);
-    char* fragmentSource = loadShaderSource(fragmentPath);
-    const GLuint vertexShader = compileShaderSource(GL_VERTEX_SHADER, vertexSource);
-    const GLuint fragmentShader = compileShaderSource(GL_FRAGMENT_SHADER, fragmentSource);
+    return createShaderProgramDefines(vertexPath, fragmentPath, NULL);
+}
 
-    free(vertexSource);
-    free(fragmentSource);
+static void bind_frame_data(const GLuint program) {
+    const GLuint block = glGetUniformBlockIndex(program, "FrameData");
+    if (block != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, block, FRAME_DATA_BINDING);
+}
 
-    return linkProgram(vertexShader, fragmentShader);
+Shader shader_from_program(const GLuint program) {
+    bind_frame_data(program);
+    Shader shader = {.id = program, .uniforms = uniform_table_build(program)};
+    return shader;
 }
 
 Shader create_shader(const char* vertexPath, const char* fragmentPath) {
-    GLuint program = create_shader_program(vertexPath, fragmentPath);
-    Shader shader = {.id = program};
-    return shader;
+    return shader_from_program(create_shader_program(vertexPath, fragmentPath));
+}
+
+Shader create_shader_desc(const ShaderDesc* desc) {
+    return shader_from_program(createShaderProgramDefines(desc->vertexPath, desc->fragmentPath, desc->defines));
+}
+
+Shader create_shader_stage(GLenum stage, const char* path) {
+    const GLuint program = stage == GL_VERTEX_SHADER
+        ? createShaderProgramDefines(path, NULL, NULL)
+        : createShaderProgramDefines(NULL, path, NULL);
+    return shader_from_program(program);
+}
+
+static GLbitfield stage_bit(GLenum stage) {
+    return stage == GL_VERTEX_SHADER ? GL_VERTEX_SHADER_BIT : GL_FRAGMENT_SHADER_BIT;
+}
+
+ShaderPipeline shader_pipeline_create(Shader vertexStage, Shader fragmentStage) {
+    ShaderPipeline pipeline = {0};
+    glCreateProgramPipelines(1, &pipeline.id);
+    shader_pipeline_set_stage(pipeline, GL_VERTEX_SHADER, vertexStage);
+    shader_pipeline_set_stage(pipeline, GL_FRAGMENT_SHADER, fragmentStage);
+    return pipeline;
+}
+
+void shader_pipeline_set_stage(ShaderPipeline pipeline, GLenum stage, Shader shader) {
+    gl_state_use_program_stages(pipeline.id, stage_bit(stage), shader_program(shader));
+}
+
+void shader_pipeline_bind(ShaderPipeline pipeline) {
+    gl_state_bind_program_pipeline(pipeline.id);
+}
+
+void shader_pipeline_delete(ShaderPipeline* pipeline) {
+    gl_state_forget_program_pipeline(pipeline->id);
+    glDeleteProgramPipelines(1, &pipeline->id);
+    pipeline->id = 0;
+}
+
+bool shader_parallel_compile_supported() {
+    static int supported = -1;
+    if (supported < 0) {
+        supported = glfwExtensionSupported("GL_KHR_parallel_shader_compile") ||
+                    glfwExtensionSupported("GL_ARB_parallel_shader_compile");
+
+        // Let the driver pick as many compiler threads as it wants.
+        typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+        PFNGLMAXSHADERCOMPILERTHREADSPROC maxThreads =
+            (PFNGLMAXSHADERCOMPILERTHREADSPROC) glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+        if (!maxThreads)
+            maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC) glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+        if (supported && maxThreads)
+            maxThreads(0xFFFFFFFF);
+    }
+    return supported;
+}
+
+bool program_link_completed(const GLuint program) {
+    if (!shader_parallel_compile_supported())
+        return true;
+
+    GLint completed = GL_FALSE;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed;
+}
+
+GLuint shader_program(Shader shader) {
+    return shader.uniforms ? shader.uniforms->program : shader.id;
+}
+
+bool shader_ready(Shader shader) {
+    return shader.uniforms != NULL && shader.uniforms->program != 0;
 }
 
 void shader_use(Shader shader) {
-    glUseProgram(shader.id);
+    gl_state_use_program(shader_program(shader));
 }
 
 void shader_delete(Shader* shader) {
-    glDeleteProgram(shader->id);
+    shader_unwatch(shader);
+    const GLuint program = shader_program(*shader);
+    gl_state_forget_program(program);
+    glDeleteProgram(program);
+    uniform_table_free(shader->uniforms);
     shader->id = 0;
+    shader->uniforms = NULL;
+}
+
+GLint shader_uniform_location(Shader shader, const char* name) {
+    const UniformEntry* entry = uniform_table_find(shader.uniforms, name);
+    return entry ? entry->location : -1;
+}
+
+bool shader_uniform_info(Shader shader, const char* name, GLint* location, GLenum* type, GLint* size) {
+    const UniformEntry* entry = uniform_table_find(shader.uniforms, name);
+    if (!entry) return false;
+    *location = entry->location;
+    *type = entry->type;
+    *size = entry->size;
+    return true;
 }
 
 void shader_u1i(Shader shader, const char* name, int val) {
-    glUniform1i(glGetUniformLocation(shader.id, name), val);
+    shader_u1i_loc(shader, shader_uniform_location(shader, name), val);
 }
 
 void shader_u1f(Shader shader, const char* name, float val) {
-    glUniform1f(glGetUniformLocation(shader.id, name), val);
+    shader_u1f_loc(shader, shader_uniform_location(shader, name), val);
 }
 
 void shader_u2f(Shader shader, const char* name, float val1, float val2) {
-    glUniform2f(glGetUniformLocation(shader.id, name), val1, val2);
+    shader_u2f_loc(shader, shader_uniform_location(shader, name), val1, val2);
 }
 
 void shader_u3f(Shader shader, const char* name, vec3 val) {
-    glUniform3f(glGetUniformLocation(shader.id, name), val[0], val[1], val[2]);
+    shader_u3f_loc(shader, shader_uniform_location(shader, name), val);
 }
 
 void shader_uMat4f(Shader shader, const char* name, mat4 val) {
-    glUniformMatrix4fv(glGetUniformLocation(shader.id, name), 1, GL_FALSE, (float*)val);
-}
\ No newline at end of file
+    shader_uMat4f_loc(shader, shader_uniform_location(shader, name), val);
+}
+
+/**
+ * Compares a value against the last one written to the location and records it.
+ * @return true if the value differs and has to be sent to the driver.
+ */
+static bool uniform_changed(Shader shader, GLint location, const void* value, uint32_t size) {
+    // GL ignores writes to -1 anyway. They are no redundant writes either, so they stay out of the stats.
+    if (location < 0) return false;
+
+    UniformTable* table = shader.uniforms;
+    if (!table || location >= table->valueCount) {
+        gl_state_count(true);
+        return true;
+    }
+
+    UniformValue* last = &table->values[location];
+    if (last->size == size && memcmp(last->data, value, size) == 0) {
+        gl_state_count(false);
+        return false;
+    }
+
+    memcpy(last->data, value, size);
+    last->size = size;
+    gl_state_count(true);
+    return true;
+}
+
+void shader_u1i_loc(Shader shader, GLint location, int val) {
+    if (uniform_changed(shader, location, &val, sizeof(val)))
+        glProgramUniform1i(shader_program(shader), location, val);
+}
+
+void shader_u1f_loc(Shader shader, GLint location, float val) {
+    if (uniform_changed(shader, location, &val, sizeof(val)))
+        glProgramUniform1f(shader_program(shader), location, val);
+}
+
+void shader_u2f_loc(Shader shader, GLint location, float val1, float val2) {
+    const float val[2] = {val1, val2};
+    if (uniform_changed(shader, location, val, sizeof(val)))
+        glProgramUniform2f(shader_program(shader), location, val1, val2);
+}
+
+void shader_u3f_loc(Shader shader, GLint location, vec3 val) {
+    if (uniform_changed(shader, location, val, sizeof(vec3)))
+        glProgramUniform3f(shader_program(shader), location, val[0], val[1], val[2]);
+}
+
+void shader_uMat4f_loc(Shader shader, GLint location, mat4 val) {
+    if (uniform_changed(shader, location, val, sizeof(mat4)))
+        glProgramUniformMatrix4fv(shader_program(shader), location, 1, GL_FALSE, (float*)val);
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "shader.h"
+#include "shader_internal.h"
+#include "shader_cache.h"
+
+typedef struct {
+    GLuint program;
+    GLuint shaders[2];
+    uint64_t key;
+    const char* vertexPath;
+    const char* fragmentPath;
+    bool done;
+} BatchEntry;
+
+struct ShaderBatch {
+    BatchEntry* entries;
+    Shader* shaders;
+    int count;
+    int remaining;
+};
+
+ShaderBatch* shader_create_batch(const ShaderDesc* descs, int n, Shader* shaders) {
+    ShaderBatch* batch = malloc(sizeof(ShaderBatch));
+    if (!batch) return NULL;
+    batch->entries = calloc(n, sizeof(BatchEntry));
+    if (!batch->entries) {
+        free(batch);
+        return NULL;
+    }
+    batch->shaders = shaders;
+    batch->count = n;
+    batch->remaining = n;
+
+    shader_parallel_compile_supported();
+
+    for (int i = 0; i < n; i++) {
+        BatchEntry* e = &batch->entries[i];
+        e->vertexPath = descs[i].vertexPath;
+        e->fragmentPath = descs[i].fragmentPath;
+        shaders[i] = (Shader) {0};
+
+        ProgramSources sources;
+        if (!loadProgramSources(e->vertexPath, e->fragmentPath, descs[i].defines, &sources)) {
+            e->done = true;
+            batch->remaining--;
+            continue;
+        }
+        e->key = sources.key;
+
+        if (shader_cache_enabled()) {
+            const GLuint cached = shader_cache_load(e->key);
+            if (cached) {
+                shaders[i] = shader_from_program(cached);
+                e->done = true;
+                batch->remaining--;
+                freeProgramSources(&sources);
+                continue;
+            }
+        }
+
+        // Nothing in this loop may query a compile or link status, as that would wait for the driver.
+        e->program = startBuildProgram(&sources, e->shaders);
+        shaders[i].id = e->program;
+        freeProgramSources(&sources);
+    }
+
+    return batch;
+}
+
+static void finish_entry(ShaderBatch* batch, int i) {
+    BatchEntry* e = &batch->entries[i];
+
+    if (finishBuildProgram(e->program, e->shaders, e->key)) {
+        batch->shaders[i] = shader_from_program(e->program);
+    } else {
+        printf("Failed to build shader %s + %s\n",
+               e->vertexPath ? e->vertexPath : "-", e->fragmentPath ? e->fragmentPath : "-");
+        batch->shaders[i] = (Shader) {0};
+    }
+
+    e->done = true;
+    batch->remaining--;
+}
+
+bool shader_batch_poll(ShaderBatch* batch) {
+    for (int i = 0; i < batch->count && batch->remaining > 0; i++) {
+        if (!batch->entries[i].done && program_link_completed(batch->entries[i].program))
+            finish_entry(batch, i);
+    }
+    return batch->remaining == 0;
+}
+
+void shader_batch_wait(ShaderBatch* batch) {
+    // The status queries in finish_entry block, so this waits for each program in turn.
+    for (int i = 0; i < batch->count; i++) {
+        if (!batch->entries[i].done)
+            finish_entry(batch, i);
+    }
+}
+
+void shader_batch_free(ShaderBatch* batch) {
+    if (!batch) return;
+
+    // Programs still compiling are owned by nobody else yet.
+    for (int i = 0; i < batch->count; i++) {
+        BatchEntry* e = &batch->entries[i];
+        if (e->done) continue;
+        glDeleteShader(e->shaders[0]);
+        glDeleteShader(e->shaders[1]);
+        glDeleteProgram(e->program);
+        batch->shaders[i] = (Shader) {0};
+    }
+    free(batch->entries);
+    free(batch);
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "shader_cache.h"
+#include "utils.h"
+
+// Bump whenever the entry layout below changes, old entries are then simply missed.
+#define CACHE_FORMAT_TAG "COpenGLLib program binary v1"
+#define CACHE_MAGIC 0x42504743u // "CGPB"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t binaryFormat;
+    uint64_t key;
+    uint64_t checksum;
+    uint32_t length;
+    uint32_t reserved;
+} CacheHeader;
+
+static char* cache_directory = NULL;
+static uint64_t driver_hash = 0;
+static ShaderCacheStats stats = {0};
+
+bool shader_cache_init(const char* directory) {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) {
+        printf("Shader cache disabled: driver has no program binary formats\n");
+        return false;
+    }
+
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        printf("Shader cache disabled: could not create %s\n", directory);
+        return false;
+    }
+
+    free(cache_directory);
+    cache_directory = strdup(directory);
+
+    driver_hash = hash_string(CACHE_FORMAT_TAG, FNV1A_SEED);
+    driver_hash = hash_string((const char*) glGetString(GL_VENDOR), driver_hash);
+    driver_hash = hash_string((const char*) glGetString(GL_RENDERER), driver_hash);
+    driver_hash = hash_string((const char*) glGetString(GL_VERSION), driver_hash);
+    return true;
+}
+
+bool shader_cache_enabled() {
+    return cache_directory != NULL;
+}
+
+uint64_t shader_cache_key(const char** sources, int count) {
+    uint64_t key = driver_hash;
+    for (int i = 0; i < count; i++) {
+        // Hash the length too, so moving text between stages changes the key.
+        const uint64_t length = strlen(sources[i]);
+        key = hash_fnv1a(&length, sizeof(length), key);
+        key = hash_fnv1a(sources[i], length, key);
+    }
+    return key;
+}
+
+static void cache_entry_path(uint64_t key, char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx.bin", cache_directory, (unsigned long long) key);
+}
+
+GLuint shader_cache_load(uint64_t key) {
+    if (!cache_directory) return 0;
+
+    char path[1024];
+    cache_entry_path(key, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        stats.misses++;
+        return 0;
+    }
+
+    CacheHeader header;
+    void* binary = NULL;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != CACHE_MAGIC || header.key != key || header.length == 0)
+        goto reject;
+
+    binary = malloc(header.length);
+    if (!binary || fread(binary, 1, header.length, file) != header.length)
+        goto reject;
+
+    if (hash_fnv1a(binary, header.length, FNV1A_SEED) != header.checksum)
+        goto reject;
+
+    fclose(file);
+
+    const GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, binary, (GLsizei) header.length);
+    free(binary);
+
+    // Drivers refuse binaries from other driver builds, in which case we compile as usual.
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        stats.misses++;
+        stats.rejected++;
+        return 0;
+    }
+
+    stats.hits++;
+    return program;
+
+reject:
+    free(binary);
+    fclose(file);
+    stats.misses++;
+    stats.rejected++;
+    return 0;
+}
+
+void shader_cache_store(uint64_t key, GLuint program) {
+    if (!cache_directory) return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    void* binary = malloc(length);
+    if (!binary) return;
+
+    GLenum binaryFormat;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &binaryFormat, binary);
+    if (written <= 0) {
+        free(binary);
+        return;
+    }
+
+    const CacheHeader header = {
+        .magic = CACHE_MAGIC,
+        .binaryFormat = binaryFormat,
+        .key = key,
+        .checksum = hash_fnv1a(binary, written, FNV1A_SEED),
+        .length = (uint32_t) written,
+    };
+
+    // Write to a temporary file first, so a crash never leaves a truncated entry behind.
+    char path[1024], tmpPath[1040];
+    cache_entry_path(key, path, sizeof(path));
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    FILE* file = fopen(tmpPath, "wb");
+    if (file) {
+        const bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                        fwrite(binary, 1, written, file) == (size_t) written;
+        fclose(file);
+        if (ok && rename(tmpPath, path) == 0)
+            stats.stores++;
+        else
+            remove(tmpPath);
+    }
+
+    free(binary);
+}
+
+ShaderCacheStats shader_cache_stats() {
+    return stats;
+}
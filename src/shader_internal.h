@@ -0,0 +1,151 @@
+//
+// Created by marios on 2/16/26.
+//
+
+#ifndef SHADER_INTERNAL_H
+#define SHADER_INTERNAL_H
+#include <stdbool.h>
+#include <glad/glad.h>
+#include "shader.h"
+
+// From KHR_parallel_shader_compile, which the generated glad loader does not include.
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+bool checkCompileErrors(GLuint shader, GLenum type);
+bool checkLinkingErrors(GLuint program);
+
+/**
+ * Reads the file at the given path as is.
+ */
+char* readShaderFile(const char* path);
+
+typedef enum {
+    SHADER_TEXT_HEAP,     // read from disk into a malloc'd buffer
+    SHADER_TEXT_MAPPED,   // mmap'd from the override directory
+    SHADER_TEXT_EMBEDDED, // compiled into the binary, never freed
+} ShaderTextKind;
+
+typedef struct {
+    const char* data; // not necessarily null terminated
+    size_t size;
+    ShaderTextKind kind;
+} ShaderText;
+
+/**
+ * Looks a shader up by name or path: first in the override directory (mmap), then in the
+ * embedded table, and finally on disk relative to the working directory.
+ * @return The text, with data NULL if the shader was found nowhere.
+ */
+ShaderText shader_text_read(const char* path);
+
+void shader_text_release(ShaderText* text);
+
+/**
+ * The file that holds a shader on disk, for watching it. NULL if the shader only exists embedded.
+ */
+const char* shader_source_disk_path(const char* path, char* buffer, size_t size);
+
+/**
+ * A set of shader files, each named the way shader_text_read looks it up.
+ */
+typedef struct {
+    char** paths;
+    int count;
+} ShaderFileSet;
+
+/**
+ * @return false if the path was in the set already, or out of memory.
+ */
+bool shader_file_set_add(ShaderFileSet* set, const char* path);
+void shader_file_set_free(ShaderFileSet* set);
+
+/**
+ * Reads a shader and runs the preprocessing stage over it: '#include "file"' lines are replaced by
+ * the file, resolved relative to the including file and included once, and the given defines are injected
+ * right after the #version line.
+ * @param defines A list like "MAX_STEPS=300;NO_DISK", or NULL.
+ * @param files Receives the file and every file it includes, for hot reload to watch. May be NULL.
+ * @return The expanded source, or NULL if the file or one of its includes could not be read.
+ */
+char* loadShaderSource(const char* path, const char* defines, ShaderFileSet* files);
+
+/**
+ * The preprocessed sources of a program. A NULL path leaves its stage out, which makes the program separable.
+ */
+typedef struct {
+    char* sources[2];    // vertex, fragment
+    uint64_t key;        // binary cache key, 0 while the cache is disabled
+    ShaderFileSet files; // the stage files and all of their includes
+} ProgramSources;
+
+bool loadProgramSources(const char* vertexPath, const char* fragmentPath, const char* defines, ProgramSources* out);
+void freeProgramSources(ProgramSources* sources);
+
+/**
+ * Compiles the present stages and starts linking, without querying any status.
+ * @param shaders Receives the stage objects, 0 for absent stages.
+ */
+GLuint startBuildProgram(const ProgramSources* sources, GLuint shaders[2]);
+
+/**
+ * Checks the results of startBuildProgram, deletes the stage objects and stores the binary in the cache.
+ * Blocks if the driver has not finished yet.
+ * @return false if compiling or linking failed, the program is deleted then.
+ */
+bool finishBuildProgram(GLuint program, GLuint shaders[2], uint64_t key);
+
+/**
+ * create_shader_program with defines injected into both stages. Either path may be NULL for a separable program.
+ */
+GLuint createShaderProgramDefines(const char* vertexPath, const char* fragmentPath, const char* defines);
+
+/**
+ * Deletes the cached variants built from these files, so they are rebuilt from the new sources on next use.
+ */
+void shader_variants_invalidate(const char* vertexPath, const char* fragmentPath);
+
+/**
+ * Creates and compiles a shader without waiting for the result. The status can be checked later with checkCompileErrors.
+ */
+GLuint compileShader(GLenum type, const char* source);
+GLuint compileShaderSource(GLenum type, const char* source);
+
+/**
+ * Attaches the shaders and starts linking without waiting for the result.
+ * If one of them is 0 the program is built as a separable single stage program.
+ */
+GLuint startLinkProgram(GLuint vertexShader, GLuint fragmentShader);
+GLuint linkProgram(GLuint vertexShader, GLuint fragmentShader);
+
+/**
+ * Enables KHR_parallel_shader_compile on first use if the driver offers it.
+ * Has to be called with a current context.
+ */
+bool shader_parallel_compile_supported();
+
+/**
+ * Whether the driver finished compiling/linking the program. Without KHR_parallel_shader_compile
+ * this is always true, as any query blocks until the link is done. Callers that must not stall
+ * have to spread the work over frames themselves, like shader_reload_poll does.
+ */
+bool program_link_completed(GLuint program);
+
+/**
+ * Binds the FrameData block and builds the uniform table of a linked program.
+ */
+Shader shader_from_program(GLuint program);
+
+/**
+ * Enumerates the uniforms of a linked program. Program 0 gives an empty table, for a handle that
+ * has no program yet.
+ */
+UniformTable* uniform_table_build(GLuint program);
+void uniform_table_free(UniformTable* table);
+
+/**
+ * Moves the contents of src into dst and frees src, so every copy of a Shader sees the new table.
+ */
+void uniform_table_replace(UniformTable* dst, UniformTable* src);
+
+#endif //SHADER_INTERNAL_H
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include "shader_internal.h"
+
+#define MAX_INCLUDE_DEPTH 16
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} SourceBuffer;
+
+static bool buffer_append(SourceBuffer* buffer, const char* text, size_t length) {
+    if (buffer->length + length + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (buffer->length + length + 1 > capacity) capacity *= 2;
+        char* grown = realloc(buffer->data, capacity);
+        if (!grown) return false;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return true;
+}
+
+static bool buffer_appendf(SourceBuffer* buffer, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static bool buffer_appendf(SourceBuffer* buffer, const char* format, ...) {
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    return length >= 0 && buffer_append(buffer, line, (size_t) length < sizeof(line) ? (size_t) length : sizeof(line) - 1);
+}
+
+/**
+ * Turns "NAME=VALUE;OTHER" into "#define NAME VALUE\n#define OTHER\n".
+ */
+static void append_defines(SourceBuffer* buffer, const char* defines) {
+    while (defines && *defines) {
+        const char* end = strchr(defines, ';');
+        if (!end) end = defines + strlen(defines);
+
+        const char* equals = memchr(defines, '=', end - defines);
+        if (equals)
+            buffer_appendf(buffer, "#define %.*s %.*s\n", (int) (equals - defines), defines, (int) (end - equals - 1), equals + 1);
+        else if (end > defines)
+            buffer_appendf(buffer, "#define %.*s\n", (int) (end - defines), defines);
+
+        defines = *end ? end + 1 : end;
+    }
+}
+
+bool shader_file_set_add(ShaderFileSet* set, const char* path) {
+    for (int i = 0; i < set->count; i++)
+        if (strcmp(set->paths[i], path) == 0)
+            return false;
+
+    char* copy = strdup(path);
+    char** grown = copy ? realloc(set->paths, (set->count + 1) * sizeof(char*)) : NULL;
+    if (!grown) {
+        free(copy);
+        return false;
+    }
+    set->paths = grown;
+    set->paths[set->count++] = copy;
+    return true;
+}
+
+void shader_file_set_free(ShaderFileSet* set) {
+    for (int i = 0; i < set->count; i++)
+        free(set->paths[i]);
+    free(set->paths);
+    set->paths = NULL;
+    set->count = 0;
+}
+
+/**
+ * Resolves an include relative to the directory of the including file and collapses "dir/../"
+ * and "./" segments, so that every file has one spelling in the include set.
+ */
+static void resolve_include(const char* includer, const char* name, int nameLength, char* out, size_t size) {
+    char joined[1024];
+    const char* slash = strrchr(includer, '/');
+    if (slash)
+        snprintf(joined, sizeof(joined), "%.*s/%.*s", (int) (slash - includer), includer, nameLength, name);
+    else
+        snprintf(joined, sizeof(joined), "%.*s", nameLength, name);
+
+    const char* segments[64];
+    int lengths[64];
+    int count = 0;
+    for (const char* s = joined; *s;) {
+        const char* end = strchr(s, '/');
+        if (!end) end = s + strlen(s);
+        const int length = (int) (end - s);
+
+        if (length == 1 && s[0] == '.') {
+            // skip
+        } else if (length == 2 && s[0] == '.' && s[1] == '.' && count > 0 &&
+                   !(lengths[count - 1] == 2 && strncmp(segments[count - 1], "..", 2) == 0)) {
+            count--;
+        } else if (count < 64) {
+            segments[count] = s;
+            lengths[count++] = length;
+        }
+        s = *end ? end + 1 : end;
+    }
+
+    size_t used = 0;
+    out[0] = '\0';
+    for (int i = 0; i < count && used < size; i++)
+        used += snprintf(out + used, size - used, "%s%.*s", i > 0 ? "/" : "", lengths[i], segments[i]);
+}
+
+/**
+ * Parses '#include "file"' at the start of a line. Returns the length of the file name, 0 if the line is no include.
+ */
+static int parse_include(const char* line, const char* end, const char** name) {
+    while (line < end && (*line == ' ' || *line == '\t')) line++;
+    if (line >= end || *line != '#') return 0;
+    line++;
+    while (line < end && (*line == ' ' || *line == '\t')) line++;
+    if (end - line < 7 || strncmp(line, "include", 7) != 0) return 0;
+    line += 7;
+    while (line < end && (*line == ' ' || *line == '\t')) line++;
+    if (line >= end || *line != '"') return 0;
+
+    const char* close = memchr(line + 1, '"', end - line - 1);
+    if (!close) return 0;
+    *name = line + 1;
+    return (int) (close - line - 1);
+}
+
+static bool is_version_line(const char* line, const char* end) {
+    while (line < end && isspace((unsigned char) *line)) line++;
+    return end - line >= 8 && strncmp(line, "#version", 8) == 0;
+}
+
+static bool expand_file(SourceBuffer* out, const char* path, const char* defines, ShaderFileSet* included, int depth) {
+    if (depth > MAX_INCLUDE_DEPTH) {
+        printf("Shader include depth exceeded at %s\n", path);
+        return false;
+    }
+
+    ShaderText text = shader_text_read(path);
+    if (!text.data) return false;
+    const char* source = text.data;
+    const char* sourceEnd = text.data + text.size;
+
+    const bool root = depth == 0;
+    bool definesInjected = !root;
+    int lineNumber = 0;
+
+    for (const char* line = source; line < sourceEnd;) {
+        const char* end = memchr(line, '\n', sourceEnd - line);
+        const char* next = end ? end + 1 : sourceEnd;
+        if (!end) end = next;
+        lineNumber++;
+
+        const char* name;
+        const int nameLength = parse_include(line, end, &name);
+        if (nameLength > 0) {
+            char includePath[1024];
+            resolve_include(path, name, nameLength, includePath, sizeof(includePath));
+
+            // Every file is included once, as if it had an include guard.
+            if (shader_file_set_add(included, includePath)) {
+                buffer_appendf(out, "#line 1\n");
+                if (!expand_file(out, includePath, NULL, included, depth + 1)) {
+                    printf("Failed to include %s from %s:%d\n", includePath, path, lineNumber);
+                    shader_text_release(&text);
+                    return false;
+                }
+                if (out->length > 0 && out->data[out->length - 1] != '\n')
+                    buffer_append(out, "\n", 1);
+            }
+            buffer_appendf(out, "#line %d\n", lineNumber + 1);
+        } else {
+            buffer_append(out, line, next - line);
+            if (!definesInjected && is_version_line(line, end)) {
+                // The defines have to come after #version, which must stay the first statement.
+                if (end == sourceEnd) buffer_append(out, "\n", 1);
+                append_defines(out, defines);
+                buffer_appendf(out, "#line %d\n", lineNumber + 1);
+                definesInjected = true;
+            }
+        }
+
+        line = next;
+    }
+
+    shader_text_release(&text);
+
+    if (!definesInjected && defines && *defines) {
+        // No #version line, so the defines go in front of everything.
+        SourceBuffer prefixed = {0};
+        append_defines(&prefixed, defines);
+        buffer_appendf(&prefixed, "#line 1\n");
+        buffer_append(&prefixed, out->data, out->length);
+        free(out->data);
+        *out = prefixed;
+    }
+    return true;
+}
+
+char* loadShaderSource(const char* path, const char* defines, ShaderFileSet* files) {
+    SourceBuffer out = {0};
+    ShaderFileSet included = {0};
+    shader_file_set_add(&included, path);
+
+    const bool ok = expand_file(&out, path, defines, &included, 0);
+
+    // The set of this file alone decides what is included once, the caller may already hold other stages.
+    for (int i = 0; ok && files && i < included.count; i++)
+        shader_file_set_add(files, included.paths[i]);
+    shader_file_set_free(&included);
+
+    if (!ok) {
+        free(out.data);
+        return NULL;
+    }
+    return out.data;
+}
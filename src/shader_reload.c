@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shader.h"
+#include "shader_internal.h"
+#include "shader_cache.h"
+#include "gl_state.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+typedef struct {
+    char* diskPath;   // where the file lives on disk
+    const char* name; // file name part of diskPath, as reported by inotify
+    int wd;
+} WatchedFile;
+
+typedef struct {
+    UniformTable* table;  // identifies the shader, every copy of its handle shares it
+    char* paths[2];       // vertex, fragment
+    char* defines;
+    WatchedFile* files;   // the stage files and everything they include, embedded only files left out
+    int fileCount;
+    bool dirty;
+
+    // The recompile in flight, 0 when idle.
+    GLuint pending;
+    GLuint pendingShaders[2];
+    uint64_t pendingKey;
+    ShaderFileSet pendingFiles; // what the recompile read, watched once it succeeds
+    bool compiling;       // stages compiled but not linked yet, without KHR_parallel_shader_compile
+} ShaderWatch;
+
+static int inotify_fd = -1;
+static ShaderWatch* watches = NULL;
+static int watch_count = 0;
+static int watch_capacity = 0;
+
+static const char* path_name(const char* path) {
+    return path ? path : "-";
+}
+
+// Watches the directory rather than the file, since most editors save by renaming a new file over the old one.
+static int watch_directory_of(const char* path, const char** name) {
+    const char* slash = strrchr(path, '/');
+    *name = slash ? slash + 1 : path;
+
+    char dir[1024];
+    if (slash) {
+        snprintf(dir, sizeof(dir), "%.*s", (int) (slash - path), path);
+        if (dir[0] == '\0') strcpy(dir, "/");
+    } else {
+        strcpy(dir, ".");
+    }
+
+    const int wd = inotify_add_watch(inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0)
+        printf("Failed to watch %s: %s\n", dir, strerror(errno));
+    return wd;
+}
+
+static void unwatch_files(ShaderWatch* w) {
+    // Directory watches are shared between files, so they are left in place.
+    for (int i = 0; i < w->fileCount; i++)
+        free(w->files[i].diskPath);
+    free(w->files);
+    w->files = NULL;
+    w->fileCount = 0;
+}
+
+/**
+ * Replaces the files of a watch, e.g. with the includes of the sources that were just compiled.
+ */
+static void watch_files(ShaderWatch* w, const ShaderFileSet* set) {
+    unwatch_files(w);
+    w->files = calloc(set->count, sizeof(WatchedFile));
+    if (!w->files) return;
+
+    for (int i = 0; i < set->count; i++) {
+        // Embedded shaders are watched through the override directory, if there is one.
+        char buffer[1024];
+        const char* diskPath = shader_source_disk_path(set->paths[i], buffer, sizeof(buffer));
+        if (!diskPath) continue;
+
+        WatchedFile* file = &w->files[w->fileCount];
+        file->diskPath = strdup(diskPath);
+        if (!file->diskPath) continue;
+        file->wd = watch_directory_of(file->diskPath, &file->name);
+        w->fileCount++;
+    }
+}
+
+void shader_watch(Shader* shader, const char* vertexPath, const char* fragmentPath) {
+    shader_watch_defines(shader, vertexPath, fragmentPath, NULL);
+}
+
+void shader_watch_defines(Shader* shader, const char* vertexPath, const char* fragmentPath, const char* defines) {
+    if (inotify_fd < 0) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd < 0) {
+            printf("Shader hot reload disabled: %s\n", strerror(errno));
+            return;
+        }
+        // Query once up front so that the driver spawns its compiler threads before the first reload.
+        if (!shader_parallel_compile_supported())
+            printf("KHR_parallel_shader_compile is not supported, shader reloads block the frames they compile "
+                   "and link in\n");
+    }
+
+    // A handle whose program failed to build still needs a table for the reload to swap into.
+    if (!shader->uniforms)
+        shader->uniforms = uniform_table_build(0);
+    if (!shader->uniforms) return;
+
+    if (watch_count == watch_capacity) {
+        const int capacity = watch_capacity ? watch_capacity * 2 : 4;
+        ShaderWatch* grown = realloc(watches, capacity * sizeof(ShaderWatch));
+        if (!grown) return;
+        watches = grown;
+        watch_capacity = capacity;
+    }
+
+    ShaderWatch* w = &watches[watch_count++];
+    *w = (ShaderWatch) {.table = shader->uniforms};
+    w->paths[0] = vertexPath ? strdup(vertexPath) : NULL;
+    w->paths[1] = fragmentPath ? strdup(fragmentPath) : NULL;
+    w->defines = defines ? strdup(defines) : NULL;
+
+    // Preprocessing finds the includes. If that fails the stage files alone are watched until a fixed save.
+    ProgramSources sources;
+    if (loadProgramSources(w->paths[0], w->paths[1], w->defines, &sources)) {
+        watch_files(w, &sources.files);
+        freeProgramSources(&sources);
+    } else {
+        ShaderFileSet roots = {0};
+        for (int i = 0; i < 2; i++)
+            if (w->paths[i]) shader_file_set_add(&roots, w->paths[i]);
+        watch_files(w, &roots);
+        shader_file_set_free(&roots);
+    }
+}
+
+static void abandon_pending(ShaderWatch* w) {
+    if (!w->pending && !w->compiling) return;
+    glDeleteShader(w->pendingShaders[0]);
+    glDeleteShader(w->pendingShaders[1]);
+    glDeleteProgram(w->pending);
+    w->pendingShaders[0] = w->pendingShaders[1] = 0;
+    w->pending = 0;
+    w->compiling = false;
+    shader_file_set_free(&w->pendingFiles);
+}
+
+void shader_unwatch(Shader* shader) {
+    if (!shader->uniforms) return;
+    for (int i = 0; i < watch_count; i++) {
+        if (watches[i].table != shader->uniforms) continue;
+
+        abandon_pending(&watches[i]);
+        unwatch_files(&watches[i]);
+        free(watches[i].paths[0]);
+        free(watches[i].paths[1]);
+        free(watches[i].defines);
+        watches[i] = watches[--watch_count];
+        i--;
+    }
+}
+
+static void swap_program(ShaderWatch* w, const GLuint program) {
+    const GLuint previous = shader_program((Shader) {.uniforms = w->table});
+    Shader fresh = shader_from_program(program);
+    if (!fresh.uniforms) {
+        glDeleteProgram(program);
+        shader_file_set_free(&w->pendingFiles);
+        return;
+    }
+    uniform_table_replace(w->table, fresh.uniforms);
+
+    // The new sources may include other files than the old ones did.
+    watch_files(w, &w->pendingFiles);
+    shader_file_set_free(&w->pendingFiles);
+
+    gl_state_forget_program(previous);
+    glDeleteProgram(previous);
+    shader_variants_invalidate(w->paths[0], w->paths[1]);
+    printf("Reloaded shader %s + %s\n", path_name(w->paths[0]), path_name(w->paths[1]));
+}
+
+/**
+ * Starts compiling the current sources. Returns true if the program could be swapped right away from the binary cache.
+ */
+static bool start_recompile(ShaderWatch* w) {
+    ProgramSources sources;
+    if (!loadProgramSources(w->paths[0], w->paths[1], w->defines, &sources))
+        return false;
+    w->pendingKey = sources.key;
+    w->pendingFiles = sources.files;
+    sources.files = (ShaderFileSet) {0};
+
+    if (shader_cache_enabled()) {
+        const GLuint cached = shader_cache_load(sources.key);
+        if (cached) {
+            freeProgramSources(&sources);
+            swap_program(w, cached);
+            return true;
+        }
+    }
+
+    if (shader_parallel_compile_supported()) {
+        // No status queries here, so the driver compiles and links on its own threads.
+        w->pending = startBuildProgram(&sources, w->pendingShaders);
+    } else {
+        // Every status query blocks, so the stages are compiled now and linked by the next poll, which
+        // splits the stall over two frames.
+        w->pendingShaders[0] = sources.sources[0] ? compileShader(GL_VERTEX_SHADER, sources.sources[0]) : 0;
+        w->pendingShaders[1] = sources.sources[1] ? compileShader(GL_FRAGMENT_SHADER, sources.sources[1]) : 0;
+        w->compiling = true;
+    }
+    freeProgramSources(&sources);
+    return false;
+}
+
+/**
+ * Links the stages compiled by start_recompile without KHR_parallel_shader_compile. Leaves the link to be
+ * checked by the next poll.
+ */
+static void start_link(ShaderWatch* w) {
+    w->compiling = false;
+    bool ok = true;
+    if (w->pendingShaders[0]) ok &= checkCompileErrors(w->pendingShaders[0], GL_VERTEX_SHADER);
+    if (w->pendingShaders[1]) ok &= checkCompileErrors(w->pendingShaders[1], GL_FRAGMENT_SHADER);
+    if (!ok) {
+        printf("Reloading %s + %s failed, keeping the previous program\n", path_name(w->paths[0]), path_name(w->paths[1]));
+        abandon_pending(w);
+        return;
+    }
+    w->pending = startLinkProgram(w->pendingShaders[0], w->pendingShaders[1]);
+}
+
+static bool finish_recompile(ShaderWatch* w) {
+    const GLuint program = w->pending;
+    w->pending = 0;
+
+    if (!finishBuildProgram(program, w->pendingShaders, w->pendingKey)) {
+        printf("Reloading %s + %s failed, keeping the previous program\n", path_name(w->paths[0]), path_name(w->paths[1]));
+        shader_file_set_free(&w->pendingFiles);
+        return false;
+    }
+
+    swap_program(w, program);
+    return true;
+}
+
+static void read_events() {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length;) {
+            const struct inotify_event* event = (const struct inotify_event*) p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) continue;
+
+            // Included files are matched like the stage files, a shared include dirties every shader using it.
+            for (int i = 0; i < watch_count; i++) {
+                for (int j = 0; j < watches[i].fileCount && !watches[i].dirty; j++) {
+                    const WatchedFile* file = &watches[i].files[j];
+                    if (file->wd >= 0 && file->wd == event->wd && strcmp(file->name, event->name) == 0)
+                        watches[i].dirty = true;
+                }
+            }
+        }
+    }
+}
+
+bool shader_reload_poll() {
+    if (inotify_fd < 0) return false;
+
+    read_events();
+
+    bool swapped = false;
+    for (int i = 0; i < watch_count; i++) {
+        ShaderWatch* w = &watches[i];
+        if (w->dirty) {
+            // A newer save supersedes whatever is still compiling.
+            w->dirty = false;
+            abandon_pending(w);
+            swapped |= start_recompile(w);
+        } else if (w->compiling) {
+            start_link(w);
+        } else if (w->pending && program_link_completed(w->pending)) {
+            swapped |= finish_recompile(w);
+        }
+    }
+    return swapped;
+}
+
+#else
+
+void shader_watch(Shader* shader, const char* vertexPath, const char* fragmentPath) {
+    printf("Shader hot reload is only supported on Linux\n");
+}
+
+void shader_watch_defines(Shader* shader, const char* vertexPath, const char* fragmentPath, const char* defines) {
+    shader_watch(shader, vertexPath, fragmentPath);
+}
+
+void shader_unwatch(Shader* shader) {
+}
+
+bool shader_reload_poll() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shader.h"
+#include "shader_internal.h"
+
+static const EmbeddedFile* embedded = NULL;
+static size_t embedded_count = 0;
+static char* override_directory = NULL;
+
+void shader_embed_register(const EmbeddedFile* files, size_t count) {
+    embedded = files;
+    embedded_count = count;
+}
+
+void shader_source_override(const char* directory) {
+    free(override_directory);
+    override_directory = directory && *directory ? strdup(directory) : NULL;
+    if (override_directory)
+        printf("Loading shaders from %s instead of the embedded copies\n", override_directory);
+}
+
+static const EmbeddedFile* find_embedded(const char* name) {
+    for (size_t i = 0; i < embedded_count; i++)
+        if (strcmp(embedded[i].name, name) == 0)
+            return &embedded[i];
+    return NULL;
+}
+
+// Only names inside the shaders directory can be overridden, not arbitrary paths.
+static bool is_shader_name(const char* path) {
+    return path[0] != '/' && strncmp(path, "../", 3) != 0 && strncmp(path, "./", 2) != 0;
+}
+
+static ShaderText map_file(const char* path) {
+    ShaderText text = {0};
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return text;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            text = (ShaderText) {.data = data, .size = st.st_size, .kind = SHADER_TEXT_MAPPED};
+        }
+    }
+    close(fd);
+    return text;
+}
+
+ShaderText shader_text_read(const char* path) {
+    if (override_directory && is_shader_name(path)) {
+        char overridden[1024];
+        snprintf(overridden, sizeof(overridden), "%s/%s", override_directory, path);
+        const ShaderText text = map_file(overridden);
+        if (text.data) return text;
+    }
+
+    const EmbeddedFile* file = find_embedded(path);
+    if (file)
+        return (ShaderText) {.data = file->data, .size = file->size, .kind = SHADER_TEXT_EMBEDDED};
+
+    char* source = readShaderFile(path);
+    if (!source)
+        return (ShaderText) {0};
+    return (ShaderText) {.data = source, .size = strlen(source), .kind = SHADER_TEXT_HEAP};
+}
+
+void shader_text_release(ShaderText* text) {
+    switch (text->kind) {
+        case SHADER_TEXT_HEAP:
+            free((char*) text->data);
+            break;
+        case SHADER_TEXT_MAPPED:
+            munmap((void*) text->data, text->size);
+            break;
+        case SHADER_TEXT_EMBEDDED:
+            break;
+    }
+    text->data = NULL;
+    text->size = 0;
+}
+
+const char* shader_source_disk_path(const char* path, char* buffer, size_t size) {
+    if (override_directory && is_shader_name(path)) {
+        snprintf(buffer, size, "%s/%s", override_directory, path);
+        return buffer;
+    }
+    if (find_embedded(path))
+        return NULL;
+    return path;
+}
+
+Shader create_shader_embedded(const char* vertexName, const char* fragmentName) {
+    if (!override_directory && (!find_embedded(vertexName) || !find_embedded(fragmentName)))
+        printf("Shader %s + %s is not embedded, loading it from disk\n", vertexName, fragmentName);
+    return create_shader(vertexName, fragmentName);
+}
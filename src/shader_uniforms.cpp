@@ -0,0 +1,20 @@
+#include <type_traits>
+#include "shader.hpp"
+
+// Instantiates every handle, so that the header is compiled with the library.
+template class gl::Uniform<gl::Float>;
+template class gl::Uniform<gl::Int>;
+template class gl::Uniform<gl::Vec2>;
+template class gl::Uniform<gl::Vec3>;
+template class gl::Uniform<gl::Mat4>;
+template class gl::Uniform<gl::Sampler2D>;
+template class gl::Uniform<gl::SamplerCube>;
+template class gl::Uniform<gl::Sampler2DArray>;
+
+// Vectors and matrices take arrays of their exact size, never a plain pointer.
+static_assert(std::is_invocable_v<decltype(&gl::Uniform<gl::Vec3>::set), const gl::Uniform<gl::Vec3>&, vec3&>);
+static_assert(!std::is_invocable_v<decltype(&gl::Uniform<gl::Vec3>::set), const gl::Uniform<gl::Vec3>&, const float*>);
+static_assert(!std::is_invocable_v<decltype(&gl::Uniform<gl::Vec3>::set), const gl::Uniform<gl::Vec3>&, vec2&>);
+static_assert(!std::is_invocable_v<decltype(&gl::Uniform<gl::Vec2>::set), const gl::Uniform<gl::Vec2>&, vec3&>);
+static_assert(std::is_invocable_v<decltype(&gl::Uniform<gl::Mat4>::set), const gl::Uniform<gl::Mat4>&, mat4&>);
+static_assert(!std::is_invocable_v<decltype(&gl::Uniform<gl::Mat4>::set), const gl::Uniform<gl::Mat4>&, const vec4*>);
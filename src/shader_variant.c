@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include "shader.h"
+#include "shader_internal.h"
+#include "utils.h"
+
+typedef struct {
+    uint64_t key;
+    char* vertexPath;
+    char* fragmentPath;
+    char* defines;
+    Shader shader;
+} Variant;
+
+static Variant* variants = NULL;
+static int variant_count = 0;
+static int variant_capacity = 0;
+
+// NULL (an absent stage, or no defines) compares and hashes like "".
+static const char* or_empty(const char* s) {
+    return s ? s : "";
+}
+
+static uint64_t variant_key(const char* vertexPath, const char* fragmentPath, const char* defines) {
+    // The separators keep ("ab", "c") and ("a", "bc") apart.
+    uint64_t key = hash_string(or_empty(vertexPath), FNV1A_SEED);
+    key = hash_fnv1a("\n", 1, key);
+    key = hash_string(or_empty(fragmentPath), key);
+    key = hash_fnv1a("\n", 1, key);
+    return hash_string(or_empty(defines), key);
+}
+
+static bool same_string(const char* a, const char* b) {
+    return strcmp(or_empty(a), or_empty(b)) == 0;
+}
+
+static char* copy_string(const char* s) {
+    return s ? strdup(s) : NULL;
+}
+
+Shader shader_variant(const char* vertexPath, const char* fragmentPath, const char* defines) {
+    const uint64_t key = variant_key(vertexPath, fragmentPath, defines);
+    for (int i = 0; i < variant_count; i++) {
+        const Variant* v = &variants[i];
+        if (v->key == key && same_string(v->vertexPath, vertexPath) &&
+            same_string(v->fragmentPath, fragmentPath) && same_string(v->defines, defines))
+            return v->shader;
+    }
+
+    if (variant_count == variant_capacity) {
+        const int capacity = variant_capacity ? variant_capacity * 2 : 8;
+        Variant* grown = realloc(variants, capacity * sizeof(Variant));
+        if (!grown) return (Shader) {0};
+        variants = grown;
+        variant_capacity = capacity;
+    }
+
+    Variant* v = &variants[variant_count++];
+    v->key = key;
+    v->vertexPath = copy_string(vertexPath);
+    v->fragmentPath = copy_string(fragmentPath);
+    v->defines = copy_string(defines);
+    v->shader = shader_from_program(createShaderProgramDefines(vertexPath, fragmentPath, defines));
+    return v->shader;
+}
+
+static void variant_free(Variant* v) {
+    shader_delete(&v->shader);
+    free(v->vertexPath);
+    free(v->fragmentPath);
+    free(v->defines);
+}
+
+void shader_variants_invalidate(const char* vertexPath, const char* fragmentPath) {
+    for (int i = 0; i < variant_count; i++) {
+        if (!same_string(variants[i].vertexPath, vertexPath) || !same_string(variants[i].fragmentPath, fragmentPath))
+            continue;
+        variant_free(&variants[i]);
+        variants[i--] = variants[--variant_count];
+    }
+}
+
+void shader_variants_clear() {
+    for (int i = 0; i < variant_count; i++)
+        variant_free(&variants[i]);
+    free(variants);
+    variants = NULL;
+    variant_count = variant_capacity = 0;
+}
@@ -1,13 +1,17 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <cglm/cglm.h>
 
 #include "mesh.h"
 #include "shader.h"
-#include "texture_helper.h"
+#include "texture_cache.h"
 #include "camera.h"
+#include "gl_state.h"
+#include "shader_cache.h"
+#include "upload_queue.h"
 
 #define INITIAL_WIDTH 800
 #define INITIAL_HEIGHT 600
@@ -22,6 +26,8 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 
 void focus_callback(GLFWwindow *window, int focused);
 
+void report_first_frame(double startup_time);
+
 unsigned int WIN_WIDTH = INITIAL_WIDTH;
 unsigned int WIN_HEIGHT = INITIAL_HEIGHT;
 float ASPECT_RATIO = (float) INITIAL_WIDTH / (float) INITIAL_HEIGHT;
@@ -40,6 +46,13 @@ int main() {
         printf("Failed to initialize GLFW\n");
         return -1;
     }
+    const double startup_time = glfwGetTime();
+    bool first_frame = true;
+
+    // DSA and glProgramUniform need 4.5, the shaders are written against 4.6.
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -71,7 +84,16 @@ int main() {
     printf("OpenGL Version: %s\n", glGetString(GL_VERSION));
 
 
-    Shader shader = create_shader("../shaders/vertex_shader.vert", "../shaders/fragment_shader.frag");
+    // Shaders are compiled into the binary, COPENGL_SHADER_DIR points at the source tree to edit them live.
+    shader_embed_register(EMBEDDED_SHADERS, EMBEDDED_SHADER_COUNT);
+    shader_source_override(getenv("COPENGL_SHADER_DIR"));
+    shader_cache_init("shader_cache");
+
+    // The cubes are drawn in one instanced call, the shader reads their matrices from the instance buffer.
+    Shader shader = shader_variant("vertex_shader.vert", "fragment_shader.frag", "INSTANCED");
+
+    // Spread texture and mesh uploads over the first frames instead of stalling startup.
+    upload_queue_set_deferred(true);
 
     Mesh mesh = shape_cube();
 
@@ -88,17 +110,22 @@ int main() {
         model_init(-1.3f, 1.0f, -1.5f)
     };
 
-    GLuint tex1 = gen_texture("../resources/container.jpg");
+    const TextureStreamDesc tex_desc = {.mipmaps = true, .placeholder = {0.5f, 0.5f, 0.5f, 1.0f}};
+    GLuint tex1 = texture_cache_acquire("../resources/container.jpg", &tex_desc);
 
     shader_use(shader);
     shader_u1i(shader, "uTexture", 0);
 
+    frame_data_init();
+    FrameData frame = {0};
+
     camera = camera_init(0.0f, 0.0f, 3.0f);
     //camera_cursor_lock(&camera, window);
 
     Model cube0 = model_init(0, 0, 0);
+    Model cubes[10];
 
-    glEnable(GL_DEPTH_TEST);
+    gl_state_enable(GL_DEPTH_TEST);
 
     while (!glfwWindowShouldClose(window)) {
         float current_frame = glfwGetTime();
@@ -107,38 +134,59 @@ int main() {
 
         key_input(window);
 
+        texture_stream_poll();
+        upload_queue_drain();
+
         //glClearColor(0.2f, 0.3f, 0.3f, 0.0f);
         glClearColor(26.0f/255.0f, 26.0f/255.0f, 30.0f/255.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, tex1);
-
-        shader_use(shader);
-        camera_to_shader(camera, shader, ASPECT_RATIO);
+        gl_state_bind_texture_unit(0, GL_TEXTURE_2D, tex1);
 
-        mesh_bind(mesh);
+        camera_frame_data(camera, ASPECT_RATIO, &frame);
+        frame.time = current_frame;
+        frame.resolution[0] = (float) WIN_WIDTH;
+        frame.resolution[1] = (float) WIN_HEIGHT;
+        frame_data_update(&frame);
 
+        shader_use(shader);
 
         model_rotate_deg(&cube0, (float) glfwGetTime() * 50.0f, 0.5f, 1.0f, 0.2f);
-        model_to_shader(cube0, shader);
-
-        //glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        cubes[0] = cube0;
 
         for (int i = 0; i < 9; i++) {
             Model c = cubePositions[i];
             model_rotate_deg(&c, 20.0f * i * glfwGetTime(), 1.0f, 0.3f, 0.5f);
-            model_to_shader(c, shader);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            cubes[i + 1] = c;
         }
 
+        mesh_draw_instanced(mesh, cubes, 10);
+
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (first_frame) {
+            report_first_frame(startup_time);
+            first_frame = false;
+        }
     }
 
+    texture_cache_release(tex1);
+    texture_stream_shutdown();
+    const UploadQueueStats upload_stats = upload_queue_stats();
+    printf("Upload queue: %lu uploads, %.2f ms average latency, %.2f ms max, %lu stalls\n",
+           (unsigned long) upload_stats.completed, upload_stats.averageLatencyMs, upload_stats.maxLatencyMs,
+           (unsigned long) upload_stats.stalls);
+    upload_queue_shutdown();
     mesh_destroy(&mesh);
-    shader_delete(&shader);
+    mesh_instance_data_delete();
+    shader_variants_clear();
+    frame_data_delete();
+
+    const GLStateStats gl_stats = gl_state_stats();
+    printf("GL state calls: %lu issued, %lu skipped as redundant\n", gl_stats.issued, gl_stats.skipped);
+    const TextureCacheStats tex_stats = texture_cache_stats();
+    printf("Texture cache: %u hits, %u misses\n", tex_stats.hits, tex_stats.misses);
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -210,3 +258,10 @@ void focus_callback(GLFWwindow *window, int focused) {
         first_mouse = true;
     }
 }
+
+void report_first_frame(double startup_time) {
+    const ShaderCacheStats stats = shader_cache_stats();
+    printf("Time to first frame: %.1f ms (%s start, shader cache: %u hits, %u misses, %u rejected)\n",
+           (glfwGetTime() - startup_time) * 1e3, stats.misses == 0 && stats.hits > 0 ? "warm" : "cold",
+           stats.hits, stats.misses, stats.rejected);
+}
@@ -0,0 +1,207 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stb/stb_image.h"
+#include "bc_encode.h"
+#include "ktx2.h"
+#include "mip_builder.h"
+#include "texture_container.h"
+
+/*
+ * Offline block compressor: TextureCompressor [options] <input> <output.ktx2>
+ * An output ending in .gtex is written as a pre-decoded container instead, see texture_container.h. Those keep the
+ * channels of the input, or float RGB for .hdr input, and take only -srgb, -mips and -filter.
+ *   -f bc1|bc3|bc7|bc6h   block format, defaults to bc7, or bc6h for .hdr input
+ *   -q fast|high          encoder preset, defaults to high
+ *   -srgb                 the input is sRGB encoded, mips are averaged in linear light
+ *   -mips                 store the full mip chain
+ *   -filter box|kaiser    mip filter, defaults to kaiser
+ */
+
+typedef struct {
+    BcFormat format;
+    bool formatSet;
+    BcQuality quality;
+    bool srgb;
+    bool mips;
+    MipFilter filter;
+    const char* input;
+    const char* output;
+} Options;
+
+static void usage(void) {
+    printf("Usage: TextureCompressor [-f bc1|bc3|bc7|bc6h] [-q fast|high] [-srgb] [-mips] [-filter box|kaiser] <input> <output.ktx2|output.gtex>\n");
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    *options = (Options) {BC_FORMAT_BC7, false, BC_QUALITY_HIGH, false, false, MIP_FILTER_KAISER, NULL, NULL};
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "-f") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "bc1") == 0) options->format = BC_FORMAT_BC1;
+            else if (strcmp(name, "bc3") == 0) options->format = BC_FORMAT_BC3;
+            else if (strcmp(name, "bc7") == 0) options->format = BC_FORMAT_BC7;
+            else if (strcmp(name, "bc6h") == 0) options->format = BC_FORMAT_BC6H;
+            else return false;
+            options->formatSet = true;
+        } else if (strcmp(arg, "-q") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "fast") == 0) options->quality = BC_QUALITY_FAST;
+            else if (strcmp(name, "high") == 0) options->quality = BC_QUALITY_HIGH;
+            else return false;
+        } else if (strcmp(arg, "-srgb") == 0) {
+            options->srgb = true;
+        } else if (strcmp(arg, "-mips") == 0) {
+            options->mips = true;
+        } else if (strcmp(arg, "-filter") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "box") == 0) options->filter = MIP_FILTER_BOX;
+            else if (strcmp(name, "kaiser") == 0) options->filter = MIP_FILTER_KAISER;
+            else return false;
+        } else if (arg[0] == '-') {
+            return false;
+        } else if (!options->input) {
+            options->input = arg;
+        } else if (!options->output) {
+            options->output = arg;
+        } else {
+            return false;
+        }
+    }
+    return options->input && options->output;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static bool ends_with(const char* str, const char* suffix) {
+    const size_t length = strlen(str), suffixLength = strlen(suffix);
+    return length >= suffixLength && strcmp(str + length - suffixLength, suffix) == 0;
+}
+
+/*
+ * Decodes the input once so the app never has to. Written next to the input as "<input>.gtex" with the defaults
+ * the file also works as the container texture_helper would have written on first use.
+ */
+static int write_container(const Options* options) {
+    const bool hdr = stbi_is_hdr(options->input);
+    int width, height, channels;
+    void* image = hdr ? (void*) stbi_loadf(options->input, &width, &height, &channels, 3)
+                      : (void*) stbi_load(options->input, &width, &height, &channels, 0);
+    if (!image) {
+        printf("Failed to load %s: %s\n", options->input, stbi_failure_reason());
+        return 1;
+    }
+    if (hdr) channels = 3;
+
+    static const GLenum FORMATS[] = {0, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    static const GLenum SRGB_FORMATS[] = {0, GL_RED, GL_RG, GL_SRGB8, GL_SRGB8_ALPHA8};
+    const GLenum format = FORMATS[channels];
+    const GLenum internalFormat = hdr ? GL_RGB32F : options->srgb ? SRGB_FORMATS[channels] : format;
+    const MipDesc desc = {channels, hdr, options->srgb && !hdr && channels >= 3, options->filter};
+    // Keyed like texture_helper keys its own containers.
+    const MipDesc keyDesc = hdr ? (MipDesc) {3, true, false, options->filter}
+                                : (MipDesc) {0, false, true, options->filter};
+
+    MipChain chain = {1, {width}, {height}, {0}, {image}, NULL};
+    const double start = now();
+    bool ok = !options->mips || mip_build(&desc, image, width, height, &chain);
+    const double mipTime = now() - start;
+    ok = ok && texture_container_write(options->output, texture_container_key(options->input, &keyDesc, options->mips),
+                                       internalFormat, format, hdr ? GL_FLOAT : GL_UNSIGNED_BYTE, channels,
+                                       mip_texel_size(&desc), &chain);
+    if (ok) {
+        printf("%s: %dx%d, %d channels %s, %d levels", options->output, width, height, channels,
+               hdr ? "float" : "8 bit", chain.levelCount);
+        if (options->mips) printf(", mips filtered in %.1f ms", mipTime * 1e3);
+        printf("\n");
+    } else {
+        printf("Failed to write %s\n", options->output);
+    }
+    mip_chain_free(&chain);
+    stbi_image_free(image);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 1;
+    }
+    if (ends_with(options.output, TEXTURE_CONTAINER_EXTENSION)) return write_container(&options);
+
+    const bool hdrInput = stbi_is_hdr(options.input);
+    if (!options.formatSet && hdrInput) options.format = BC_FORMAT_BC6H;
+    const bool hdr = bc_format_is_hdr(options.format);
+    if (hdr && options.srgb) {
+        printf("BC6H stores linear values, ignoring -srgb\n");
+        options.srgb = false;
+    }
+
+    int width, height, channels;
+    void* image = hdr ? (void*) stbi_loadf(options.input, &width, &height, &channels, 3)
+                      : (void*) stbi_load(options.input, &width, &height, &channels, 4);
+    if (!image) {
+        printf("Failed to load %s: %s\n", options.input, stbi_failure_reason());
+        return 1;
+    }
+
+    MipChain chain = {1, {width}, {height}, {0}, {image}, NULL};
+    double mipTime = 0.0;
+    bool ok = true;
+    if (options.mips) {
+        const MipDesc desc = {hdr ? 3 : 4, hdr, options.srgb, options.filter};
+        const double start = now();
+        ok = mip_build(&desc, image, width, height, &chain);
+        mipTime = now() - start;
+    }
+    const int levelCount = chain.levelCount < KTX2_MAX_LEVELS ? chain.levelCount : KTX2_MAX_LEVELS;
+
+    void* levels[KTX2_MAX_LEVELS] = {0};
+    size_t total = 0;
+    double encodeTime = 0.0;
+
+    for (int level = 0; level < levelCount && ok; level++) {
+        const size_t size = bc_image_size(options.format, chain.widths[level], chain.heights[level]);
+        levels[level] = malloc(size);
+        if (!levels[level]) {
+            ok = false;
+            break;
+        }
+        const double start = now();
+        bc_encode_image(options.format, options.quality, chain.levels[level], chain.widths[level],
+                        chain.heights[level], levels[level]);
+        encodeTime += now() - start;
+        total += size;
+    }
+    mip_chain_free(&chain);
+    stbi_image_free(image);
+
+    if (ok) {
+        ok = ktx2_write(options.output, options.format, options.srgb, width, height, levelCount,
+                        (const void* const*) levels);
+    } else {
+        printf("Out of memory\n");
+    }
+    if (ok) {
+        const double uncompressed = (double) width * height * (hdr ? 8 : 4) * (levelCount > 1 ? 4.0 / 3.0 : 1.0);
+        printf("%s: %dx%d, %d levels, %s %s, encoded in %.1f ms", options.output, width, height, levelCount,
+               bc_format_name(options.format), options.quality == BC_QUALITY_HIGH ? "high" : "fast",
+               encodeTime * 1e3);
+        if (options.mips) printf(", mips filtered in %.1f ms", mipTime * 1e3);
+        printf("\n");
+        printf("  %.2f MB, %.1fx smaller than %s\n", total / (1024.0 * 1024.0), uncompressed / (double) total,
+               hdr ? "RGBA16F" : "RGBA8");
+    }
+
+    for (int level = 0; level < levelCount; level++) free(levels[level]);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,368 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "texture_atlas.h"
+#include "gl_state.h"
+#include "mip_builder.h"
+#include "thread_pool.h"
+#include "stb/stb_image.h"
+
+#define DEFAULT_MAX_SIZE 4096
+#define DEFAULT_LEVELS 4
+#define DEFAULT_PADDING 1
+
+typedef struct {
+    int x;
+    int y;
+    int width;
+} SkylineNode;
+
+/**
+ * The top edge of everything packed into a page so far, as horizontal segments from left to right.
+ * Space below the skyline is never reused, which keeps inserts cheap and works well for images sorted by height.
+ */
+typedef struct {
+    SkylineNode* nodes;
+    int count;
+    int width;
+    int height;
+} Skyline;
+
+typedef struct {
+    int index;      // of the image
+    int width;      // of the cell: the image rounded up to the alignment, plus the gutter on both sides
+    int height;
+    int layer;
+    int x;
+    int y;
+} Cell;
+
+static bool skyline_init(Skyline* skyline, int width, int height) {
+    // A node is at least one texel wide, so there are never more nodes than texels.
+    skyline->nodes = malloc((size_t) (width + 1) * sizeof(SkylineNode));
+    if (!skyline->nodes) return false;
+    skyline->nodes[0] = (SkylineNode) {0, 0, width};
+    skyline->count = 1;
+    skyline->width = width;
+    skyline->height = height;
+    return true;
+}
+
+// The lowest y a width x height rectangle can sit at with its left edge on node i, -1 if it does not fit there.
+static int skyline_fit(const Skyline* skyline, int i, int width, int height) {
+    if (skyline->nodes[i].x + width > skyline->width) return -1;
+    int y = 0;
+    for (int remaining = width; remaining > 0; i++) {
+        if (skyline->nodes[i].y > y) y = skyline->nodes[i].y;
+        if (y + height > skyline->height) return -1;
+        remaining -= skyline->nodes[i].width;
+    }
+    return y;
+}
+
+/**
+ * Places a rectangle bottom-left: where its top ends up lowest, on the narrowest node if that ties.
+ * @return false if it does not fit anywhere.
+ */
+static bool skyline_insert(Skyline* skyline, int width, int height, int* x, int* y) {
+    int best = -1, bestTop = INT_MAX, bestWidth = INT_MAX;
+    for (int i = 0; i < skyline->count; i++) {
+        const int fit = skyline_fit(skyline, i, width, height);
+        if (fit < 0) continue;
+        if (fit + height < bestTop || (fit + height == bestTop && skyline->nodes[i].width < bestWidth)) {
+            best = i;
+            bestTop = fit + height;
+            bestWidth = skyline->nodes[i].width;
+        }
+    }
+    if (best < 0) return false;
+    *x = skyline->nodes[best].x;
+    *y = bestTop - height;
+
+    SkylineNode* nodes = skyline->nodes;
+    memmove(nodes + best + 1, nodes + best, (size_t) (skyline->count - best) * sizeof(SkylineNode));
+    nodes[best] = (SkylineNode) {*x, bestTop, width};
+    skyline->count++;
+
+    // Cut the nodes the rectangle now covers.
+    for (int i = best + 1; i < skyline->count;) {
+        const int covered = nodes[best].x + nodes[best].width - nodes[i].x;
+        if (covered <= 0) break;
+        nodes[i].x += covered;
+        nodes[i].width -= covered;
+        if (nodes[i].width > 0) break;
+        memmove(nodes + i, nodes + i + 1, (size_t) (skyline->count - i - 1) * sizeof(SkylineNode));
+        skyline->count--;
+    }
+    // Merge neighbours of equal height.
+    for (int i = 0; i + 1 < skyline->count;) {
+        if (nodes[i].y != nodes[i + 1].y) {
+            i++;
+            continue;
+        }
+        nodes[i].width += nodes[i + 1].width;
+        memmove(nodes + i + 1, nodes + i + 2, (size_t) (skyline->count - i - 2) * sizeof(SkylineNode));
+        skyline->count--;
+    }
+    return true;
+}
+
+// Tallest first, then widest, which leaves the fewest holes under a skyline.
+static int by_size(const void* a, const void* b) {
+    const Cell* x = a;
+    const Cell* y = b;
+    if (x->height != y->height) return y->height - x->height;
+    if (x->width != y->width) return y->width - x->width;
+    return x->index - y->index;
+}
+
+/**
+ * Places every cell into pages of width x height texels, opening new pages only when layered.
+ * @return The number of pages used, 0 if the cells did not fit or out of memory.
+ */
+static int place_cells(Cell* cells, int count, int width, int height, bool layered) {
+    Skyline* pages = NULL;
+    int pageCount = 0;
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++) {
+        Cell* cell = &cells[i];
+        int layer = 0;
+        while (layer < pageCount && !skyline_insert(&pages[layer], cell->width, cell->height, &cell->x, &cell->y))
+            layer++;
+        if (layer == pageCount) {
+            if (pageCount > 0 && !layered) {
+                ok = false;
+                break;
+            }
+            Skyline* grown = realloc(pages, (size_t) (pageCount + 1) * sizeof(Skyline));
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            pages = grown;
+            if (!skyline_init(&pages[pageCount], width, height)) {
+                ok = false;
+                break;
+            }
+            pageCount++;
+            // Every cell fits an empty page, the caller sized it after the largest one.
+            ok = skyline_insert(&pages[layer], cell->width, cell->height, &cell->x, &cell->y);
+        }
+        cell->layer = layer;
+    }
+    for (int i = 0; i < pageCount; i++)
+        free(pages[i].nodes);
+    free(pages);
+    return ok ? pageCount : 0;
+}
+
+static int next_power_of_two(int value) {
+    int power = 1;
+    while (power < value) power *= 2;
+    return power;
+}
+
+/**
+ * Copies an image into its cell, repeating its edge texels over the gutter and the alignment padding.
+ */
+static void blit_extruded(unsigned char* page, int pageWidth, const AtlasImage* image, const Cell* cell, int border) {
+    const size_t texel = 4;
+    for (int y = 0; y < cell->height; y++) {
+        int sy = y - border;
+        sy = sy < 0 ? 0 : sy >= image->height ? image->height - 1 : sy;
+        const unsigned char* src = image->pixels + (size_t) sy * image->width * texel;
+        unsigned char* dst = page + ((size_t) (cell->y + y) * pageWidth + cell->x) * texel;
+        for (int x = 0; x < border; x++)
+            memcpy(dst + x * texel, src, texel);
+        memcpy(dst + border * texel, src, image->width * texel);
+        for (int x = border + image->width; x < cell->width; x++)
+            memcpy(dst + x * texel, src + (image->width - 1) * texel, texel);
+    }
+}
+
+/**
+ * Composes one page, filters its chain and uploads the first levelCount levels into the bound texture.
+ */
+static bool upload_page(const TextureAtlas* atlas, const AtlasImage* images, const Cell* cells, int count, int layer,
+                        int border) {
+    unsigned char* page = calloc((size_t) atlas->width * atlas->height, 4);
+    if (!page) return false;
+    for (int i = 0; i < count; i++) {
+        if (cells[i].layer == layer) blit_extruded(page, atlas->width, &images[cells[i].index], &cells[i], border);
+    }
+
+    // Box filtered, a wider kernel would reach past the gutter into the neighbours.
+    const MipDesc desc = {4, false, true, MIP_FILTER_BOX};
+    MipChain chain;
+    if (!mip_build_levels(&desc, page, atlas->width, atlas->height, atlas->levelCount, &chain)) {
+        free(page);
+        return false;
+    }
+    for (int level = 0; level < atlas->levelCount; level++) {
+        if (atlas->target == GL_TEXTURE_2D_ARRAY) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, chain.widths[level], chain.heights[level], 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, chain.levels[level]);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, chain.widths[level], chain.heights[level], 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, chain.levels[level]);
+        }
+    }
+    mip_chain_free(&chain);
+    free(page);
+    return true;
+}
+
+bool texture_atlas_pack(const AtlasImage* images, int count, const AtlasDesc* desc, TextureAtlas* atlas) {
+    memset(atlas, 0, sizeof(*atlas));
+    AtlasDesc resolved = desc ? *desc : (AtlasDesc) {0};
+    if (resolved.maxSize <= 0) resolved.maxSize = DEFAULT_MAX_SIZE;
+    if (resolved.levels <= 0) resolved.levels = DEFAULT_LEVELS;
+    if (resolved.levels > MIP_MAX_LEVELS) resolved.levels = MIP_MAX_LEVELS;
+    if (resolved.padding <= 0) resolved.padding = DEFAULT_PADDING;
+    if (count <= 0) return false;
+
+    // Cells start on multiples of the footprint of a texel of the last level, so each level of an image is made of
+    // its own texels only.
+    const int alignment = 1 << (resolved.levels - 1);
+    const int border = resolved.padding << (resolved.levels - 1);
+    Cell* cells = malloc((size_t) count * sizeof(Cell));
+    if (!cells) return false;
+    int largest = 0;
+    double area = 0.0, imageArea = 0.0;
+    for (int i = 0; i < count; i++) {
+        const int width = (images[i].width + alignment - 1) / alignment * alignment + 2 * border;
+        const int height = (images[i].height + alignment - 1) / alignment * alignment + 2 * border;
+        cells[i] = (Cell) {i, width, height, 0, 0, 0};
+        if (width > largest) largest = width;
+        if (height > largest) largest = height;
+        area += (double) width * height;
+        imageArea += (double) images[i].width * images[i].height;
+    }
+    if (largest > resolved.maxSize) {
+        printf("Atlas image of %d texels with its gutter does not fit in %d\n", largest, resolved.maxSize);
+        free(cells);
+        return false;
+    }
+    qsort(cells, count, sizeof(Cell), by_size);
+
+    // Pages of arrays are only as large as the largest image needs. Atlases start at the smallest power of two
+    // rectangle with room for every cell and grow one side at a time until they fit, never more than twice as wide
+    // as high.
+    const bool layered = resolved.target == ATLAS_TEXTURE_ARRAY;
+    int width = next_power_of_two(largest), height = width;
+    while (!layered && (double) width * height < area) {
+        if (width == height) width *= 2;
+        else height *= 2;
+    }
+    int layers = 0;
+    while (width <= resolved.maxSize && height <= resolved.maxSize &&
+           (layers = place_cells(cells, count, width, height, layered)) == 0) {
+        if (width == height) width *= 2;
+        else height *= 2;
+    }
+    if (layers == 0) {
+        printf("Atlas of %d images does not fit in %dx%d\n", count, resolved.maxSize, resolved.maxSize);
+        free(cells);
+        return false;
+    }
+
+    atlas->target = layered ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    atlas->width = width;
+    atlas->height = height;
+    atlas->layers = layers;
+    const int fullChain = mip_level_count(width, height);
+    atlas->levelCount = resolved.levels < fullChain ? resolved.levels : fullChain;
+    atlas->occupancy = imageArea / ((double) width * height * layers);
+    atlas->regionCount = count;
+    atlas->regions = calloc(count, sizeof(AtlasRegion));
+    if (!atlas->regions) {
+        free(cells);
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        const Cell* cell = &cells[i];
+        AtlasRegion* region = &atlas->regions[cell->index];
+        region->layer = cell->layer;
+        region->x = cell->x + border;
+        region->y = cell->y + border;
+        region->width = images[cell->index].width;
+        region->height = images[cell->index].height;
+        region->uvScale[0] = (float) region->width / (float) width;
+        region->uvScale[1] = (float) region->height / (float) height;
+        region->uvOffset[0] = (float) region->x / (float) width;
+        region->uvOffset[1] = (float) region->y / (float) height;
+    }
+
+    glGenTextures(1, &atlas->texture);
+    gl_state_bind_texture(atlas->target, atlas->texture);
+    // Sampling past an image lands in its own gutter, never in the next page over.
+    glTexParameteri(atlas->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(atlas->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(atlas->target, GL_TEXTURE_MIN_FILTER,
+                    atlas->levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(atlas->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(atlas->target, GL_TEXTURE_MAX_LEVEL, atlas->levelCount - 1);
+    if (layered) {
+        for (int level = 0; level < atlas->levelCount; level++) {
+            const int levelWidth = width >> level > 0 ? width >> level : 1;
+            const int levelHeight = height >> level > 0 ? height >> level : 1;
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth, levelHeight, layers, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+
+    bool ok = true;
+    for (int layer = 0; layer < layers && ok; layer++)
+        ok = upload_page(atlas, images, cells, count, layer, border);
+    free(cells);
+    if (!ok) {
+        printf("Out of memory building a %dx%d atlas page\n", width, height);
+        texture_atlas_free(atlas);
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    const char* const* paths;
+    AtlasImage* images;
+} DecodeJob;
+
+static void decode_image(void* ctx, int index) {
+    DecodeJob* job = ctx;
+    int channels;
+    AtlasImage* image = &job->images[index];
+    image->pixels = stbi_load(job->paths[index], &image->width, &image->height, &channels, 4);
+}
+
+bool texture_atlas_load(const char* const* paths, int count, const AtlasDesc* desc, TextureAtlas* atlas) {
+    memset(atlas, 0, sizeof(*atlas));
+    AtlasImage* images = calloc(count, sizeof(AtlasImage));
+    if (!images) return false;
+
+    DecodeJob job = {paths, images};
+    thread_pool_parallel_for(thread_pool_shared(), count, decode_image, &job);
+
+    bool ok = true;
+    for (int i = 0; i < count; i++) {
+        if (images[i].pixels) continue;
+        printf("Failed to load atlas image %s\n", paths[i]);
+        ok = false;
+    }
+    ok = ok && texture_atlas_pack(images, count, desc, atlas);
+
+    for (int i = 0; i < count; i++)
+        stbi_image_free((void*) images[i].pixels);
+    free(images);
+    return ok;
+}
+
+void texture_atlas_free(TextureAtlas* atlas) {
+    if (atlas->texture) {
+        gl_state_forget_texture(atlas->texture);
+        glDeleteTextures(1, &atlas->texture);
+    }
+    free(atlas->regions);
+    memset(atlas, 0, sizeof(*atlas));
+}
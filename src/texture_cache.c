@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "texture_cache.h"
+#include "gl_state.h"
+#include "utils.h"
+
+typedef struct {
+    uint64_t key;
+    char* path; // canonical
+    int params[7];
+    GLuint texture;
+    int refs;
+    bool loading;
+    bool orphaned; // released or cleared while loading, freed by its stream callback
+    TextureStreamCallback callback;
+    void* user;
+} CacheEntry;
+
+static CacheEntry** entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+static unsigned int hits = 0;
+static unsigned int misses = 0;
+
+// Only the parameters that change the texture object, the placeholder and callback do not.
+static void desc_params(const TextureStreamDesc* desc, int params[7]) {
+    TextureStreamDesc resolved = desc ? *desc : (TextureStreamDesc) {0};
+    texture_stream_resolve_desc(&resolved);
+    params[0] = resolved.hdr;
+    params[1] = resolved.mipmaps;
+    params[2] = resolved.wrapS;
+    params[3] = resolved.wrapT;
+    params[4] = resolved.minFilter;
+    params[5] = resolved.magFilter;
+    params[6] = (int) resolved.hdrFormat;
+}
+
+static void entry_free(CacheEntry* e) {
+    gl_state_forget_texture(e->texture);
+    glDeleteTextures(1, &e->texture);
+    free(e->path);
+    free(e);
+}
+
+static void remove_entry(int i) {
+    entries[i] = entries[--entry_count];
+}
+
+static void entry_loaded(GLuint texture, int width, int height, bool loaded, void* user) {
+    CacheEntry* e = user;
+    e->loading = false;
+
+    if (e->orphaned) {
+        entry_free(e);
+        return;
+    }
+    if (e->callback)
+        e->callback(texture, width, height, loaded, e->user);
+}
+
+GLuint texture_cache_acquire(const char* path, const TextureStreamDesc* desc) {
+    // Different spellings of the same file ("./a.png", "../x/a.png") share one entry.
+    char* canonical = realpath(path, NULL);
+    if (!canonical) canonical = strdup(path);
+    if (!canonical) return 0;
+
+    int params[7];
+    desc_params(desc, params);
+    uint64_t key = hash_string(canonical, FNV1A_SEED);
+    key = hash_fnv1a(params, sizeof(params), key);
+
+    for (int i = 0; i < entry_count; i++) {
+        CacheEntry* e = entries[i];
+        if (e->key == key && strcmp(e->path, canonical) == 0 && memcmp(e->params, params, sizeof(params)) == 0) {
+            free(canonical);
+            e->refs++;
+            hits++;
+            return e->texture;
+        }
+    }
+    misses++;
+
+    if (entry_count == entry_capacity) {
+        const int capacity = entry_capacity ? entry_capacity * 2 : 16;
+        CacheEntry** grown = realloc(entries, capacity * sizeof(CacheEntry*));
+        if (!grown) {
+            free(canonical);
+            return 0;
+        }
+        entries = grown;
+        entry_capacity = capacity;
+    }
+
+    CacheEntry* e = calloc(1, sizeof(CacheEntry));
+    if (!e) {
+        free(canonical);
+        return 0;
+    }
+    e->key = key;
+    e->path = canonical;
+    memcpy(e->params, params, sizeof(params));
+    e->refs = 1;
+    e->loading = true;
+
+    TextureStreamDesc load = desc ? *desc : (TextureStreamDesc) {0};
+    e->callback = load.callback;
+    e->user = load.user;
+    load.callback = entry_loaded;
+    load.user = e;
+    e->texture = texture_stream_load(canonical, &load);
+
+    entries[entry_count++] = e;
+    return e->texture;
+}
+
+void texture_cache_release(GLuint texture) {
+    for (int i = 0; i < entry_count; i++) {
+        CacheEntry* e = entries[i];
+        if (e->texture != texture) continue;
+
+        if (--e->refs > 0) return;
+        remove_entry(i);
+        // The stream still uploads into the texture, it is deleted once that finished.
+        if (e->loading) e->orphaned = true;
+        else entry_free(e);
+        return;
+    }
+    printf("Released texture %u that is not in the texture cache\n", texture);
+}
+
+TextureCacheStats texture_cache_stats() {
+    TextureCacheStats stats = {hits, misses, (unsigned int) entry_count, 0};
+    for (int i = 0; i < entry_count; i++)
+        stats.references += entries[i]->refs;
+    return stats;
+}
+
+void texture_cache_clear() {
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i]->loading) entries[i]->orphaned = true;
+        else entry_free(entries[i]);
+    }
+    free(entries);
+    entries = NULL;
+    entry_count = 0;
+    entry_capacity = 0;
+}
@@ -0,0 +1,204 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "texture_container.h"
+#include "utils.h"
+
+// Bump whenever the layout changes, old files are then rewritten.
+#define CONTAINER_FORMAT_TAG "COpenGLLib gtex v1"
+#define CONTAINER_MAGIC 0x58455447u // "GTEX"
+#define CONTAINER_VERSION 1
+// The payload starts on a page, so level 0 of a mapping is page aligned.
+#define PAYLOAD_OFFSET 4096
+
+typedef struct {
+    uint64_t offset; // from the start of the file
+    uint64_t size;
+    uint64_t rowPitch;
+} LevelEntry;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t internalFormat;
+    uint32_t format;
+    uint32_t type;
+    uint32_t channels;
+    uint32_t texelSize;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint64_t key;
+    uint64_t checksum;
+    uint64_t payloadSize;
+    LevelEntry levels[MIP_MAX_LEVELS];
+} ContainerHeader;
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// FNV-1a over 64 bit words, eight times fewer steps than hash_fnv1a. Payload sizes are multiples of 8.
+static uint64_t payload_checksum(const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    uint64_t hash = FNV1A_SEED;
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash ^= word;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t texture_container_key(const char* assetPath, const MipDesc* desc, bool mipmaps) {
+    struct stat st;
+    if (stat(assetPath, &st) != 0) return 0;
+
+    const int64_t params[] = {
+        desc->channels, desc->hdr, desc->srgb, mipmaps ? (int64_t) desc->filter : -1,
+        (int64_t) st.st_size, (int64_t) st.st_mtime,
+    };
+    const uint64_t key = hash_fnv1a(params, sizeof(params), hash_string(CONTAINER_FORMAT_TAG, FNV1A_SEED));
+    return key ? key : 1;
+}
+
+bool texture_container_is_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    uint32_t magic = 0;
+    const bool ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == CONTAINER_MAGIC;
+    fclose(file);
+    return ok;
+}
+
+bool texture_container_write(const char* path, uint64_t key, GLenum internalFormat, GLenum format, GLenum type,
+                             int channels, size_t texelSize, const MipChain* chain) {
+    ContainerHeader header = {
+        .magic = CONTAINER_MAGIC,
+        .version = CONTAINER_VERSION,
+        .internalFormat = internalFormat,
+        .format = format,
+        .type = type,
+        .channels = (uint32_t) channels,
+        .texelSize = (uint32_t) texelSize,
+        .width = (uint32_t) chain->widths[0],
+        .height = (uint32_t) chain->heights[0],
+        .levelCount = (uint32_t) chain->levelCount,
+        .key = key,
+    };
+    size_t offset = PAYLOAD_OFFSET;
+    for (int level = 0; level < chain->levelCount; level++) {
+        LevelEntry* entry = &header.levels[level];
+        entry->rowPitch = align_up((size_t) chain->widths[level] * texelSize, TEXTURE_CONTAINER_ROW_ALIGNMENT);
+        entry->size = entry->rowPitch * chain->heights[level];
+        entry->offset = offset;
+        offset = align_up(offset + entry->size, TEXTURE_CONTAINER_LEVEL_ALIGNMENT);
+    }
+    header.payloadSize = offset - PAYLOAD_OFFSET;
+
+    unsigned char* payload = calloc(1, header.payloadSize);
+    if (!payload) return false;
+    for (int level = 0; level < chain->levelCount; level++) {
+        const LevelEntry* entry = &header.levels[level];
+        const size_t rowBytes = (size_t) chain->widths[level] * texelSize;
+        const unsigned char* src = chain->levels[level];
+        unsigned char* dst = payload + (entry->offset - PAYLOAD_OFFSET);
+        for (int y = 0; y < chain->heights[level]; y++)
+            memcpy(dst + y * entry->rowPitch, src + y * rowBytes, rowBytes);
+    }
+    header.checksum = payload_checksum(payload, header.payloadSize);
+
+    // Write to a temporary file first, so a crash never leaves a truncated container behind.
+    char tmpPath[1040];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE* file = fopen(tmpPath, "wb");
+    if (!file) {
+        free(payload);
+        return false;
+    }
+    static const unsigned char padding[PAYLOAD_OFFSET] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(padding, 1, PAYLOAD_OFFSET - sizeof(header), file) == PAYLOAD_OFFSET - sizeof(header) &&
+              fwrite(payload, 1, header.payloadSize, file) == header.payloadSize;
+    ok = fclose(file) == 0 && ok;
+    free(payload);
+    if (!ok || rename(tmpPath, path) != 0) {
+        remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+static bool header_valid(const ContainerHeader* header, size_t fileSize, uint64_t key) {
+    if (header->magic != CONTAINER_MAGIC || header->version != CONTAINER_VERSION) return false;
+    if (key && header->key != key) return false;
+    if (header->width == 0 || header->height == 0 || header->texelSize == 0) return false;
+    if (header->levelCount == 0 || header->levelCount > MIP_MAX_LEVELS) return false;
+    if (header->payloadSize > fileSize - PAYLOAD_OFFSET) return false;
+
+    for (uint32_t level = 0; level < header->levelCount; level++) {
+        const LevelEntry* entry = &header->levels[level];
+        const uint64_t width = header->width >> level > 0 ? header->width >> level : 1;
+        const uint64_t height = header->height >> level > 0 ? header->height >> level : 1;
+        if (entry->rowPitch < width * header->texelSize || entry->rowPitch % TEXTURE_CONTAINER_ROW_ALIGNMENT != 0 ||
+            entry->size != entry->rowPitch * height || entry->offset < PAYLOAD_OFFSET ||
+            entry->offset % TEXTURE_CONTAINER_LEVEL_ALIGNMENT != 0 ||
+            entry->offset + entry->size > PAYLOAD_OFFSET + header->payloadSize)
+            return false;
+    }
+    return true;
+}
+
+bool texture_container_open(const char* path, uint64_t key, TextureContainer* container) {
+    memset(container, 0, sizeof(*container));
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    ContainerHeader header;
+    bool ok = fstat(fd, &st) == 0 && (size_t) st.st_size >= PAYLOAD_OFFSET &&
+              pread(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header) &&
+              header_valid(&header, (size_t) st.st_size, key);
+    void* mapping = ok ? mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+    // The checksum reads every page right away, start reading ahead before it gets there.
+    madvise(mapping, (size_t) st.st_size, MADV_WILLNEED);
+
+    const unsigned char* payload = (const unsigned char*) mapping + PAYLOAD_OFFSET;
+    if (payload_checksum(payload, header.payloadSize) != header.checksum) {
+        printf("Texture container %s is corrupt\n", path);
+        munmap(mapping, (size_t) st.st_size);
+        return false;
+    }
+
+    *container = (TextureContainer) {
+        .internalFormat = header.internalFormat,
+        .format = header.format,
+        .type = header.type,
+        .channels = (int) header.channels,
+        .width = (int) header.width,
+        .height = (int) header.height,
+        .levelCount = (int) header.levelCount,
+        .mapping = mapping,
+        .mappingSize = (size_t) st.st_size,
+    };
+    for (int level = 0; level < container->levelCount; level++) {
+        container->widths[level] = container->width >> level > 0 ? container->width >> level : 1;
+        container->heights[level] = container->height >> level > 0 ? container->height >> level : 1;
+        container->rowPitches[level] = header.levels[level].rowPitch;
+        container->levelSizes[level] = header.levels[level].size;
+        container->levels[level] = (const unsigned char*) mapping + header.levels[level].offset;
+    }
+    return true;
+}
+
+void texture_container_close(TextureContainer* container) {
+    if (container->mapping) munmap(container->mapping, container->mappingSize);
+    memset(container, 0, sizeof(*container));
+}
@@ -1,5 +1,15 @@
 #include <glad/glad.h>
 #include "texture_helper.h"
+#include "gl_state.h"
+#include "ktx2.h"
+#include "texture_container.h"
+#include "upload_queue.h"
+#include "texture_residency.h"
+#include "mip_builder.h"
+#include "hdr_pack.h"
+#include "thread_pool.h"
+#include <GLFW/glfw3.h>
+#include <string.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../external/glfw/src/internal.h"
@@ -7,36 +17,257 @@
 
 #define min(X,Y) (((X) < (Y)) ? (X) : (Y))
 
+#define LOAD_MIP_FILTER MIP_FILTER_KAISER
+
 typedef unsigned char* Image;
 
 GLint get_image_format(int nrChannels) {
     switch (nrChannels) {
         case 1: return GL_RED;
+        case 2: return GL_RG;
         case 3: return GL_RGB;
         case 4: return GL_RGBA;
         default: return GL_RGB;
     }
 }
 
+// BPTC is core since 4.2, S3TC is an extension every desktop driver exposes.
+static bool compressed_format_supported(GLenum format) {
+    switch (format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            return glfwExtensionSupported("GL_EXT_texture_compression_s3tc");
+        default:
+            return format != 0;
+    }
+}
+
+// Uploads every stored level into the texture bound to GL_TEXTURE_2D, the file replaces glGenerateMipmap.
+static bool upload_ktx2_levels(const Ktx2Texture* ktx, const char* path) {
+    const GLenum format = ktx2_gl_format(ktx->vkFormat);
+    if (!compressed_format_supported(format)) {
+        printf("Compressed format of %s is not supported by the driver\n", path);
+        return false;
+    }
+
+    for (int level = 0; level < ktx->levelCount; level++) {
+        const int w = ktx->width >> level > 0 ? ktx->width >> level : 1;
+        const int h = ktx->height >> level > 0 ? ktx->height >> level : 1;
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, w, h, 0, (GLsizei) ktx->levelSizes[level],
+                               ktx->levels[level]);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ktx->levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, ktx->levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    return true;
+}
+
+static bool upload_ktx2(const char* path, int* width, int* height) {
+    Ktx2Texture ktx;
+    if (!ktx2_read(path, &ktx)) return false;
+    const bool ok = upload_ktx2_levels(&ktx, path);
+    *width = ktx.width;
+    *height = ktx.height;
+    ktx2_free(&ktx);
+    return ok;
+}
+
+/**
+ * Allocates a level and queues its pixels instead of uploading them while uploads are deferred, see
+ * upload_queue_set_deferred. The data is copied, callers may free it right after.
+ * @param layer The cube face for cube maps, -1 for 2D textures.
+ * @param rowPitch Bytes between the rows of data, 0 if tightly packed.
+ * @return false if the level still has to be uploaded directly.
+ */
+static bool defer_level(GLuint texture, GLenum target, GLint layer, GLint level, GLint internalFormat, int width,
+                        int height, GLenum format, GLenum type, const void* data, size_t rowPitch) {
+    if (!upload_queue_deferred()) return false;
+    const UploadTextureRegion region = {texture, level, layer, 0, 0, width, height, format, type, data, rowPitch};
+    glTexImage2D(target, level, internalFormat, width, height, 0, format, type, NULL);
+    return upload_queue_texture(&region, UPLOAD_DATA_COPY, NULL, NULL);
+}
+
+// Uploads every level of a pre-decoded container into the texture bound to GL_TEXTURE_2D, straight from the mapping.
+static void upload_container_levels(GLuint texture, const TextureContainer* container, GLint internalFormat) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, TEXTURE_CONTAINER_ROW_ALIGNMENT);
+    if (!internalFormat) internalFormat = (GLint) container->internalFormat;
+    for (int level = 0; level < container->levelCount; level++) {
+        if (defer_level(texture, GL_TEXTURE_2D, -1, level, internalFormat, container->widths[level],
+                        container->heights[level], container->format, container->type, container->levels[level],
+                        container->rowPitches[level]))
+            continue;
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, container->widths[level], container->heights[level], 0,
+                     container->format, container->type, container->levels[level]);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, container->levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    container->levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+}
+
+static bool upload_container(GLuint texture, const char* path, uint64_t key, GLint internalFormat, int* width,
+                             int* height, int* nrChannels) {
+    TextureContainer container;
+    if (!texture_container_open(path, key, &container)) return false;
+    upload_container_levels(texture, &container, internalFormat);
+    *width = container.width;
+    *height = container.height;
+    *nrChannels = container.channels;
+    texture_container_close(&container);
+    return true;
+}
+
+// Uploads a chain built by mip_build into the texture bound to GL_TEXTURE_2D.
+static void upload_chain(GLuint texture, const MipChain* chain, GLint internalFormat, GLenum format, GLenum type) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < chain->levelCount; level++) {
+        if (defer_level(texture, GL_TEXTURE_2D, -1, level, internalFormat, chain->widths[level],
+                        chain->heights[level], format, type, chain->levels[level], 0))
+            continue;
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, chain->widths[level], chain->heights[level], 0, format,
+                     type, chain->levels[level]);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, chain->levelCount - 1);
+}
+
+/**
+ * Uploads an image and the mip chain built below it on the CPU into the texture bound to GL_TEXTURE_2D.
+ * @param containerPath Where to keep the decoded image and its chain for upload_container, under key.
+ *                      NULL builds the chain every time.
+ */
+static void upload_with_mips(GLuint texture, const char* containerPath, uint64_t key, const MipDesc* desc,
+                             const void* data, int width, int height, GLint internalFormat, GLenum format,
+                             GLenum type) {
+    MipChain chain;
+    const bool built = mip_build(desc, data, width, height, &chain);
+
+    if (built) {
+        upload_chain(texture, &chain, internalFormat, format, type);
+        // The container holds the chain as well, so the next load skips both decoding and filtering.
+        if (containerPath && key) {
+            texture_container_write(containerPath, key, (GLenum) internalFormat, format, type, desc->channels,
+                                    mip_texel_size(desc), &chain);
+        }
+        mip_chain_free(&chain);
+    } else {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+}
+
+/**
+ * Loads an 8 bit image into the texture bound to GL_TEXTURE_2D, from the container kept next to it if there is a
+ * current one, otherwise by decoding it and writing that container.
+ */
+static bool load_image(GLuint texture, const char* texLocation, int* width, int* height, int* nrChannels,
+                       GLint format) {
+    // A container next to the asset skips decoding, it is written the first time the asset is decoded.
+    char containerPath[1024];
+    snprintf(containerPath, sizeof(containerPath), "%s" TEXTURE_CONTAINER_EXTENSION, texLocation);
+    const MipDesc keyDesc = {0, false, true, LOAD_MIP_FILTER};
+    const uint64_t key = texture_container_key(texLocation, &keyDesc, true);
+    if (key && upload_container(texture, containerPath, key, format, width, height, nrChannels)) return true;
+
+    // load and generate the texture, color channels of 8 bit files are taken as sRGB
+    unsigned char *data = stbi_load(texLocation, width, height, nrChannels, 0);
+    if (!data) return false;
+    const MipDesc desc = {*nrChannels, false, *nrChannels >= 3, LOAD_MIP_FILTER};
+    upload_with_mips(texture, containerPath, key, &desc, data, *width, *height, format, format, GL_UNSIGNED_BYTE);
+    stbi_image_free(data);
+    return true;
+}
+
+// Like load_image for float RGB, the way gen_skybox_texture loads HDR files. internalFormat is a float RGB format.
+static bool load_hdr_image(GLuint texture, const char* texLocation, GLint internalFormat) {
+    int width, height, nrChannels;
+    char containerPath[1024];
+    snprintf(containerPath, sizeof(containerPath), "%s" TEXTURE_CONTAINER_EXTENSION, texLocation);
+    const MipDesc desc = {3, true, false, LOAD_MIP_FILTER};
+    const uint64_t key = texture_container_key(texLocation, &desc, true);
+    if (key && upload_container(texture, containerPath, key, internalFormat, &width, &height, &nrChannels)) return true;
+
+    // load and generate the texture, always as RGB since that is what gets uploaded
+    float* data = stbi_loadf(texLocation, &width, &height, &nrChannels, 3);
+    if (!data) return false;
+    upload_with_mips(texture, containerPath, key, &desc, data, width, height, internalFormat, GL_RGB, GL_FLOAT);
+    stbi_image_free(data);
+    return true;
+}
+
+// Brings back textures evicted by texture_residency, into the same name.
+static bool reload_texture(GLuint texture, GLenum target, const char* path, GLint format) {
+    int width, height, nrChannels;
+    gl_state_bind_texture(target, texture);
+    if (ktx2_is_file(path)) return upload_ktx2(path, &width, &height);
+    if (texture_container_is_file(path)) return upload_container(texture, path, 0, 0, &width, &height, &nrChannels);
+    return load_image(texture, path, &width, &height, &nrChannels, format);
+}
+
+static bool reload_hdr_image(GLuint texture, GLenum target, const char* path, GLint format) {
+    gl_state_bind_texture(target, texture);
+    return load_hdr_image(texture, path, format);
+}
+
+unsigned int gen_texture_ktx2(const char* path, int* width, int* height) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    gl_state_bind_texture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (!upload_ktx2(path, width, height)) {
+        gl_state_forget_texture(texture);
+        glDeleteTextures(1, &texture);
+        return 0;
+    }
+    texture_residency_track(texture, GL_TEXTURE_2D, path, 0, reload_texture);
+    return texture;
+}
+
+unsigned int gen_texture_container(const char* path, int* width, int* height, int* nrChannels) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    gl_state_bind_texture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (!upload_container(texture, path, 0, 0, width, height, nrChannels)) {
+        printf("Failed to load texture container %s\n", path);
+        gl_state_forget_texture(texture);
+        glDeleteTextures(1, &texture);
+        return 0;
+    }
+    texture_residency_track(texture, GL_TEXTURE_2D, path, 0, reload_texture);
+    return texture;
+}
+
 unsigned int gen_texture_whcf(char* texLocation, int* width, int* height, int* nrChannels, GLint format) {
+    // Block compressed files carry their own format and mips.
+    if (ktx2_is_file(texLocation)) {
+        *nrChannels = 4;
+        return gen_texture_ktx2(texLocation, width, height);
+    }
+    if (texture_container_is_file(texLocation)) return gen_texture_container(texLocation, width, height, nrChannels);
+
     GLuint texture;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    gl_state_bind_texture(GL_TEXTURE_2D, texture);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    // load and generate the texture
-    unsigned char *data = stbi_load(texLocation, width, height, nrChannels, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, format, *width, *height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
+    if (load_image(texture, texLocation, width, height, nrChannels, format))
+        texture_residency_track(texture, GL_TEXTURE_2D, texLocation, format, reload_texture);
+    else
         printf("Failed to load texture\n");
-    }
-    stbi_image_free(data);
 
     return texture;
 }
@@ -60,27 +291,183 @@ unsigned int gen_texture(char* texLocation) {
     return gen_texture_wh(texLocation, &width, &height);
 }
 
+typedef enum {
+    BATCH_FAILED,
+    BATCH_KTX2,
+    BATCH_CONTAINER,
+    BATCH_DECODED,
+} BatchSource;
+
+typedef struct {
+    const char* path;
+    BatchSource source;
+    bool hdr;
+    Ktx2Texture ktx;
+    TextureContainer container;
+    void* pixels;
+    int width;
+    int height;
+    int channels;
+    MipChain chain;
+    bool built; // otherwise glGenerateMipmap fills in the levels below pixels
+} BatchTexture;
+
+// The formats gen_texture and gen_skybox_texture upload a decoded image as.
+static void batch_formats(const BatchTexture* item, GLint* internalFormat, GLenum* format, GLenum* type) {
+    *format = item->hdr ? GL_RGB : (GLenum) get_image_format(item->channels);
+    *internalFormat = item->hdr ? GL_RGB32F : (GLint) *format;
+    *type = item->hdr ? GL_FLOAT : GL_UNSIGNED_BYTE;
+}
+
+// Everything of a batch load but the upload: reads or maps the file, or decodes it, filters its chain and writes
+// the container next to it.
+static void batch_decode(void* ctx, int index) {
+    BatchTexture* item = (BatchTexture*) ctx + index;
+    const char* path = item->path;
+    if (ktx2_is_file(path)) {
+        item->source = ktx2_read(path, &item->ktx) ? BATCH_KTX2 : BATCH_FAILED;
+        return;
+    }
+    if (texture_container_is_file(path)) {
+        item->source = texture_container_open(path, 0, &item->container) ? BATCH_CONTAINER : BATCH_FAILED;
+        return;
+    }
+
+    // Keyed like load_image and load_hdr_image, so batches and single loads share their containers.
+    item->hdr = stbi_is_hdr(path);
+    char containerPath[1024];
+    snprintf(containerPath, sizeof(containerPath), "%s" TEXTURE_CONTAINER_EXTENSION, path);
+    const MipDesc keyDesc = item->hdr ? (MipDesc) {3, true, false, LOAD_MIP_FILTER}
+                                      : (MipDesc) {0, false, true, LOAD_MIP_FILTER};
+    const uint64_t key = texture_container_key(path, &keyDesc, true);
+    if (key && texture_container_open(containerPath, key, &item->container)) {
+        item->source = BATCH_CONTAINER;
+        return;
+    }
+
+    item->pixels = item->hdr ? (void*) stbi_loadf(path, &item->width, &item->height, &item->channels, 3)
+                             : (void*) stbi_load(path, &item->width, &item->height, &item->channels, 0);
+    if (!item->pixels) {
+        printf("Failed to load texture %s: %s\n", path, stbi_failure_reason());
+        return;
+    }
+    if (item->hdr) item->channels = 3;
+
+    const MipDesc desc = {item->channels, item->hdr, !item->hdr && item->channels >= 3, LOAD_MIP_FILTER};
+    item->built = mip_build(&desc, item->pixels, item->width, item->height, &item->chain);
+    if (item->built && key) {
+        GLint internalFormat;
+        GLenum format, type;
+        batch_formats(item, &internalFormat, &format, &type);
+        texture_container_write(containerPath, key, (GLenum) internalFormat, format, type, desc.channels,
+                                mip_texel_size(&desc), &item->chain);
+    }
+    item->source = BATCH_DECODED;
+}
+
+static bool batch_upload(GLuint texture, const BatchTexture* item) {
+    GLint internalFormat;
+    GLenum format, type;
+    switch (item->source) {
+        case BATCH_KTX2:
+            return upload_ktx2_levels(&item->ktx, item->path);
+        case BATCH_CONTAINER:
+            upload_container_levels(texture, &item->container, 0);
+            return true;
+        case BATCH_DECODED:
+            batch_formats(item, &internalFormat, &format, &type);
+            if (item->built) {
+                upload_chain(texture, &item->chain, internalFormat, format, type);
+            } else {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, item->width, item->height, 0, format, type,
+                             item->pixels);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void batch_free(BatchTexture* item) {
+    if (item->source == BATCH_KTX2) ktx2_free(&item->ktx);
+    if (item->source == BATCH_CONTAINER) texture_container_close(&item->container);
+    if (item->built) mip_chain_free(&item->chain);
+    stbi_image_free(item->pixels);
+}
+
+int gen_textures(const char* const* paths, int count, unsigned int* textures) {
+    for (int i = 0; i < count; i++)
+        textures[i] = 0;
+    BatchTexture* items = calloc(count, sizeof(BatchTexture));
+    if (!items) return 0;
+    for (int i = 0; i < count; i++)
+        items[i].path = paths[i];
+
+    thread_pool_parallel_for(thread_pool_shared(), count, batch_decode, items);
+
+    int loaded = 0;
+    for (int i = 0; i < count; i++) {
+        BatchTexture* item = &items[i];
+        if (item->source != BATCH_FAILED) {
+            GLuint texture;
+            glGenTextures(1, &texture);
+            gl_state_bind_texture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            if (batch_upload(texture, item)) {
+                const int channels = item->source == BATCH_CONTAINER ? item->container.channels : item->channels;
+                if (item->hdr)
+                    texture_residency_track(texture, GL_TEXTURE_2D, item->path, GL_RGB32F, reload_hdr_image);
+                else
+                    texture_residency_track(texture, GL_TEXTURE_2D, item->path, get_image_format(channels),
+                                            reload_texture);
+                textures[i] = texture;
+                loaded++;
+            } else {
+                gl_state_forget_texture(texture);
+                glDeleteTextures(1, &texture);
+            }
+        }
+        // Freed as soon as it is uploaded rather than after the pass.
+        batch_free(item);
+    }
+    free(items);
+    return loaded;
+}
+
 unsigned int gen_skybox_texture(char* texLocation) {
+    if (ktx2_is_file(texLocation)) {
+        int width, height;
+        const GLuint texture = gen_texture_ktx2(texLocation, &width, &height);
+        if (texture) glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+    if (texture_container_is_file(texLocation)) {
+        int width, height, nrChannels;
+        const GLuint texture = gen_texture_container(texLocation, &width, &height, &nrChannels);
+        if (texture) glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
     GLuint texture;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    gl_state_bind_texture(GL_TEXTURE_2D, texture);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    // load and generate the texture
-    int width, height, nrChannels;
-    float* data = stbi_loadf(texLocation, &width, &height, &nrChannels, 0);
-    if (data) {
-        GLint format = get_image_format(nrChannels);
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, data);
-    } else {
+    if (load_hdr_image(texture, texLocation, GL_RGB32F))
+        texture_residency_track(texture, GL_TEXTURE_2D, texLocation, GL_RGB32F, reload_hdr_image);
+    else
         printf("Failed to load texture: %s\n", stbi_failure_reason());
-    }
-    stbi_image_free(data);
 
     return texture;
 }
@@ -92,20 +479,71 @@ unsigned int gen_skybox_texture(char* texLocation) {
 
 
 
+unsigned int gen_env_map_texture(const EnvMap* map, GLenum hdrFormat) {
+    const GLenum target = map->layout == ENV_MAP_CUBE ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+    const size_t texels = (size_t) map->faces[0].widths[0] * map->faces[0].heights[0];
+    void* packed = malloc(texels * hdr_pack_texel_size(hdrFormat));
+    if (!packed) return 0;
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    gl_state_bind_texture(target, texture);
+    // Only longitude wraps around.
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, map->layout == ENV_MAP_EQUIRECT ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, map->faces[0].levelCount - 1);
+    // Filters across face edges instead of clamping at them.
+    if (target == GL_TEXTURE_CUBE_MAP) gl_state_enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    GLenum format, type;
+    hdr_pack_upload_format(hdrFormat, &format, &type);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int face = 0; face < map->faceCount; face++) {
+        const MipChain* chain = &map->faces[face];
+        const GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum) face : target;
+        for (int level = 0; level < chain->levelCount; level++) {
+            hdr_pack(hdrFormat, chain->levels[level], packed, (size_t) chain->widths[level] * chain->heights[level]);
+            const GLint layer = target == GL_TEXTURE_CUBE_MAP ? face : -1;
+            if (defer_level(texture, faceTarget, layer, level, (GLint) hdrFormat, chain->widths[level],
+                            chain->heights[level], format, type, packed, 0))
+                continue;
+            glTexImage2D(faceTarget, level, (GLint) hdrFormat, chain->widths[level], chain->heights[level], 0, format,
+                         type, packed);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    free(packed);
+    texture_residency_track(texture, target, NULL, 0, NULL);
+
+    return texture;
+}
+
+unsigned int gen_env_map(const char* path, EnvMapLayout layout, int size, GLenum hdrFormat) {
+    EnvMap map;
+    if (!env_map_load(path, layout, size, MIP_FILTER_KAISER, &map)) return 0;
+    const GLuint texture = gen_env_map_texture(&map, hdrFormat);
+    env_map_free(&map);
+    return texture;
+}
+
 unsigned int gen_texture_data(Image data, int width, int height, int nrChannels) {
     GLuint texture;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    gl_state_bind_texture(GL_TEXTURE_2D, texture);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     GLint format = get_image_format(nrChannels);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // Generated images have no file to cache the chain next to.
+    const MipDesc desc = {nrChannels, false, nrChannels >= 3, LOAD_MIP_FILTER};
+    upload_with_mips(texture, NULL, 0, &desc, data, width, height, format, format, GL_UNSIGNED_BYTE);
+    texture_residency_track(texture, GL_TEXTURE_2D, NULL, 0, NULL);
 
     return texture;
 }
@@ -113,23 +551,18 @@ unsigned int gen_texture_data(Image data, int width, int height, int nrChannels)
 
 
 Image image_subregion(Image source, int width, int height, int channels, int xOffset, int yOffset, int size) {
-    int N = size * size * channels;
-    Image subregion = (Image) malloc(N * sizeof(unsigned char));
-    if (!subregion) return NULL;
-
-    if (xOffset + size > width || yOffset + size > height) {
+    if (xOffset < 0 || yOffset < 0 || xOffset + size > width || yOffset + size > height) {
         return NULL;
     }
 
-    for (int y = 0; y < size; y++) {
-        for (int x = 0; x < size; x++) {
-            int dst = (y*size + x) * channels; //subregion pixel at (x,y)
-            int src = ((y+yOffset)*width + x+xOffset) * channels; //source pixel at (x,y)
+    const size_t rowBytes = (size_t) size * channels;
+    Image subregion = (Image) malloc(rowBytes * size);
+    if (!subregion) return NULL;
 
-            for (int c = 0; c < channels; c++) {
-                subregion[dst+c] = source[src+c];
-            }
-        }
+    const unsigned char* src = source + ((size_t) yOffset * width + xOffset) * channels;
+    for (int y = 0; y < size; y++) {
+        memcpy(subregion + y * rowBytes, src, rowBytes);
+        src += (size_t) width * channels;
     }
 
     return subregion;
@@ -138,7 +571,7 @@ Image image_subregion(Image source, int width, int height, int channels, int xOf
 unsigned int gen_cube_map_single(char* textureLocation, int* width, int* height, int* nrChannels) {
     GLuint texture;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    gl_state_bind_texture(GL_TEXTURE_CUBE_MAP, texture);
 
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -149,6 +582,8 @@ unsigned int gen_cube_map_single(char* textureLocation, int* width, int* height,
     Image data = stbi_load(textureLocation, width, height, nrChannels, 0);
     if (!data) {
         printf("Failed to load texture\n");
+        gl_state_forget_texture(texture);
+        glDeleteTextures(1, &texture);
         return 0;
     }
 
@@ -156,24 +591,31 @@ unsigned int gen_cube_map_single(char* textureLocation, int* width, int* height,
     int newHeight = *height / 3;
     int size = min(newWidth, newHeight);
     size = (int)pow((int)sqrt(size), 2);
-    Image faces[6];
-    /*right*/ faces[0] = image_subregion(data, *width, *height, *nrChannels, newWidth * 2, newHeight, size);
-    /*left*/ faces[1] = image_subregion(data, *width, *height, *nrChannels, 0, newHeight, size);
-    /*top*/ faces[2] = image_subregion(data, *width, *height, *nrChannels, newWidth, 0, size);
-    /*bottom*/ faces[3] = image_subregion(data, *width, *height, *nrChannels, newWidth, newHeight * 2, size);
-    /*front*/ faces[4] = image_subregion(data, *width, *height, *nrChannels, newWidth, newHeight, size);
-    /*back*/ faces[5] = image_subregion(data, *width, *height, *nrChannels, newWidth * 3, newHeight, size);
-
-
+    // Cell of each face in the 4x3 cross, in GL_TEXTURE_CUBE_MAP_POSITIVE_X order: right, left, top, bottom, front, back.
+    static const int FACE_CELLS[6][2] = {{2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {3, 1}};
 
+    // The faces are read straight out of the cross, the unpack state selects the rectangle of each one.
     GLint format = get_image_format(*nrChannels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, *width);
     for (int i = 0; i < 6; i++) {
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, FACE_CELLS[i][0] * newWidth);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, FACE_CELLS[i][1] * newHeight);
+        const Image face = data + ((size_t) FACE_CELLS[i][1] * newHeight * *width + FACE_CELLS[i][0] * newWidth) *
+                                  *nrChannels;
+        if (defer_level(texture, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, i, 0, format, size, size, format,
+                        GL_UNSIGNED_BYTE, face, (size_t) *width * *nrChannels))
+            continue;
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                     0, format, size, size, 0, format, GL_UNSIGNED_BYTE, faces[i]);
-        free(faces[i]);
+                     0, format, size, size, 0, format, GL_UNSIGNED_BYTE, data);
     }
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
     stbi_image_free(data);
+    texture_residency_track(texture, GL_TEXTURE_CUBE_MAP, NULL, 0, NULL);
 
     return texture;
-}
\ No newline at end of file
+}
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "texture_residency.h"
+#include "gl_state.h"
+#include "ktx2.h"
+#include "upload_queue.h"
+
+#define DEFAULT_MIN_SIZE 64
+
+typedef struct {
+    GLuint texture;
+    GLenum target;
+    int faces;
+    GLenum internalFormat;
+    bool compressed;
+    int levelCount;  // levels currently resident
+    int widths[RESIDENCY_MAX_LEVELS];
+    int heights[RESIDENCY_MAX_LEVELS];
+    size_t levelSizes[RESIDENCY_MAX_LEVELS]; // bytes of one face
+    size_t bytes;
+    size_t fullBytes;
+    int fullLevelCount;
+    GLint maxLevel;  // GL_TEXTURE_MAX_LEVEL as created
+    int dropped;     // top levels dropped since the last (re)load
+    char* path;
+    GLint format;
+    TextureReloadFn reload;
+    uint64_t lastUse;
+    bool reloadPending;
+} ResidentTexture;
+
+static ResidentTexture* entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+// GL names are small and dense, so entries are found by indexing with the name instead of hashing it.
+// Holds the entry index + 1, 0 for untracked names.
+static int* slots = NULL;
+static GLuint slot_count = 0;
+
+static ResidencyBudget budget = {0, RESIDENCY_DROP_MIPS, DEFAULT_MIN_SIZE};
+static uint64_t frame = 1;
+static size_t resident_bytes = 0;
+static uint64_t evictions = 0;
+static uint64_t mip_drops = 0;
+static uint64_t reloads = 0;
+// Set while residency binds textures for its own work, which must not count as a use of them.
+static bool internal_bind = false;
+
+void texture_residency_set_budget(const ResidencyBudget* newBudget) {
+    budget = *newBudget;
+    if (budget.minSize <= 0) budget.minSize = DEFAULT_MIN_SIZE;
+}
+
+static ResidentTexture* find(GLuint texture) {
+    if (texture >= slot_count || !slots[texture]) return NULL;
+    return &entries[slots[texture] - 1];
+}
+
+static void bind_internal(const ResidentTexture* e) {
+    internal_bind = true;
+    gl_state_bind_texture(e->target, e->texture);
+    internal_bind = false;
+}
+
+static GLenum face_target(const ResidentTexture* e, int face) {
+    return e->target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum) face : e->target;
+}
+
+static size_t texel_bits(GLenum faceTarget, GLint level) {
+    static const GLenum SIZES[] = {
+        GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE,
+        GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE, GL_TEXTURE_SHARED_SIZE,
+    };
+    size_t bits = 0;
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+        GLint size = 0;
+        glGetTexLevelParameteriv(faceTarget, level, SIZES[i], &size);
+        bits += (size_t) size;
+    }
+    return bits;
+}
+
+/**
+ * Reads the levels the texture currently has from the driver. Levels past GL_TEXTURE_MAX_LEVEL, or whose size does
+ * not follow from level 0, are left over from an earlier drop and not counted.
+ */
+static void measure(ResidentTexture* e) {
+    bind_internal(e);
+    const GLenum faceTarget = face_target(e, 0);
+    GLint maxLevel = 0, internalFormat = 0, compressed = GL_FALSE;
+    glGetTexParameteriv(e->target, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+    glGetTexLevelParameteriv(faceTarget, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+    glGetTexLevelParameteriv(faceTarget, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    e->internalFormat = (GLenum) internalFormat;
+    e->compressed = compressed == GL_TRUE;
+
+    const size_t bytesPerTexel = (texel_bits(faceTarget, 0) + 7) / 8;
+    e->levelCount = 0;
+    e->bytes = 0;
+    for (int level = 0; level <= maxLevel && level < RESIDENCY_MAX_LEVELS; level++) {
+        GLint width = 0, height = 0;
+        glGetTexLevelParameteriv(faceTarget, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(faceTarget, level, GL_TEXTURE_HEIGHT, &height);
+        if (width <= 0 || height <= 0) break;
+        if (level > 0 && (width != (e->widths[0] >> level > 0 ? e->widths[0] >> level : 1) ||
+                          height != (e->heights[0] >> level > 0 ? e->heights[0] >> level : 1)))
+            break;
+
+        size_t size = (size_t) width * height * bytesPerTexel;
+        if (e->compressed) {
+            GLint compressedSize = 0;
+            glGetTexLevelParameteriv(faceTarget, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressedSize);
+            size = (size_t) compressedSize;
+        }
+        e->widths[level] = width;
+        e->heights[level] = height;
+        e->levelSizes[level] = size;
+        e->bytes += size * e->faces;
+        e->levelCount = level + 1;
+    }
+}
+
+void texture_residency_track(GLuint texture, GLenum target, const char* path, GLint format, TextureReloadFn reload) {
+    if (!texture || (target != GL_TEXTURE_2D && target != GL_TEXTURE_CUBE_MAP)) return;
+    texture_residency_untrack(texture);
+
+    if (texture >= slot_count) {
+        GLuint count = slot_count ? slot_count : 64;
+        while (count <= texture) count *= 2;
+        int* grown = realloc(slots, count * sizeof(int));
+        if (!grown) return;
+        memset(grown + slot_count, 0, (count - slot_count) * sizeof(int));
+        slots = grown;
+        slot_count = count;
+    }
+    if (entry_count == entry_capacity) {
+        const int capacity = entry_capacity ? entry_capacity * 2 : 16;
+        ResidentTexture* grown = realloc(entries, capacity * sizeof(ResidentTexture));
+        if (!grown) return;
+        entries = grown;
+        entry_capacity = capacity;
+    }
+
+    ResidentTexture* e = &entries[entry_count];
+    memset(e, 0, sizeof(*e));
+    e->texture = texture;
+    e->target = target;
+    e->faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+    e->path = path && reload ? strdup(path) : NULL;
+    e->format = format;
+    e->reload = e->path ? reload : NULL;
+    e->lastUse = frame;
+    measure(e);
+    if (e->levelCount == 0) {
+        free(e->path);
+        return;
+    }
+    glGetTexParameteriv(target, GL_TEXTURE_MAX_LEVEL, &e->maxLevel);
+    e->fullBytes = e->bytes;
+    e->fullLevelCount = e->levelCount;
+    resident_bytes += e->bytes;
+    slots[texture] = ++entry_count;
+}
+
+void texture_residency_untrack(GLuint texture) {
+    ResidentTexture* e = find(texture);
+    if (!e) return;
+
+    resident_bytes -= e->bytes;
+    free(e->path);
+    slots[texture] = 0;
+    const int last = entry_count - 1;
+    const int index = (int) (e - entries);
+    if (index != last) {
+        entries[index] = entries[last];
+        slots[entries[index].texture] = index + 1;
+    }
+    entry_count--;
+}
+
+void texture_residency_touch(GLuint texture) {
+    if (internal_bind || texture >= slot_count || !slots[texture]) return;
+    ResidentTexture* e = &entries[slots[texture] - 1];
+    e->lastUse = frame;
+    if (e->dropped && e->reload) e->reloadPending = true;
+}
+
+static void respecify(const ResidentTexture* e, GLint level, int source) {
+    for (int face = 0; face < e->faces; face++) {
+        if (e->compressed) {
+            glCompressedTexImage2D(face_target(e, face), level, e->internalFormat, e->widths[source],
+                                   e->heights[source], 0, (GLsizei) e->levelSizes[source], NULL);
+        } else {
+            glTexImage2D(face_target(e, face), level, (GLint) e->internalFormat, e->widths[source],
+                         e->heights[source], 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+}
+
+/**
+ * Drops the top count levels, the rest move up to start at level 0. Mutable textures cannot lose a level, so the
+ * levels past the new chain are shrunk to the size of the last one instead, which frees their memory just the same.
+ */
+static bool drop_levels(ResidentTexture* e, int count) {
+    const int kept = e->levelCount - count;
+    if (count <= 0 || kept < 1) return false;
+
+    GLuint copy;
+    glCreateTextures(e->target, 1, &copy);
+    glTextureStorage2D(copy, kept, e->internalFormat, e->widths[count], e->heights[count]);
+    for (int level = 0; level < kept; level++) {
+        glCopyImageSubData(e->texture, e->target, level + count, 0, 0, 0, copy, e->target, level, 0, 0, 0,
+                           e->widths[level + count], e->heights[level + count], e->faces);
+    }
+
+    bind_internal(e);
+    const int last = e->levelCount - 1;
+    for (int level = 0; level < e->levelCount; level++)
+        respecify(e, level, level < kept ? level + count : last);
+    for (int level = 0; level < kept; level++) {
+        glCopyImageSubData(copy, e->target, level, 0, 0, 0, e->texture, e->target, level, 0, 0, 0,
+                           e->widths[level + count], e->heights[level + count], e->faces);
+    }
+    glTexParameteri(e->target, GL_TEXTURE_MAX_LEVEL, kept - 1);
+    glDeleteTextures(1, &copy);
+
+    e->dropped += count;
+    resident_bytes -= e->bytes;
+    measure(e);
+    resident_bytes += e->bytes;
+    return true;
+}
+
+static bool reload(ResidentTexture* e) {
+    bind_internal(e);
+    // Loaders that let glGenerateMipmap build the chain leave the limit alone.
+    glTexParameteri(e->target, GL_TEXTURE_MAX_LEVEL, e->maxLevel);
+    e->reloadPending = false;
+    // The loader binds the texture as well, which would queue the next reload while the levels are still dropped.
+    internal_bind = true;
+    const bool loaded = e->reload(e->texture, e->target, e->path, e->format);
+    internal_bind = false;
+    if (!loaded) {
+        printf("Failed to reload evicted texture %s\n", e->path);
+        e->reload = NULL;
+        return false;
+    }
+    e->dropped = 0;
+    resident_bytes -= e->bytes;
+    measure(e);
+    resident_bytes += e->bytes;
+    e->fullBytes = e->bytes;
+    e->fullLevelCount = e->levelCount;
+    reloads++;
+    return true;
+}
+
+// Shrinks a texture one step under the policy, false if it cannot shrink any further.
+static bool shrink(ResidentTexture* e) {
+    if (budget.policy == RESIDENCY_EVICT && e->reload) {
+        if (!drop_levels(e, e->levelCount - 1)) return false;
+        evictions++;
+        return true;
+    }
+    const int top = e->widths[0] > e->heights[0] ? e->widths[0] : e->heights[0];
+    if (e->levelCount < 2 || top / 2 < budget.minSize) return false;
+    if (!drop_levels(e, 1)) return false;
+    mip_drops++;
+    return true;
+}
+
+void texture_residency_update() {
+    // Uploads still queued were issued against the current levels.
+    if (budget.bytes == 0 || entry_count == 0 || upload_queue_stats().queued > 0) {
+        frame++;
+        return;
+    }
+
+    // One reload per frame, they decode on this thread. Evicted textures come back even if that pushes others out,
+    // dropped mips only when they fit.
+    ResidentTexture* pending = NULL;
+    for (int i = 0; i < entry_count; i++) {
+        ResidentTexture* e = &entries[i];
+        if (e->reloadPending && (!pending || e->lastUse > pending->lastUse)) pending = e;
+    }
+    if (pending) {
+        const size_t grown = pending->fullBytes - pending->bytes;
+        const bool fits = budget.policy == RESIDENCY_EVICT ? pending->fullBytes <= budget.bytes
+                                                           : resident_bytes + grown <= budget.bytes;
+        if (fits) reload(pending);
+        else pending->reloadPending = false;
+    }
+
+    // Textures bound this frame are never shrunk, the budget may stay exceeded if they alone exceed it.
+    while (resident_bytes > budget.bytes) {
+        ResidentTexture* victim = NULL;
+        for (int i = 0; i < entry_count; i++) {
+            ResidentTexture* e = &entries[i];
+            if (e->lastUse >= frame || e->levelCount < 2) continue;
+            if (!victim || e->lastUse < victim->lastUse) victim = e;
+        }
+        if (!victim) break;
+        if (!shrink(victim)) victim->lastUse = frame; // skipped until it is bound again
+    }
+    frame++;
+}
+
+static int by_bytes(const void* a, const void* b) {
+    const size_t x = ((const ResidencyFormatStats*) a)->bytes, y = ((const ResidencyFormatStats*) b)->bytes;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+ResidencyStats texture_residency_stats() {
+    ResidencyStats stats = {
+        .budget = budget.bytes,
+        .residentBytes = resident_bytes,
+        .textures = (unsigned int) entry_count,
+        .evictions = evictions,
+        .mipDrops = mip_drops,
+        .reloads = reloads,
+    };
+    for (int i = 0; i < entry_count; i++) {
+        const ResidentTexture* e = &entries[i];
+        stats.fullBytes += e->fullBytes;
+        if (e->dropped) stats.shrunk++;
+
+        int f = 0;
+        while (f < stats.formatCount && stats.formats[f].internalFormat != e->internalFormat) f++;
+        if (f == RESIDENCY_MAX_FORMATS) continue;
+        if (f == stats.formatCount) stats.formats[stats.formatCount++].internalFormat = e->internalFormat;
+        stats.formats[f].textures++;
+        stats.formats[f].bytes += e->bytes;
+    }
+    qsort(stats.formats, stats.formatCount, sizeof(ResidencyFormatStats), by_bytes);
+    return stats;
+}
+
+const char* texture_residency_format_name(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_R8: return "R8";
+        case GL_RG8: return "RG8";
+        case GL_RGB8: return "RGB8";
+        case GL_RGBA8: return "RGBA8";
+        case GL_SRGB8: return "SRGB8";
+        case GL_SRGB8_ALPHA8: return "SRGB8_ALPHA8";
+        case GL_RGB16F: return "RGB16F";
+        case GL_RGBA16F: return "RGBA16F";
+        case GL_RGB32F: return "RGB32F";
+        case GL_RGBA32F: return "RGBA32F";
+        case GL_R11F_G11F_B10F: return "R11F_G11F_B10F";
+        case GL_RGB9_E5: return "RGB9_E5";
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return "BC1";
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT: return "BC1_SRGB";
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT: return "BC3_SRGB";
+        case GL_COMPRESSED_RGBA_BPTC_UNORM: return "BC7";
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM: return "BC7_SRGB";
+        case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT: return "BC6H";
+        default: return "other";
+    }
+}
@@ -0,0 +1,695 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "texture_stream.h"
+#include "texture_helper.h"
+#include "thread_pool.h"
+#include "gl_state.h"
+#include "hdr_pack.h"
+#include "hdr_reader.h"
+#include "mip_builder.h"
+#include "texture_container.h"
+#include "stb/stb_image.h"
+
+// Radiance files stream through a ring of this many row chunks of about STREAM_CHUNK_BYTES each.
+#define STREAM_CHUNKS 4
+#define STREAM_CHUNK_BYTES (4 * 1024 * 1024)
+
+// The filter texture_helper builds its chains with, so both share the containers next to the assets.
+#define STREAM_MIP_FILTER MIP_FILTER_KAISER
+
+/**
+ * A load moves through these states. Worker threads only perform the DECODING -> DECODED/HEADER/FAILED and
+ * COPYING -> COPIED transitions, everything else happens on the GL thread inside texture_stream_poll.
+ * Whole images go DECODED -> COPYING -> COPIED -> UPLOADING, Radiance files go HEADER -> ROWS and filter their
+ * mips on the way through.
+ */
+typedef enum {
+    STREAM_DECODING,
+    STREAM_DECODED,
+    STREAM_COPYING,
+    STREAM_COPIED,
+    STREAM_UPLOADING,
+    STREAM_HEADER,
+    STREAM_ROWS,
+    STREAM_FAILED,
+} StreamState;
+
+/**
+ * A slot of the row ring. The decoder fills FREE slots in ring order, the GL thread uploads FILLED ones
+ * and frees them once the fence of their upload signaled. Next to a chunk of level 0 rows a slot carries the rows
+ * the smaller levels gained while that chunk was decoded.
+ */
+typedef enum {
+    CHUNK_FREE,
+    CHUNK_FILLED,
+    CHUNK_UPLOADED,
+    CHUNK_FAILED,
+} ChunkState;
+
+typedef struct {
+    _Atomic int state;
+    int firstRows[MIP_MAX_LEVELS];
+    int rows[MIP_MAX_LEVELS];
+    GLsync fence;
+} StreamChunk;
+
+// A level of a streamed Radiance file, filled top to bottom while the rows above it decode.
+typedef struct {
+    int width;
+    int height;
+    int rowsPushed;
+    size_t rowBytes;
+    size_t slotOffset; // where its rows start in a ring slot
+    float* row;        // decoded for level 0, box filtered from pairs of rows of the level above otherwise
+} StreamLevel;
+
+typedef struct {
+    GLuint texture;
+    char* path;
+    TextureStreamDesc desc;
+    _Atomic int state;
+
+    void* pixels;
+    int width;
+    int height;
+    int channels;
+    size_t size;
+
+    GLuint pbo;
+    void* mapped;
+    GLsync fence;
+
+    // The levels uploaded from the buffer, the chain holds their sources unless they are mapped from the container.
+    MipChain mips;
+    TextureContainer container;
+    size_t sourcePitches[MIP_MAX_LEVELS]; // 0 for tightly packed rows
+    int levelCount;
+    size_t levelOffsets[MIP_MAX_LEVELS];
+
+    // Row streaming. decodeSlot and decodeRow belong to the decoder task, which runs at most once at a time.
+    HdrReader* reader;
+    StreamChunk chunks[STREAM_CHUNKS];
+    StreamLevel levels[MIP_MAX_LEVELS];
+    int streamLevels;
+    size_t slotBytes;
+    int chunkRows;
+    int decodeSlot;
+    int decodeRow;
+    int rowsUploaded;
+    _Atomic bool decoderRunning;
+} StreamJob;
+
+static StreamJob** jobs = NULL;
+static int jobCount = 0;
+static int jobCapacity = 0;
+
+static size_t texel_size(const StreamJob* job) {
+    return job->desc.hdr ? hdr_pack_texel_size(job->desc.hdrFormat) : (size_t) job->channels;
+}
+
+static int level_extent(int size, int level) {
+    return size >> level > 0 ? size >> level : 1;
+}
+
+// Lays the levels of the chain out for the unpack buffer.
+static void layout_buffer(StreamJob* job) {
+    job->size = 0;
+    for (int level = 0; level < job->levelCount; level++) {
+        job->levelOffsets[level] = job->size;
+        job->size += (size_t) level_extent(job->width, level) * level_extent(job->height, level) * texel_size(job);
+    }
+}
+
+// The formats a decoded image is kept in, like batch_formats of texture_helper.
+static void source_formats(const StreamJob* job, GLenum* internalFormat, GLenum* format, GLenum* type) {
+    *format = job->desc.hdr ? GL_RGB : (GLenum) get_image_format(job->channels);
+    *internalFormat = job->desc.hdr ? GL_RGB32F : *format;
+    *type = job->desc.hdr ? GL_FLOAT : GL_UNSIGNED_BYTE;
+}
+
+/**
+ * Builds the mip chain below source and writes it to the container under key. Runs on a worker.
+ */
+static void prepare_levels(StreamJob* job, const void* source, const char* containerPath, uint64_t key) {
+    bool built = false;
+    if (job->desc.mipmaps) {
+        const MipDesc mipDesc = {job->channels, job->desc.hdr, !job->desc.hdr && job->channels >= 3, STREAM_MIP_FILTER};
+        built = mip_build(&mipDesc, source, job->width, job->height, &job->mips);
+        if (!built) {
+            printf("Failed to build the mips of %s, loading it without\n", job->path);
+        } else if (key) {
+            GLenum internalFormat, format, type;
+            source_formats(job, &internalFormat, &format, &type);
+            texture_container_write(containerPath, key, internalFormat, format, type, job->channels,
+                                    mip_texel_size(&mipDesc), &job->mips);
+        }
+    }
+    if (!built) {
+        memset(&job->mips, 0, sizeof(job->mips));
+        job->mips.levelCount = 1;
+        job->mips.levels[0] = source;
+    }
+
+    job->levelCount = job->mips.levelCount;
+    layout_buffer(job);
+}
+
+// Takes the levels straight from the mapped container, only level 0 without mipmaps.
+static void use_container(StreamJob* job) {
+    const TextureContainer* container = &job->container;
+    job->width = container->width;
+    job->height = container->height;
+    job->channels = container->channels;
+    job->levelCount = job->desc.mipmaps ? container->levelCount : 1;
+    memset(&job->mips, 0, sizeof(job->mips));
+    job->mips.levelCount = job->levelCount;
+    for (int level = 0; level < job->levelCount; level++) {
+        job->mips.levels[level] = container->levels[level];
+        job->sourcePitches[level] = container->rowPitches[level];
+    }
+    layout_buffer(job);
+}
+
+// Packing straight into the mapped buffer saves a pass over the float image.
+static void pack_levels(StreamJob* job, void* dst) {
+    for (int level = 0; level < job->levelCount; level++) {
+        const char* src = job->mips.levels[level];
+        const int width = level_extent(job->width, level), height = level_extent(job->height, level);
+        const size_t texels = (size_t) width * height, rowBytes = (size_t) width * job->channels;
+        char* out = (char*) dst + job->levelOffsets[level];
+        // Float rows are always tightly packed, only 8 bit rows of a container carry padding.
+        if (job->desc.hdr) {
+            hdr_pack(job->desc.hdrFormat, (const float*) src, out, texels);
+        } else if (!job->sourcePitches[level] || job->sourcePitches[level] == rowBytes) {
+            memcpy(out, src, texels * job->channels);
+        } else {
+            for (int y = 0; y < height; y++)
+                memcpy(out + y * rowBytes, src + y * job->sourcePitches[level], rowBytes);
+        }
+    }
+}
+
+static void release_sources(StreamJob* job) {
+    mip_chain_free(&job->mips);
+    texture_container_close(&job->container);
+    stbi_image_free(job->pixels);
+    job->pixels = NULL;
+}
+
+static void decode_job(void* arg) {
+    StreamJob* job = arg;
+
+    if (job->desc.hdr) {
+        // Radiance files are decoded in row chunks straight into upload memory, anything else goes through stbi.
+        // A container would bring back the whole image, so they skip it.
+        job->reader = hdr_reader_open(job->path);
+        if (job->reader) {
+            job->width = hdr_reader_width(job->reader);
+            job->height = hdr_reader_height(job->reader);
+            atomic_store_explicit(&job->state, STREAM_HEADER, memory_order_release);
+            return;
+        }
+    }
+
+    // Keyed like load_image and load_hdr_image of texture_helper, whichever decodes the asset first writes it.
+    char containerPath[1024];
+    snprintf(containerPath, sizeof(containerPath), "%s" TEXTURE_CONTAINER_EXTENSION, job->path);
+    const MipDesc keyDesc = {job->desc.hdr ? 3 : 0, job->desc.hdr, !job->desc.hdr, STREAM_MIP_FILTER};
+    const uint64_t key = texture_container_key(job->path, &keyDesc, true);
+    if (key && texture_container_open(containerPath, key, &job->container)) {
+        use_container(job);
+        atomic_store_explicit(&job->state, STREAM_DECODED, memory_order_release);
+        return;
+    }
+
+    if (job->desc.hdr) {
+        job->pixels = stbi_loadf(job->path, &job->width, &job->height, &job->channels, 3);
+        job->channels = 3;
+    } else {
+        job->pixels = stbi_load(job->path, &job->width, &job->height, &job->channels, 0);
+    }
+
+    if (!job->pixels) {
+        printf("Failed to load texture %s: %s\n", job->path, stbi_failure_reason());
+        atomic_store_explicit(&job->state, STREAM_FAILED, memory_order_release);
+        return;
+    }
+    prepare_levels(job, job->pixels, containerPath, key);
+    atomic_store_explicit(&job->state, STREAM_DECODED, memory_order_release);
+}
+
+static void copy_job(void* arg) {
+    StreamJob* job = arg;
+    pack_levels(job, job->mapped);
+    release_sources(job);
+    atomic_store_explicit(&job->state, STREAM_COPIED, memory_order_release);
+}
+
+void texture_stream_resolve_desc(TextureStreamDesc* desc) {
+    if (!desc->hdrFormat || !hdr_pack_supported(desc->hdrFormat)) desc->hdrFormat = GL_RGB32F;
+    if (!desc->wrapS) desc->wrapS = GL_REPEAT;
+    if (!desc->wrapT) desc->wrapT = GL_REPEAT;
+    if (!desc->minFilter) desc->minFilter = desc->mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+    if (!desc->magFilter) desc->magFilter = GL_LINEAR;
+}
+
+static void set_placeholder(GLuint texture, const TextureStreamDesc* desc) {
+    gl_state_bind_texture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, desc->wrapS);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, desc->wrapT);
+    // Mipmapped filtering would leave the single level placeholder incomplete, it is enabled after the upload.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc->magFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc->magFilter);
+    glTexImage2D(GL_TEXTURE_2D, 0, desc->hdr ? GL_RGBA16F : GL_RGBA8, 1, 1, 0, GL_RGBA, GL_FLOAT, desc->placeholder);
+}
+
+GLuint texture_stream_load(const char* path, const TextureStreamDesc* desc) {
+    TextureStreamDesc resolved = desc ? *desc : (TextureStreamDesc) {0};
+    texture_stream_resolve_desc(&resolved);
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    set_placeholder(texture, &resolved);
+
+    StreamJob* job = calloc(1, sizeof(StreamJob));
+    if (!job) return texture;
+    job->texture = texture;
+    job->path = strdup(path);
+    job->desc = resolved;
+    atomic_init(&job->state, STREAM_DECODING);
+
+    if (jobCount == jobCapacity) {
+        const int capacity = jobCapacity ? jobCapacity * 2 : 8;
+        StreamJob** grown = realloc(jobs, capacity * sizeof(StreamJob*));
+        if (!grown) {
+            free(job->path);
+            free(job);
+            return texture;
+        }
+        jobs = grown;
+        jobCapacity = capacity;
+    }
+    jobs[jobCount++] = job;
+
+    thread_pool_submit(thread_pool_shared(), decode_job, job);
+    return texture;
+}
+
+/**
+ * Uploads the prepared levels.
+ * @param base The packed levels in client memory, or the offset of the first one in the bound unpack buffer.
+ */
+static void upload(StreamJob* job, const void* base) {
+    GLenum format = get_image_format(job->channels);
+    GLenum type = GL_UNSIGNED_BYTE;
+    GLint internalFormat = (GLint) format;
+    if (job->desc.hdr) {
+        hdr_pack_upload_format(job->desc.hdrFormat, &format, &type);
+        internalFormat = (GLint) job->desc.hdrFormat;
+    }
+
+    gl_state_bind_texture(GL_TEXTURE_2D, job->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < job->levelCount; level++) {
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, level_extent(job->width, level),
+                     level_extent(job->height, level), 0, format, type, (const char*) base + job->levelOffsets[level]);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // A chain that could not be built leaves a single level, which keeps mipmapped filtering complete.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, job->levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, job->desc.minFilter);
+
+    job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    atomic_store_explicit(&job->state, STREAM_UPLOADING, memory_order_relaxed);
+}
+
+static void start_copy(StreamJob* job) {
+    glCreateBuffers(1, &job->pbo);
+    glNamedBufferStorage(job->pbo, (GLsizeiptr) job->size, NULL, GL_MAP_WRITE_BIT);
+    job->mapped = glMapNamedBufferRange(job->pbo, 0, (GLsizeiptr) job->size,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if (!job->mapped) {
+        // Without a mapping upload from client memory, which still keeps the decode off this thread.
+        glDeleteBuffers(1, &job->pbo);
+        job->pbo = 0;
+        void* packed = malloc(job->size);
+        if (!packed) {
+            release_sources(job);
+            atomic_store_explicit(&job->state, STREAM_FAILED, memory_order_relaxed);
+            return;
+        }
+        pack_levels(job, packed);
+        release_sources(job);
+        upload(job, packed);
+        free(packed);
+        return;
+    }
+
+    atomic_store_explicit(&job->state, STREAM_COPYING, memory_order_relaxed);
+    thread_pool_submit(thread_pool_shared(), copy_job, job);
+}
+
+static void upload_from_buffer(StreamJob* job) {
+    glUnmapNamedBuffer(job->pbo);
+    job->mapped = NULL;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+    upload(job, (const void*) 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/**
+ * Packs the next row of a level into the slot being filled and averages it into the row of the level below, which
+ * is pushed in turn once both of its source rows are in. The last row and column of odd sizes are dropped, like
+ * glGenerateMipmap does.
+ */
+static void level_push(StreamJob* job, StreamChunk* chunk, char* slot, int levelIndex, const float* row) {
+    StreamLevel* level = &job->levels[levelIndex];
+    const int y = level->rowsPushed++;
+    char* dst = slot + level->slotOffset + (size_t) (y - chunk->firstRows[levelIndex]) * level->rowBytes;
+    hdr_pack(job->desc.hdrFormat, row, dst, (size_t) level->width);
+    chunk->rows[levelIndex]++;
+
+    if (levelIndex + 1 >= job->streamLevels) return;
+    StreamLevel* next = &job->levels[levelIndex + 1];
+    const float weight = level->height > 1 ? 0.25f : 0.5f;
+    const int step = level->width > 1 ? 3 : 0;
+    const bool first = (y & 1) == 0;
+    for (int x = 0; x < next->width; x++) {
+        const float* src = row + (size_t) x * 6;
+        for (int c = 0; c < 3; c++) {
+            const float value = weight * (src[c] + src[step + c]);
+            next->row[x * 3 + c] = first ? value : next->row[x * 3 + c] + value;
+        }
+    }
+    if (level->height == 1 || !first) level_push(job, chunk, slot, levelIndex + 1, next->row);
+}
+
+/**
+ * Decodes rows into free slots of the ring, in order, until it catches up with the uploads or the image ends.
+ */
+static void decode_rows(void* arg) {
+    StreamJob* job = arg;
+
+    while (job->decodeRow < job->height) {
+        StreamChunk* chunk = &job->chunks[job->decodeSlot];
+        if (atomic_load_explicit(&chunk->state, memory_order_acquire) != CHUNK_FREE) break;
+
+        const int rows = job->height - job->decodeRow < job->chunkRows ? job->height - job->decodeRow : job->chunkRows;
+        char* slot = (char*) job->mapped + (size_t) job->decodeSlot * job->slotBytes;
+        for (int level = 0; level < job->streamLevels; level++) {
+            chunk->firstRows[level] = job->levels[level].rowsPushed;
+            chunk->rows[level] = 0;
+        }
+        bool ok = true;
+        if (job->streamLevels > 1) {
+            // Row by row in float, so the smaller levels are filtered on the way through.
+            for (int i = 0; i < rows && ok; i++) {
+                // A failed read leaves the previous row in place, which must not be packed or filtered again.
+                ok = hdr_reader_read_rows(job->reader, GL_RGB32F, job->levels[0].row, 1);
+                if (ok) level_push(job, chunk, slot, 0, job->levels[0].row);
+            }
+        } else {
+            ok = hdr_reader_read_rows(job->reader, job->desc.hdrFormat, slot, rows);
+            chunk->rows[0] = rows;
+        }
+
+        job->decodeRow += rows;
+        job->decodeSlot = (job->decodeSlot + 1) % STREAM_CHUNKS;
+        atomic_store_explicit(&chunk->state, ok ? CHUNK_FILLED : CHUNK_FAILED, memory_order_release);
+        if (!ok) break;
+    }
+
+    atomic_store_explicit(&job->decoderRunning, false, memory_order_release);
+}
+
+/**
+ * Lays out the levels of a Radiance file in the ring slots. A chunk of level 0 rows completes at most
+ * (chunkRows >> level) + 1 rows of a smaller level, which is the room that level gets in every slot.
+ * @return false if the rows the levels are filtered in could not be allocated.
+ */
+static bool layout_levels(StreamJob* job, int levelCount) {
+    const size_t texelSize = hdr_pack_texel_size(job->desc.hdrFormat);
+    job->streamLevels = levelCount;
+    job->slotBytes = 0;
+    bool allocated = true;
+    for (int i = 0; i < levelCount; i++) {
+        StreamLevel* level = &job->levels[i];
+        level->width = level_extent(job->width, i);
+        level->height = level_extent(job->height, i);
+        level->rowBytes = (size_t) level->width * texelSize;
+        level->slotOffset = job->slotBytes;
+        const int rows = i == 0 ? job->chunkRows : (job->chunkRows >> i) + 1;
+        job->slotBytes += (size_t) (rows < level->height ? rows : level->height) * level->rowBytes;
+        if (levelCount > 1) {
+            level->row = malloc((size_t) level->width * 3 * sizeof(float));
+            allocated = allocated && level->row;
+        }
+    }
+    return allocated;
+}
+
+static void free_levels(StreamJob* job) {
+    for (int i = 0; i < MIP_MAX_LEVELS; i++) {
+        free(job->levels[i].row);
+        job->levels[i].row = NULL;
+    }
+}
+
+static void start_rows(StreamJob* job) {
+    GLenum format, type;
+    hdr_pack_upload_format(job->desc.hdrFormat, &format, &type);
+
+    job->channels = 3;
+    job->chunkRows = (int) (STREAM_CHUNK_BYTES / ((size_t) job->width * hdr_pack_texel_size(job->desc.hdrFormat)));
+    if (job->chunkRows < 1) job->chunkRows = 1;
+    if (job->chunkRows > job->height) job->chunkRows = job->height;
+    // Only a row per level is kept in float, level 1 and below never exist in host memory as a whole.
+    if (!layout_levels(job, job->desc.mipmaps ? mip_level_count(job->width, job->height) : 1)) {
+        printf("Failed to allocate the mips of %s, loading it without\n", job->path);
+        free_levels(job);
+        layout_levels(job, 1);
+    }
+
+    // The full size storage starts out as the placeholder color and fills in chunk by chunk.
+    gl_state_bind_texture(GL_TEXTURE_2D, job->texture);
+    for (int level = 0; level < job->streamLevels; level++) {
+        glTexImage2D(GL_TEXTURE_2D, level, (GLint) job->desc.hdrFormat, job->levels[level].width,
+                     job->levels[level].height, 0, format, type, NULL);
+        glClearTexImage(job->texture, level, GL_RGBA, GL_FLOAT, job->desc.placeholder);
+    }
+
+    // Persistent and coherent, so workers write into the ring while the GL thread uploads other slots from it.
+    const GLsizeiptr size = (GLsizeiptr) (STREAM_CHUNKS * job->slotBytes);
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &job->pbo);
+    glNamedBufferStorage(job->pbo, size, NULL, flags);
+    job->mapped = glMapNamedBufferRange(job->pbo, 0, size, flags);
+    if (!job->mapped) {
+        printf("Failed to map the upload ring for %s\n", job->path);
+        atomic_store_explicit(&job->state, STREAM_FAILED, memory_order_relaxed);
+        return;
+    }
+
+    atomic_store_explicit(&job->state, STREAM_ROWS, memory_order_relaxed);
+}
+
+static void upload_chunk(StreamJob* job, int slot) {
+    StreamChunk* chunk = &job->chunks[slot];
+    GLenum format, type;
+    hdr_pack_upload_format(job->desc.hdrFormat, &format, &type);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < job->streamLevels; level++) {
+        if (chunk->rows[level] == 0) continue;
+        const size_t offset = (size_t) slot * job->slotBytes + job->levels[level].slotOffset;
+        glTextureSubImage2D(job->texture, level, 0, chunk->firstRows[level], job->levels[level].width,
+                            chunk->rows[level], format, type, (const void*) offset);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    chunk->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    job->rowsUploaded += chunk->rows[0];
+    atomic_store_explicit(&chunk->state, CHUNK_UPLOADED, memory_order_relaxed);
+}
+
+static bool fence_signaled(GLsync fence, bool block) {
+    const GLuint64 timeout = block ? GL_TIMEOUT_IGNORED : 0;
+    const GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+/**
+ * Uploads the filled chunks, recycles the slots the GPU is done with and restarts the decoder if it stalled
+ * on a full ring.
+ * @return true once every row was uploaded and the GPU finished reading the ring.
+ */
+static bool advance_rows(StreamJob* job, bool block) {
+    bool pending = atomic_load_explicit(&job->decoderRunning, memory_order_acquire);
+    bool failed = false;
+
+    for (int i = 0; i < STREAM_CHUNKS; i++) {
+        StreamChunk* chunk = &job->chunks[i];
+        switch (atomic_load_explicit(&chunk->state, memory_order_acquire)) {
+            case CHUNK_FILLED:
+                upload_chunk(job, i);
+                pending = true;
+                break;
+            case CHUNK_UPLOADED:
+                if (fence_signaled(chunk->fence, block)) {
+                    glDeleteSync(chunk->fence);
+                    chunk->fence = NULL;
+                    atomic_store_explicit(&chunk->state, CHUNK_FREE, memory_order_release);
+                } else {
+                    pending = true;
+                }
+                break;
+            case CHUNK_FAILED:
+                failed = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (failed) {
+        // The decoder stops at the failed chunk, the job can go once the task has returned.
+        if (!atomic_load_explicit(&job->decoderRunning, memory_order_acquire))
+            atomic_store_explicit(&job->state, STREAM_FAILED, memory_order_relaxed);
+        return false;
+    }
+
+    if (!atomic_load_explicit(&job->decoderRunning, memory_order_acquire) && job->decodeRow < job->height &&
+        atomic_load_explicit(&job->chunks[job->decodeSlot].state, memory_order_acquire) == CHUNK_FREE) {
+        atomic_store_explicit(&job->decoderRunning, true, memory_order_relaxed);
+        thread_pool_submit(thread_pool_shared(), decode_rows, job);
+        return false;
+    }
+
+    if (pending || job->rowsUploaded < job->height) return false;
+
+    // The GPU is done with the ring.
+    glUnmapNamedBuffer(job->pbo);
+    glDeleteBuffers(1, &job->pbo);
+    job->mapped = NULL;
+    job->pbo = 0;
+    hdr_reader_close(job->reader);
+    job->reader = NULL;
+    free_levels(job);
+
+    glTextureParameteri(job->texture, GL_TEXTURE_MAX_LEVEL, job->streamLevels - 1);
+    glTextureParameteri(job->texture, GL_TEXTURE_MIN_FILTER, job->desc.minFilter);
+    return true;
+}
+
+static void free_job(StreamJob* job) {
+    if (job->mapped) glUnmapNamedBuffer(job->pbo);
+    if (job->pbo) glDeleteBuffers(1, &job->pbo);
+    if (job->fence) glDeleteSync(job->fence);
+    for (int i = 0; i < STREAM_CHUNKS; i++) {
+        if (job->chunks[i].fence) glDeleteSync(job->chunks[i].fence);
+    }
+    hdr_reader_close(job->reader);
+    release_sources(job);
+    free_levels(job);
+    free(job->path);
+    free(job);
+}
+
+/**
+ * Advances one job.
+ * @return true once the job is finished and its callback ran.
+ */
+static bool advance(StreamJob* job, bool block) {
+    switch (atomic_load_explicit(&job->state, memory_order_acquire)) {
+        case STREAM_DECODED:
+            start_copy(job);
+            return false;
+        case STREAM_COPIED:
+            upload_from_buffer(job);
+            return false;
+        case STREAM_UPLOADING:
+            if (!fence_signaled(job->fence, block)) return false;
+            break;
+        case STREAM_HEADER:
+            start_rows(job);
+            return false;
+        case STREAM_ROWS:
+            if (!advance_rows(job, block)) return false;
+            break;
+        case STREAM_FAILED:
+            if (job->desc.callback)
+                job->desc.callback(job->texture, 0, 0, false, job->desc.user);
+            return true;
+        default:
+            return false;
+    }
+
+    if (job->desc.callback)
+        job->desc.callback(job->texture, job->width, job->height, true, job->desc.user);
+    return true;
+}
+
+static int poll_jobs(bool block) {
+    // Callbacks may start new loads, those are appended past the end and kept as they are.
+    const int count = jobCount;
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (advance(jobs[i], block)) {
+            free_job(jobs[i]);
+        } else {
+            jobs[kept++] = jobs[i];
+        }
+    }
+    for (int i = count; i < jobCount; i++)
+        jobs[kept++] = jobs[i];
+    jobCount = kept;
+    return jobCount;
+}
+
+int texture_stream_poll() {
+    return poll_jobs(false);
+}
+
+bool texture_stream_ready(GLuint texture) {
+    for (int i = 0; i < jobCount; i++) {
+        if (jobs[i]->texture == texture) return false;
+    }
+    return true;
+}
+
+void texture_stream_finish() {
+    // Each pass moves every job at least one state forward, the waits cover the worker stages.
+    while (poll_jobs(true) > 0)
+        thread_pool_wait(thread_pool_shared());
+}
+
+void texture_stream_shutdown() {
+    // Dropped loads report a failure, so that owners like the texture cache free what they keep for them.
+    // Callbacks may start new loads, those are dropped in the next pass.
+    while (jobCount > 0) {
+        thread_pool_wait(thread_pool_shared());
+
+        StreamJob** dropped = jobs;
+        const int count = jobCount;
+        jobs = NULL;
+        jobCount = 0;
+        jobCapacity = 0;
+
+        for (int i = 0; i < count; i++) {
+            if (dropped[i]->desc.callback)
+                dropped[i]->desc.callback(dropped[i]->texture, 0, 0, false, dropped[i]->desc.user);
+            free_job(dropped[i]);
+        }
+        free(dropped);
+    }
+    free(jobs);
+    jobs = NULL;
+    jobCapacity = 0;
+}
@@ -0,0 +1,216 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "thread_pool.h"
+
+typedef struct PoolTask {
+    ThreadTask run;
+    void* arg;
+    struct PoolTask* next;
+} PoolTask;
+
+struct ThreadPool {
+    pthread_t* threads;
+    int threadCount;
+
+    pthread_mutex_t lock;
+    pthread_cond_t hasWork;
+    pthread_cond_t idle;
+    PoolTask* head;
+    PoolTask* tail;
+    int active; // tasks queued or running
+    bool stopping;
+};
+
+static void* worker_main(void* arg) {
+    ThreadPool* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->stopping)
+            pthread_cond_wait(&pool->hasWork, &pool->lock);
+        if (!pool->head) break;
+
+        PoolTask* task = pool->head;
+        pool->head = task->next;
+        if (!pool->head) pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        task->run(task->arg);
+        free(task);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0)
+            pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+ThreadPool* thread_pool_create(int threadCount) {
+    if (threadCount <= 0) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = cpus > 0 ? (int) cpus : 1;
+    }
+
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+    pool->threads = calloc(threadCount, sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->hasWork, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < threadCount; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            printf("Failed to start worker thread %d\n", i);
+            break;
+        }
+        pool->threadCount++;
+    }
+
+    if (pool->threadCount == 0) {
+        thread_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static ThreadPool* shared = NULL;
+static pthread_once_t sharedOnce = PTHREAD_ONCE_INIT;
+
+static void create_shared() {
+    shared = thread_pool_create(0);
+}
+
+ThreadPool* thread_pool_shared() {
+    pthread_once(&sharedOnce, create_shared);
+    return shared;
+}
+
+int thread_pool_size(ThreadPool* pool) {
+    return pool ? pool->threadCount : 0;
+}
+
+void thread_pool_submit(ThreadPool* pool, ThreadTask task, void* arg) {
+    PoolTask* t = pool ? malloc(sizeof(PoolTask)) : NULL;
+    if (!t) {
+        // Running inline keeps the caller's completion logic intact.
+        task(arg);
+        return;
+    }
+    t->run = task;
+    t->arg = arg;
+    t->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) pool->tail->next = t;
+    else pool->head = t;
+    pool->tail = t;
+    pool->active++;
+    pthread_cond_signal(&pool->hasWork);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Shared by the caller of thread_pool_parallel_for and its runner tasks. Runners may only get to run after
+ * the caller already finished every item, so the state is reference counted instead of living on its stack.
+ */
+typedef struct {
+    ThreadRangeTask run;
+    void* ctx;
+    int count;
+    _Atomic int next;
+    _Atomic int refs;
+
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int completed;
+} ParallelFor;
+
+static void parallel_release(ParallelFor* pf) {
+    if (atomic_fetch_sub(&pf->refs, 1) != 1) return;
+    pthread_cond_destroy(&pf->done);
+    pthread_mutex_destroy(&pf->lock);
+    free(pf);
+}
+
+static void run_items(ParallelFor* pf) {
+    for (int i = atomic_fetch_add(&pf->next, 1); i < pf->count; i = atomic_fetch_add(&pf->next, 1)) {
+        pf->run(pf->ctx, i);
+
+        pthread_mutex_lock(&pf->lock);
+        if (++pf->completed == pf->count)
+            pthread_cond_signal(&pf->done);
+        pthread_mutex_unlock(&pf->lock);
+    }
+}
+
+static void parallel_runner(void* arg) {
+    run_items(arg);
+    parallel_release(arg);
+}
+
+void thread_pool_parallel_for(ThreadPool* pool, int count, ThreadRangeTask task, void* ctx) {
+    if (count <= 0) return;
+
+    ParallelFor* pf = pool ? malloc(sizeof(ParallelFor)) : NULL;
+    if (!pf) {
+        for (int i = 0; i < count; i++)
+            task(ctx, i);
+        return;
+    }
+    const int runners = count - 1 < pool->threadCount ? count - 1 : pool->threadCount;
+    pf->run = task;
+    pf->ctx = ctx;
+    pf->count = count;
+    pf->completed = 0;
+    atomic_init(&pf->next, 0);
+    atomic_init(&pf->refs, runners + 1);
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->done, NULL);
+
+    // The caller takes items as well, so this also works from inside a pool task without starving.
+    for (int i = 0; i < runners; i++)
+        thread_pool_submit(pool, parallel_runner, pf);
+    run_items(pf);
+
+    pthread_mutex_lock(&pf->lock);
+    while (pf->completed < pf->count)
+        pthread_cond_wait(&pf->done, &pf->lock);
+    pthread_mutex_unlock(&pf->lock);
+    parallel_release(pf);
+}
+
+void thread_pool_wait(ThreadPool* pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_destroy(ThreadPool* pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->hasWork);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->threadCount; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->hasWork);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GLFW/glfw3.h>
+#include "upload_queue.h"
+
+#define DEFAULT_FRAME_BYTES (8 * 1024 * 1024)
+#define DEFAULT_FRAME_MS 2.0
+#define DEFAULT_STAGING_SIZE (32 * 1024 * 1024)
+
+// Drains whose staging memory may still be read by the GPU, it rarely runs further behind than this.
+#define MAX_FRAMES 8
+// Unpack offsets have to be aligned to the component size, 16 covers every type.
+#define STAGING_ALIGNMENT 16
+
+typedef struct Upload {
+    struct Upload* next;
+    bool isTexture;
+    UploadTextureRegion region;
+    GLuint buffer;
+    GLintptr offset;
+    const unsigned char* data;
+    size_t rowBytes;  // staged bytes per row, buffers are one row of size bytes
+    size_t rowPitch;  // bytes between rows of data
+    int rows;
+    size_t size;      // bytes to stage in total
+    size_t staged;    // rows issued for textures, bytes for buffers
+    bool freeData;
+    UploadCallback callback;
+    void* user;
+    double enqueued;
+    uint64_t frame;   // the drain that issued the last part
+} Upload;
+
+typedef struct {
+    GLsync fence;
+    size_t end;   // head of the ring when the drain finished
+    size_t bytes; // allocated by the drain, padding included
+    uint64_t serial;
+} StagingFrame;
+
+typedef struct {
+    GLuint buffer;
+    unsigned char* mapped;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    size_t used;
+    StagingFrame frames[MAX_FRAMES];
+    int firstFrame;
+    int frameCount;
+    size_t frameBytes;
+    uint64_t serial; // of the drain in progress
+} StagingRing;
+
+static UploadBudget budget = {DEFAULT_FRAME_BYTES, DEFAULT_FRAME_MS, DEFAULT_STAGING_SIZE};
+static bool deferred = false;
+static StagingRing ring = {0};
+static Upload* queue_head = NULL;
+static Upload* queue_tail = NULL;
+static Upload* issued_head = NULL;
+static Upload* issued_tail = NULL;
+static UploadQueueStats stats = {0};
+static double latency_sum = 0.0;
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static size_t texel_size(GLenum format, GLenum type) {
+    int channels;
+    switch (format) {
+        case GL_RED: channels = 1; break;
+        case GL_RG: channels = 2; break;
+        case GL_RGB: case GL_BGR: channels = 3; break;
+        case GL_RGBA: case GL_BGRA: channels = 4; break;
+        default: return 0;
+    }
+    switch (type) {
+        case GL_UNSIGNED_BYTE: case GL_BYTE: return channels;
+        case GL_HALF_FLOAT: case GL_UNSIGNED_SHORT: case GL_SHORT: return channels * 2;
+        case GL_FLOAT: case GL_UNSIGNED_INT: case GL_INT: return channels * 4;
+        // Packed types hold every channel in one word.
+        case GL_UNSIGNED_INT_5_9_9_9_REV:
+        case GL_UNSIGNED_INT_10F_11F_11F_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_8_8_8_8_REV: return 4;
+        default: return 0;
+    }
+}
+
+void upload_queue_set_budget(const UploadBudget* newBudget) {
+    budget.bytesPerFrame = newBudget->bytesPerFrame ? newBudget->bytesPerFrame : DEFAULT_FRAME_BYTES;
+    budget.msPerFrame = newBudget->msPerFrame > 0.0 ? newBudget->msPerFrame : DEFAULT_FRAME_MS;
+    if (!ring.buffer) budget.stagingSize = newBudget->stagingSize ? newBudget->stagingSize : DEFAULT_STAGING_SIZE;
+}
+
+void upload_queue_set_deferred(bool enabled) {
+    deferred = enabled;
+}
+
+bool upload_queue_deferred() {
+    return deferred;
+}
+
+static bool ring_init() {
+    if (ring.buffer) return true;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &ring.buffer);
+    glNamedBufferStorage(ring.buffer, (GLsizeiptr) budget.stagingSize, NULL, flags);
+    ring.mapped = glMapNamedBufferRange(ring.buffer, 0, (GLsizeiptr) budget.stagingSize, flags);
+    if (!ring.mapped) {
+        printf("Failed to map the upload staging ring\n");
+        glDeleteBuffers(1, &ring.buffer);
+        ring.buffer = 0;
+        return false;
+    }
+    ring.capacity = budget.stagingSize;
+    return true;
+}
+
+/**
+ * Takes size contiguous bytes from the ring. The free space is [head, tail) once head has wrapped around,
+ * otherwise [head, capacity) and [0, tail).
+ * @return false if the drains in flight still hold too much of it.
+ */
+static bool ring_alloc(size_t size, size_t* offset) {
+    size_t start = align_up(ring.head, STAGING_ALIGNMENT);
+    const bool wrapped = ring.head < ring.tail || (ring.head == ring.tail && ring.used > 0);
+    if (wrapped) {
+        if (start + size > ring.tail) return false;
+    } else if (start + size > ring.capacity) {
+        // The end of the ring is skipped, it counts as used until this drain retires.
+        if (size > ring.tail) return false;
+        start = 0;
+    }
+    const size_t consumed = start >= ring.head ? start + size - ring.head : ring.capacity - ring.head + size;
+    ring.used += consumed;
+    ring.frameBytes += consumed;
+    ring.head = start + size;
+    *offset = start;
+    return true;
+}
+
+static void complete(Upload* upload) {
+    const double latency = (glfwGetTime() - upload->enqueued) * 1e3;
+    stats.inFlight--;
+    stats.completed++;
+    latency_sum += latency;
+    stats.averageLatencyMs = latency_sum / (double) stats.completed;
+    if (latency > stats.maxLatencyMs) stats.maxLatencyMs = latency;
+    if (upload->callback) upload->callback(upload->user);
+    free(upload);
+}
+
+static void retire_frames(bool block) {
+    while (ring.frameCount > 0) {
+        StagingFrame* frame = &ring.frames[ring.firstFrame];
+        const GLenum status = glClientWaitSync(frame->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                               block ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+
+        glDeleteSync(frame->fence);
+        ring.tail = frame->end;
+        ring.used -= frame->bytes;
+        while (issued_head && issued_head->frame <= frame->serial) {
+            Upload* upload = issued_head;
+            issued_head = upload->next;
+            if (!issued_head) issued_tail = NULL;
+            complete(upload);
+        }
+        ring.firstFrame = (ring.firstFrame + 1) % MAX_FRAMES;
+        ring.frameCount--;
+    }
+}
+
+// Takes ownership of upload, and frees it if the copy of the data fails.
+static bool enqueue(Upload* upload, const void* data, UploadDataMode mode) {
+    upload->enqueued = glfwGetTime();
+    upload->data = data;
+    upload->freeData = mode == UPLOAD_DATA_OWNED;
+    if (mode == UPLOAD_DATA_COPY) {
+        // Copied tightly packed, the staging copy reads it row by row all the same.
+        unsigned char* copy = malloc(upload->size);
+        if (!copy) {
+            free(upload);
+            return false;
+        }
+        for (int row = 0; row < upload->rows; row++)
+            memcpy(copy + row * upload->rowBytes, upload->data + row * upload->rowPitch, upload->rowBytes);
+        upload->data = copy;
+        upload->rowPitch = upload->rowBytes;
+        upload->freeData = true;
+    }
+
+    upload->next = NULL;
+    if (queue_tail) queue_tail->next = upload;
+    else queue_head = upload;
+    queue_tail = upload;
+    stats.queued++;
+    stats.queuedBytes += upload->size;
+    return true;
+}
+
+bool upload_queue_texture(const UploadTextureRegion* region, UploadDataMode mode, UploadCallback callback,
+                          void* user) {
+    const size_t texelSize = texel_size(region->format, region->type);
+    // A part is at most half the ring, and never less than a row.
+    if (texelSize == 0 || region->width <= 0 || region->height <= 0 ||
+        (size_t) region->width * texelSize > budget.stagingSize / 2)
+        return false;
+    Upload* upload = calloc(1, sizeof(Upload));
+    if (!upload) return false;
+
+    upload->isTexture = true;
+    upload->region = *region;
+    upload->rowBytes = (size_t) region->width * texelSize;
+    upload->rowPitch = region->rowPitch ? region->rowPitch : upload->rowBytes;
+    upload->rows = region->height;
+    upload->size = upload->rowBytes * region->height;
+    upload->callback = callback;
+    upload->user = user;
+    return enqueue(upload, region->data, mode);
+}
+
+bool upload_queue_buffer(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data, UploadDataMode mode,
+                         UploadCallback callback, void* user) {
+    if (size <= 0) return false;
+    Upload* upload = calloc(1, sizeof(Upload));
+    if (!upload) return false;
+
+    upload->buffer = buffer;
+    upload->offset = offset;
+    upload->rowBytes = (size_t) size;
+    upload->rowPitch = (size_t) size;
+    upload->rows = 1;
+    upload->size = (size_t) size;
+    upload->callback = callback;
+    upload->user = user;
+    return enqueue(upload, data, mode);
+}
+
+/**
+ * Stages and issues the next part of an upload, at most allowance bytes unless a single row is larger.
+ * @return The bytes staged, 0 if the ring is full.
+ */
+static size_t issue_part(Upload* upload, size_t allowance) {
+    size_t offset;
+    if (!upload->isTexture) {
+        size_t bytes = upload->size - upload->staged;
+        if (bytes > allowance) bytes = allowance;
+        if (bytes > ring.capacity / 2) bytes = ring.capacity / 2;
+        if (!ring_alloc(bytes, &offset)) return 0;
+        memcpy(ring.mapped + offset, upload->data + upload->staged, bytes);
+        glCopyNamedBufferSubData(ring.buffer, upload->buffer, (GLintptr) offset,
+                                 upload->offset + (GLintptr) upload->staged, (GLsizeiptr) bytes);
+        upload->staged += bytes;
+        return bytes;
+    }
+
+    const int remaining = upload->rows - (int) upload->staged;
+    size_t rows = allowance / upload->rowBytes;
+    if (rows == 0) rows = 1;
+    if (rows > (size_t) remaining) rows = (size_t) remaining;
+    if (rows * upload->rowBytes > ring.capacity / 2) rows = ring.capacity / 2 / upload->rowBytes;
+    if (rows == 0 || !ring_alloc(rows * upload->rowBytes, &offset)) return 0;
+
+    const unsigned char* src = upload->data + upload->staged * upload->rowPitch;
+    for (size_t row = 0; row < rows; row++)
+        memcpy(ring.mapped + offset + row * upload->rowBytes, src + row * upload->rowPitch, upload->rowBytes);
+
+    const UploadTextureRegion* r = &upload->region;
+    const int y = r->y + (int) upload->staged;
+    if (r->layer >= 0) {
+        glTextureSubImage3D(r->texture, r->level, r->x, y, r->layer, r->width, (GLsizei) rows, 1, r->format, r->type,
+                            (const void*) offset);
+    } else {
+        glTextureSubImage2D(r->texture, r->level, r->x, y, r->width, (GLsizei) rows, r->format, r->type,
+                            (const void*) offset);
+    }
+    upload->staged += rows;
+    return rows * upload->rowBytes;
+}
+
+static bool upload_staged(const Upload* upload) {
+    return upload->staged == (upload->isTexture ? (size_t) upload->rows : upload->size);
+}
+
+static void drain(bool unlimited) {
+    retire_frames(false);
+    if (!queue_head || ring.frameCount == MAX_FRAMES || !ring_init()) return;
+
+    const double start = glfwGetTime();
+    size_t bytes = 0;
+    ring.serial++;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    while (queue_head) {
+        if (!unlimited && (bytes >= budget.bytesPerFrame || (glfwGetTime() - start) * 1e3 >= budget.msPerFrame))
+            break;
+        Upload* upload = queue_head;
+        const size_t allowance = unlimited ? ring.capacity : budget.bytesPerFrame - bytes;
+        const size_t staged = issue_part(upload, allowance);
+        if (staged == 0) {
+            stats.stalls++;
+            break;
+        }
+        bytes += staged;
+        stats.queuedBytes -= staged;
+        if (!upload_staged(upload)) continue;
+
+        queue_head = upload->next;
+        if (!queue_head) queue_tail = NULL;
+        if (upload->freeData) free((void*) upload->data);
+        upload->data = NULL;
+        upload->frame = ring.serial;
+        upload->next = NULL;
+        if (issued_tail) issued_tail->next = upload;
+        else issued_head = upload;
+        issued_tail = upload;
+        stats.queued--;
+        stats.inFlight++;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    stats.lastFrameBytes = bytes;
+    stats.lastFrameMs = (glfwGetTime() - start) * 1e3;
+
+    if (bytes > 0) {
+        const int index = (ring.firstFrame + ring.frameCount) % MAX_FRAMES;
+        ring.frames[index] = (StagingFrame) {
+            glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), ring.head, ring.frameBytes, ring.serial,
+        };
+        ring.frameCount++;
+        ring.frameBytes = 0;
+    }
+}
+
+unsigned int upload_queue_drain() {
+    drain(false);
+    return stats.queued + stats.inFlight;
+}
+
+void upload_queue_finish() {
+    while (queue_head || issued_head) {
+        drain(true);
+        // Nothing staged and nothing left to wait for, the ring could not be created.
+        if (ring.frameCount == 0) break;
+        retire_frames(true);
+    }
+}
+
+UploadQueueStats upload_queue_stats() {
+    return stats;
+}
+
+void upload_queue_shutdown() {
+    upload_queue_finish();
+    if (ring.buffer) {
+        glUnmapNamedBuffer(ring.buffer);
+        glDeleteBuffers(1, &ring.buffer);
+    }
+    memset(&ring, 0, sizeof(ring));
+}
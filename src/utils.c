@@ -12,3 +12,23 @@ void goFullscreen(GLFWwindow* window) {
     glfwSetWindowMonitor(window, monitor, 0, 0, mode->width, mode->height, mode->refreshRate);
     glfwPollEvents();
 }
+
+
+uint64_t hash_fnv1a(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t hash_string(const char* str, uint64_t seed) {
+    uint64_t hash = seed;
+    for (; *str; str++) {
+        hash ^= (unsigned char) *str;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
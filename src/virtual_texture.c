@@ -0,0 +1,682 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "virtual_texture.h"
+#include "gl_state.h"
+#include "hdr_pack.h"
+#include "hdr_reader.h"
+#include "thread_pool.h"
+
+#define VT_MAGIC 0x58455456u // "VTEX"
+#define VT_VERSION 1
+// Tiles start past the header at a page boundary.
+#define VT_DATA_OFFSET 4096
+
+// Feedback buffers in flight, read back this many frames after they were written.
+#define VT_FEEDBACK_FRAMES 3
+// Tile reads in flight on the thread pool, and uploads into the atlas per frame.
+#define VT_MAX_LOADS 16
+#define VT_UPLOADS_PER_FRAME 16
+// Atlas slots per tile that fits on the screen, covering two levels plus the tiles around the edges.
+#define VT_SLOTS_PER_SCREEN_TILE 3
+
+#define TILE_MISSING (-1)
+#define TILE_LOADING (-2)
+#define TILE_FAILED (-3)
+#define SLOT_PINNED UINT32_MAX
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;       // the hdr_pack format of the texels
+    uint32_t imageWidth;
+    uint32_t imageHeight;
+    uint32_t tilesX;       // level 0 grid, powers of two
+    uint32_t tilesY;
+    uint32_t tileSize;
+    uint32_t border;
+    uint32_t levelCount;
+    uint64_t levelFirstTile[VT_MAX_LEVELS];
+    uint64_t tileCount;
+} VtHeader;
+
+typedef enum {
+    LOAD_IDLE,
+    LOAD_READING,
+    LOAD_READ,
+    LOAD_FAILED,
+} LoadState;
+
+// A missing tile asked for by the feedback, with its level so that sorting needs no lookups.
+typedef struct {
+    int tile;
+    int level;
+} WantedTile;
+
+typedef struct {
+    VirtualTexture* vt;
+    int tile;
+    _Atomic int state;
+    void* data;
+} TileLoad;
+
+struct VirtualTexture {
+    int fd;
+    VtHeader header;
+    size_t tileBytes;
+    int slotSize; // texels per slot edge, the tile and its borders
+
+    GLuint pageTable;
+    GLuint atlas;
+    int slotsX;
+    int slotCount;
+    int32_t* slotTile;     // the tile held by each slot, TILE_MISSING when free
+    uint32_t* slotUsed;    // frame the tile was last wanted, SLOT_PINNED for the coarsest level
+    int32_t* tileSlot;     // the slot of each tile, or one of the TILE_ states
+    uint32_t* tileWanted;  // frame the tile was last queued for loading
+    uint8_t* pageEntries;  // RGBA8UI page table texels of every level back to back
+    bool pageDirty;
+
+    GLuint feedback[VT_FEEDBACK_FRAMES];
+    uint32_t* feedbackMapped[VT_FEEDBACK_FRAMES];
+    GLsync feedbackFence[VT_FEEDBACK_FRAMES];
+    size_t feedbackWords;
+    int feedbackIndex;
+    uint32_t frame;
+
+    TileLoad loads[VT_MAX_LOADS];
+    pthread_mutex_t loadLock;
+    pthread_cond_t loadDone; // signaled whenever a read finishes, vt_close waits on it
+    WantedTile* wanted;
+    int wantedCount;
+    VirtualTextureStats stats;
+};
+
+static int level_tiles(uint32_t tiles, int level) {
+    return tiles >> level > 0 ? (int) (tiles >> level) : 1;
+}
+
+static size_t header_tile_bytes(const VtHeader* header) {
+    const size_t slot = header->tileSize + 2 * header->border;
+    return slot * slot * hdr_pack_texel_size(header->format);
+}
+
+// Levels go down to a single tile, each stored row by row after the previous one.
+static void header_layout(VtHeader* header) {
+    const uint32_t tiles = header->tilesX > header->tilesY ? header->tilesX : header->tilesY;
+    header->levelCount = 1;
+    while (tiles >> header->levelCount > 0 && header->levelCount < VT_MAX_LEVELS) header->levelCount++;
+
+    header->tileCount = 0;
+    for (uint32_t level = 0; level < header->levelCount; level++) {
+        header->levelFirstTile[level] = header->tileCount;
+        header->tileCount += (uint64_t) level_tiles(header->tilesX, (int) level) * level_tiles(header->tilesY, (int) level);
+    }
+}
+
+static uint32_t next_power_of_two(uint32_t value) {
+    uint32_t power = 1;
+    while (power < value) power <<= 1;
+    return power;
+}
+
+/*
+ * Tile file building. Each level keeps a band of VT_TILE_SIZE rows plus the border rows above and below it.
+ * Rows of a level arrive top to bottom, a band is cut into tiles once the first border row of the next band is in,
+ * and every pair of rows is averaged into a row of the next level on the way.
+ */
+
+typedef struct {
+    int width;
+    int height;
+    int tilesX;
+    int rowsPushed;
+    int bandY;
+    float* band;
+    float* half; // the row of the next level being accumulated
+} LevelBuild;
+
+typedef struct {
+    VtHeader header;
+    int fd;
+    size_t tileBytes;
+    LevelBuild levels[VT_MAX_LEVELS];
+    float* tileFloats;
+    void* tilePacked;
+    bool ok;
+} TileBuilder;
+
+static float* band_row(const LevelBuild* level, int row) {
+    return level->band + (size_t) row * level->width * 3;
+}
+
+static void emit_band(TileBuilder* b, int levelIndex, int validRows) {
+    LevelBuild* level = &b->levels[levelIndex];
+    const int tile = (int) b->header.tileSize, border = (int) b->header.border, slot = tile + 2 * border;
+    const size_t rowBytes = (size_t) level->width * 3 * sizeof(float);
+    // Past the last row of the level the edge repeats.
+    for (int row = validRows; row < slot; row++)
+        memcpy(band_row(level, row), band_row(level, validRows - 1), rowBytes);
+
+    for (int tx = 0; tx < level->tilesX && b->ok; tx++) {
+        for (int row = 0; row < slot; row++) {
+            const float* src = band_row(level, row);
+            float* dst = b->tileFloats + (size_t) row * slot * 3;
+            for (int i = 0; i < slot; i++) {
+                // Longitude wraps around, which also fills tiles wider than a small level.
+                int x = (tx * tile - border + i) % level->width;
+                if (x < 0) x += level->width;
+                memcpy(dst + i * 3, src + x * 3, 3 * sizeof(float));
+            }
+        }
+        hdr_pack(b->header.format, b->tileFloats, b->tilePacked, (size_t) slot * slot);
+
+        const uint64_t index = b->header.levelFirstTile[levelIndex] + (uint64_t) level->bandY * level->tilesX + tx;
+        const off_t offset = (off_t) (VT_DATA_OFFSET + index * b->tileBytes);
+        if (pwrite(b->fd, b->tilePacked, b->tileBytes, offset) != (ssize_t) b->tileBytes) b->ok = false;
+    }
+}
+
+static void level_push(TileBuilder* b, int levelIndex, const float* row) {
+    LevelBuild* level = &b->levels[levelIndex];
+    const int tile = (int) b->header.tileSize, border = (int) b->header.border;
+    const size_t rowBytes = (size_t) level->width * 3 * sizeof(float);
+    const int y = level->rowsPushed++;
+    const int start = level->bandY * tile - border;
+
+    // Above the first row the edge repeats.
+    if (y == 0) {
+        for (int i = 0; i < border; i++) memcpy(band_row(level, i), row, rowBytes);
+    }
+    memcpy(band_row(level, y - start), row, rowBytes);
+    if (y - start == tile + 2 * border - 1 || y == level->height - 1) {
+        emit_band(b, levelIndex, y - start + 1);
+        memmove(level->band, band_row(level, tile), 2 * border * rowBytes);
+        level->bandY++;
+    }
+
+    if (levelIndex + 1 >= (int) b->header.levelCount) return;
+    LevelBuild* next = &b->levels[levelIndex + 1];
+    const float weight = level->height > 1 ? 0.25f : 0.5f;
+    const int step = level->width > 1 ? 3 : 0;
+    const bool first = (y & 1) == 0;
+    for (int x = 0; x < next->width; x++) {
+        const float* src = row + (size_t) x * 6;
+        for (int c = 0; c < 3; c++) {
+            const float value = weight * (src[c] + src[step + c]);
+            next->half[x * 3 + c] = first ? value : next->half[x * 3 + c] + value;
+        }
+    }
+    if (level->height == 1 || !first) level_push(b, levelIndex + 1, next->half);
+}
+
+static void builder_free(TileBuilder* b) {
+    for (int i = 0; i < VT_MAX_LEVELS; i++) {
+        free(b->levels[i].band);
+        free(b->levels[i].half);
+    }
+    free(b->tileFloats);
+    free(b->tilePacked);
+}
+
+bool vt_build_from_hdr(const char* hdrPath, const char* tilePath, GLenum format) {
+    if (!hdr_pack_supported(format)) return false;
+    HdrReader* reader = hdr_reader_open(hdrPath);
+    if (!reader) return false;
+    const int width = hdr_reader_width(reader), height = hdr_reader_height(reader);
+
+    TileBuilder b = {0};
+    b.header = (VtHeader) {
+        .magic = VT_MAGIC,
+        .version = VT_VERSION,
+        .format = format,
+        .imageWidth = (uint32_t) width,
+        .imageHeight = (uint32_t) height,
+        .tilesX = next_power_of_two((uint32_t) (width + VT_TILE_SIZE - 1) / VT_TILE_SIZE),
+        .tilesY = next_power_of_two((uint32_t) (height + VT_TILE_SIZE - 1) / VT_TILE_SIZE),
+        .tileSize = VT_TILE_SIZE,
+        .border = VT_TILE_BORDER,
+    };
+    header_layout(&b.header);
+    b.tileBytes = header_tile_bytes(&b.header);
+    b.ok = true;
+
+    const int slot = VT_TILE_SIZE + 2 * VT_TILE_BORDER;
+    const int virtualWidth = (int) b.header.tilesX * VT_TILE_SIZE, virtualHeight = (int) b.header.tilesY * VT_TILE_SIZE;
+    bool allocated = (b.tileFloats = malloc((size_t) slot * slot * 3 * sizeof(float))) &&
+                     (b.tilePacked = malloc(b.tileBytes));
+    for (int i = 0; i < (int) b.header.levelCount && allocated; i++) {
+        LevelBuild* level = &b.levels[i];
+        level->width = virtualWidth >> i > 0 ? virtualWidth >> i : 1;
+        level->height = virtualHeight >> i > 0 ? virtualHeight >> i : 1;
+        level->tilesX = level_tiles(b.header.tilesX, i);
+        level->band = malloc((size_t) slot * level->width * 3 * sizeof(float));
+        level->half = malloc((size_t) level->width * 3 * sizeof(float));
+        allocated = level->band && level->half;
+    }
+
+    char tmpPath[1024];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", tilePath);
+    b.fd = allocated ? open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if (b.fd < 0) {
+        printf("Failed to create %s\n", allocated ? tmpPath : "tile builder buffers");
+        builder_free(&b);
+        hdr_reader_close(reader);
+        return false;
+    }
+
+    // Rows and columns past the image repeat its last ones up to whole tiles.
+    float* row = b.levels[0].half ? malloc((size_t) virtualWidth * 3 * sizeof(float)) : NULL;
+    b.ok = row != NULL;
+    for (int y = 0; y < virtualHeight && b.ok; y++) {
+        if (y < height && !hdr_reader_read_rows(reader, GL_RGB32F, row, 1)) {
+            printf("Failed to read %s at row %d\n", hdrPath, y);
+            b.ok = false;
+            break;
+        }
+        for (int x = width; x < virtualWidth; x++) memcpy(row + x * 3, row + (width - 1) * 3, 3 * sizeof(float));
+        level_push(&b, 0, row);
+    }
+    free(row);
+    hdr_reader_close(reader);
+
+    b.ok = b.ok && pwrite(b.fd, &b.header, sizeof(b.header), 0) == (ssize_t) sizeof(b.header);
+    b.ok = close(b.fd) == 0 && b.ok;
+    builder_free(&b);
+    if (b.ok) b.ok = rename(tmpPath, tilePath) == 0;
+    if (!b.ok) {
+        printf("Failed to write %s\n", tilePath);
+        remove(tmpPath);
+    }
+    return b.ok;
+}
+
+/*
+ * Runtime.
+ */
+
+static int tile_level(const VirtualTexture* vt, int tile) {
+    int level = 0;
+    while (level + 1 < (int) vt->header.levelCount && (uint64_t) tile >= vt->header.levelFirstTile[level + 1]) level++;
+    return level;
+}
+
+static int tile_parent(const VirtualTexture* vt, int tile) {
+    const int level = tile_level(vt, tile);
+    if (level + 1 >= (int) vt->header.levelCount) return -1;
+    const int local = tile - (int) vt->header.levelFirstTile[level];
+    const int tilesX = level_tiles(vt->header.tilesX, level);
+    const int x = local % tilesX, y = local / tilesX;
+    return (int) vt->header.levelFirstTile[level + 1] + (y >> 1) * level_tiles(vt->header.tilesX, level + 1) + (x >> 1);
+}
+
+static bool read_tile_data(const VirtualTexture* vt, int tile, void* data) {
+    const off_t offset = (off_t) (VT_DATA_OFFSET + (uint64_t) tile * vt->tileBytes);
+    return pread(vt->fd, data, vt->tileBytes, offset) == (ssize_t) vt->tileBytes;
+}
+
+static void read_tile(void* arg) {
+    TileLoad* load = arg;
+    VirtualTexture* vt = load->vt;
+    const bool ok = read_tile_data(vt, load->tile, load->data);
+    // Published under the lock, so vt_close cannot see the read finished and free vt before this unlocks.
+    pthread_mutex_lock(&vt->loadLock);
+    atomic_store_explicit(&load->state, ok ? LOAD_READ : LOAD_FAILED, memory_order_release);
+    pthread_cond_broadcast(&vt->loadDone);
+    pthread_mutex_unlock(&vt->loadLock);
+}
+
+static bool loads_reading(VirtualTexture* vt) {
+    for (int i = 0; i < VT_MAX_LOADS; i++) {
+        if (atomic_load_explicit(&vt->loads[i].state, memory_order_acquire) == LOAD_READING) return true;
+    }
+    return false;
+}
+
+static void upload_tile(VirtualTexture* vt, int slot, const void* data) {
+    GLenum format, type;
+    hdr_pack_upload_format(vt->header.format, &format, &type);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTextureSubImage2D(vt->atlas, 0, slot % vt->slotsX * vt->slotSize, slot / vt->slotsX * vt->slotSize,
+                        vt->slotSize, vt->slotSize, format, type, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+static void place_tile(VirtualTexture* vt, int tile, int slot, uint32_t used) {
+    vt->slotTile[slot] = tile;
+    vt->slotUsed[slot] = used;
+    vt->tileSlot[tile] = slot;
+    vt->stats.residentTiles++;
+    vt->pageDirty = true;
+}
+
+/**
+ * A free slot, or the one whose tile was wanted least recently.
+ * @return -1 if every tile was wanted by the latest feedback, evicting one of those would only thrash.
+ */
+static int claim_slot(VirtualTexture* vt) {
+    int victim = -1;
+    for (int slot = 0; slot < vt->slotCount; slot++) {
+        if (vt->slotTile[slot] == TILE_MISSING) return slot;
+        if (vt->slotUsed[slot] != SLOT_PINNED && (victim < 0 || vt->slotUsed[slot] < vt->slotUsed[victim]))
+            victim = slot;
+    }
+    if (victim < 0 || vt->slotUsed[victim] + 1 >= vt->frame) return -1;
+
+    vt->tileSlot[vt->slotTile[victim]] = TILE_MISSING;
+    vt->slotTile[victim] = TILE_MISSING;
+    vt->stats.residentTiles--;
+    vt->stats.evictions++;
+    vt->pageDirty = true;
+    return victim;
+}
+
+// A missing tile points at its nearest resident ancestor, the shader rescales into it.
+static void upload_page_table(VirtualTexture* vt) {
+    for (int level = (int) vt->header.levelCount - 1; level >= 0; level--) {
+        const int tilesX = level_tiles(vt->header.tilesX, level), tilesY = level_tiles(vt->header.tilesY, level);
+        const int first = (int) vt->header.levelFirstTile[level];
+        for (int y = 0; y < tilesY; y++) {
+            for (int x = 0; x < tilesX; x++) {
+                const int tile = first + y * tilesX + x;
+                uint8_t* entry = vt->pageEntries + (size_t) tile * 4;
+                const int slot = vt->tileSlot[tile];
+                if (slot >= 0) {
+                    entry[0] = (uint8_t) (slot % vt->slotsX);
+                    entry[1] = (uint8_t) (slot / vt->slotsX);
+                    entry[2] = (uint8_t) level;
+                    entry[3] = 255;
+                } else if (level + 1 < (int) vt->header.levelCount) {
+                    const int parent = (int) vt->header.levelFirstTile[level + 1] +
+                                       (y >> 1) * level_tiles(vt->header.tilesX, level + 1) + (x >> 1);
+                    memcpy(entry, vt->pageEntries + (size_t) parent * 4, 4);
+                } else {
+                    memset(entry, 0, 4);
+                }
+            }
+        }
+        glTextureSubImage2D(vt->pageTable, level, 0, 0, tilesX, tilesY, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                            vt->pageEntries + (size_t) first * 4);
+    }
+    vt->pageDirty = false;
+}
+
+// Marks the tile and its ancestors as used, and queues the missing ones.
+static void want_tile(VirtualTexture* vt, int tile) {
+    for (; tile >= 0; tile = tile_parent(vt, tile)) {
+        const int slot = vt->tileSlot[tile];
+        if (slot >= 0) {
+            if (vt->slotUsed[slot] != SLOT_PINNED) vt->slotUsed[slot] = vt->frame;
+        } else if (slot == TILE_MISSING && vt->tileWanted[tile] != vt->frame) {
+            vt->wanted[vt->wantedCount++] = (WantedTile) {tile, tile_level(vt, tile)};
+        }
+        if (vt->tileWanted[tile] == vt->frame) return;
+        vt->tileWanted[tile] = vt->frame;
+    }
+}
+
+static void read_feedback(VirtualTexture* vt, uint32_t* bits) {
+    vt->wantedCount = 0;
+    vt->stats.requestedTiles = 0;
+    for (size_t word = 0; word < vt->feedbackWords; word++) {
+        uint32_t value = bits[word];
+        if (!value) continue;
+        bits[word] = 0;
+        while (value) {
+            const int tile = (int) (word * 32) + __builtin_ctz(value);
+            value &= value - 1;
+            if ((uint64_t) tile >= vt->header.tileCount) continue;
+            vt->stats.requestedTiles++;
+            want_tile(vt, tile);
+        }
+    }
+}
+
+// Coarse levels first, they are the fallback of everything below them.
+static int compare_wanted(const void* a, const void* b) {
+    return ((const WantedTile*) b)->level - ((const WantedTile*) a)->level;
+}
+
+static void start_loads(VirtualTexture* vt) {
+    qsort(vt->wanted, vt->wantedCount, sizeof(WantedTile), compare_wanted);
+
+    int next = 0;
+    for (int i = 0; i < VT_MAX_LOADS && next < vt->wantedCount; i++) {
+        TileLoad* load = &vt->loads[i];
+        if (atomic_load_explicit(&load->state, memory_order_acquire) != LOAD_IDLE) continue;
+        while (next < vt->wantedCount && vt->tileSlot[vt->wanted[next].tile] != TILE_MISSING) next++;
+        if (next == vt->wantedCount) break;
+
+        load->tile = vt->wanted[next++].tile;
+        vt->tileSlot[load->tile] = TILE_LOADING;
+        vt->stats.loadsInFlight++;
+        atomic_store_explicit(&load->state, LOAD_READING, memory_order_relaxed);
+        thread_pool_submit(thread_pool_shared(), read_tile, load);
+    }
+    // What did not fit is asked for again by the next feedback.
+    vt->wantedCount = 0;
+}
+
+static void finish_loads(VirtualTexture* vt) {
+    int uploads = 0;
+    for (int i = 0; i < VT_MAX_LOADS && uploads < VT_UPLOADS_PER_FRAME; i++) {
+        TileLoad* load = &vt->loads[i];
+        const int state = atomic_load_explicit(&load->state, memory_order_acquire);
+        if (state != LOAD_READ && state != LOAD_FAILED) continue;
+
+        const int slot = state == LOAD_READ ? claim_slot(vt) : -1;
+        if (slot >= 0) {
+            upload_tile(vt, slot, load->data);
+            place_tile(vt, load->tile, slot, vt->frame);
+            vt->stats.loads++;
+            uploads++;
+        } else {
+            vt->tileSlot[load->tile] = state == LOAD_FAILED ? TILE_FAILED : TILE_MISSING;
+        }
+        vt->stats.loadsInFlight--;
+        atomic_store_explicit(&load->state, LOAD_IDLE, memory_order_relaxed);
+    }
+}
+
+static bool open_header(VirtualTexture* vt, const char* tilePath) {
+    vt->fd = open(tilePath, O_RDONLY);
+    if (vt->fd < 0) return false;
+
+    struct stat st;
+    VtHeader* h = &vt->header;
+    if (fstat(vt->fd, &st) != 0 || pread(vt->fd, h, sizeof(*h), 0) != (ssize_t) sizeof(*h)) return false;
+    if (h->magic != VT_MAGIC || h->version != VT_VERSION || !hdr_pack_supported(h->format)) return false;
+    if (h->tileSize == 0 || h->tileSize > 1024 || h->border > 8 || h->tilesX == 0 || h->tilesY == 0 ||
+        h->tilesX > 4096 || h->tilesY > 4096)
+        return false;
+
+    // The layout is derived again rather than trusted.
+    VtHeader expected = *h;
+    header_layout(&expected);
+    if (memcmp(&expected, h, sizeof(expected)) != 0) return false;
+    vt->tileBytes = header_tile_bytes(h);
+    return (uint64_t) st.st_size >= VT_DATA_OFFSET + h->tileCount * vt->tileBytes;
+}
+
+VirtualTexture* vt_open(const char* tilePath, int screenWidth, int screenHeight) {
+    VirtualTexture* vt = calloc(1, sizeof(VirtualTexture));
+    if (!vt) return NULL;
+    if (!open_header(vt, tilePath)) {
+        printf("Failed to open virtual texture %s\n", tilePath);
+        if (vt->fd >= 0) close(vt->fd);
+        free(vt);
+        return NULL;
+    }
+    pthread_mutex_init(&vt->loadLock, NULL);
+    pthread_cond_init(&vt->loadDone, NULL);
+    const VtHeader* h = &vt->header;
+    const int tileCount = (int) h->tileCount;
+    vt->slotSize = (int) (h->tileSize + 2 * h->border);
+
+    // Enough slots to cover the screen a few times over, the page table addresses at most 256 x 256.
+    GLint maxSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    const int maxSlots = maxSize / vt->slotSize < 256 ? maxSize / vt->slotSize : 256;
+    const int screenTiles = (screenWidth / (int) h->tileSize + 2) * (screenHeight / (int) h->tileSize + 2);
+    int slots = screenTiles * VT_SLOTS_PER_SCREEN_TILE;
+    if (slots > tileCount) slots = tileCount;
+    vt->slotsX = 1;
+    while (vt->slotsX * vt->slotsX < slots) vt->slotsX++;
+    if (vt->slotsX > maxSlots) vt->slotsX = maxSlots;
+    int slotsY = (slots + vt->slotsX - 1) / vt->slotsX;
+    if (slotsY > maxSlots) slotsY = maxSlots;
+    vt->slotCount = vt->slotsX * slotsY;
+
+    vt->feedbackWords = (size_t) (tileCount + 31) / 32;
+    vt->slotTile = malloc(vt->slotCount * sizeof(int32_t));
+    vt->slotUsed = calloc(vt->slotCount, sizeof(uint32_t));
+    vt->tileSlot = malloc(tileCount * sizeof(int32_t));
+    vt->tileWanted = calloc(tileCount, sizeof(uint32_t));
+    vt->pageEntries = calloc(tileCount, 4);
+    vt->wanted = malloc(tileCount * sizeof(WantedTile));
+    bool ok = vt->slotTile && vt->slotUsed && vt->tileSlot && vt->tileWanted && vt->pageEntries && vt->wanted;
+    for (int i = 0; i < VT_MAX_LOADS && ok; i++) {
+        vt->loads[i].vt = vt;
+        atomic_init(&vt->loads[i].state, LOAD_IDLE);
+        ok = (vt->loads[i].data = malloc(vt->tileBytes)) != NULL;
+    }
+    if (!ok) {
+        printf("Out of memory opening virtual texture %s\n", tilePath);
+        vt_close(vt);
+        return NULL;
+    }
+    for (int i = 0; i < vt->slotCount; i++) vt->slotTile[i] = TILE_MISSING;
+    for (int i = 0; i < tileCount; i++) vt->tileSlot[i] = TILE_MISSING;
+    vt->frame = 1;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &vt->atlas);
+    glTextureStorage2D(vt->atlas, 1, h->format, vt->slotsX * vt->slotSize, slotsY * vt->slotSize);
+    glTextureParameteri(vt->atlas, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(vt->atlas, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(vt->atlas, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(vt->atlas, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Integer textures are only complete with nearest filtering.
+    glCreateTextures(GL_TEXTURE_2D, 1, &vt->pageTable);
+    glTextureStorage2D(vt->pageTable, (GLsizei) h->levelCount, GL_RGBA8UI, (GLsizei) h->tilesX, (GLsizei) h->tilesY);
+    glTextureParameteri(vt->pageTable, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(vt->pageTable, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const GLsizeiptr feedbackSize = (GLsizeiptr) (vt->feedbackWords * sizeof(uint32_t));
+    for (int i = 0; i < VT_FEEDBACK_FRAMES; i++) {
+        glCreateBuffers(1, &vt->feedback[i]);
+        glNamedBufferStorage(vt->feedback[i], feedbackSize, NULL, flags);
+        vt->feedbackMapped[i] = glMapNamedBufferRange(vt->feedback[i], 0, feedbackSize, flags);
+        if (!vt->feedbackMapped[i]) {
+            printf("Failed to map the feedback buffer of %s\n", tilePath);
+            vt_close(vt);
+            return NULL;
+        }
+        memset(vt->feedbackMapped[i], 0, feedbackSize);
+    }
+
+    // The coarsest tile is the fallback of every other one, it never leaves.
+    const int root = (int) h->levelFirstTile[h->levelCount - 1];
+    if (!read_tile_data(vt, root, vt->loads[0].data)) {
+        printf("Failed to read virtual texture %s\n", tilePath);
+        vt_close(vt);
+        return NULL;
+    }
+    upload_tile(vt, 0, vt->loads[0].data);
+    place_tile(vt, root, 0, SLOT_PINNED);
+    upload_page_table(vt);
+
+    vt->stats.levelCount = (int) h->levelCount;
+    vt->stats.tileCount = tileCount;
+    vt->stats.slotCount = vt->slotCount;
+    vt->stats.atlasBytes = (size_t) vt->slotCount * vt->slotSize * vt->slotSize * hdr_pack_texel_size(h->format);
+    return vt;
+}
+
+void vt_bind(VirtualTexture* vt, Shader shader, GLuint firstUnit) {
+    gl_state_bind_texture_unit(firstUnit, GL_TEXTURE_2D, vt->pageTable);
+    gl_state_bind_texture_unit(firstUnit + 1, GL_TEXTURE_2D, vt->atlas);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VT_FEEDBACK_BINDING, vt->feedback[vt->feedbackIndex]);
+
+    const VtHeader* h = &vt->header;
+    const float width = (float) (h->tilesX * h->tileSize), height = (float) (h->tilesY * h->tileSize);
+    shader_u1i(shader, "vtPageTable", (int) firstUnit);
+    shader_u1i(shader, "vtAtlas", (int) firstUnit + 1);
+    shader_u2f(shader, "vtSize", width, height);
+    shader_u2f(shader, "vtImageScale", (float) h->imageWidth / width, (float) h->imageHeight / height);
+    shader_u1i(shader, "vtTileSize", (int) h->tileSize);
+    shader_u1i(shader, "vtBorder", (int) h->border);
+    shader_u1i(shader, "vtLevels", (int) h->levelCount);
+    shader_u1i(shader, "vtFrame", (int) (vt->frame & 0x7FFFFFFF));
+}
+
+void vt_update(VirtualTexture* vt) {
+    // Shader writes have to reach the persistent mapping before the fence.
+    glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    const int written = vt->feedbackIndex;
+    if (vt->feedbackFence[written]) glDeleteSync(vt->feedbackFence[written]);
+    vt->feedbackFence[written] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    vt->feedbackIndex = (written + 1) % VT_FEEDBACK_FRAMES;
+    vt->frame++;
+
+    // The buffer bound next is the oldest. If the GPU is still on it its bits simply pile up until the next round.
+    const int oldest = vt->feedbackIndex;
+    GLsync fence = vt->feedbackFence[oldest];
+    if (fence) {
+        const GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            glDeleteSync(fence);
+            vt->feedbackFence[oldest] = NULL;
+            read_feedback(vt, vt->feedbackMapped[oldest]);
+        }
+    }
+
+    finish_loads(vt);
+    start_loads(vt);
+    if (vt->pageDirty) upload_page_table(vt);
+}
+
+VirtualTextureStats vt_stats(const VirtualTexture* vt) {
+    return vt->stats;
+}
+
+void vt_close(VirtualTexture* vt) {
+    if (!vt) return;
+    // Reads in flight write into the load buffers. Only this texture's reads are waited for, the shared pool may
+    // be busy with anything else.
+    pthread_mutex_lock(&vt->loadLock);
+    while (loads_reading(vt))
+        pthread_cond_wait(&vt->loadDone, &vt->loadLock);
+    pthread_mutex_unlock(&vt->loadLock);
+    pthread_mutex_destroy(&vt->loadLock);
+    pthread_cond_destroy(&vt->loadDone);
+
+    for (int i = 0; i < VT_FEEDBACK_FRAMES; i++) {
+        if (vt->feedbackMapped[i]) glUnmapNamedBuffer(vt->feedback[i]);
+        if (vt->feedback[i]) glDeleteBuffers(1, &vt->feedback[i]);
+        if (vt->feedbackFence[i]) glDeleteSync(vt->feedbackFence[i]);
+    }
+    if (vt->pageTable) {
+        gl_state_forget_texture(vt->pageTable);
+        glDeleteTextures(1, &vt->pageTable);
+    }
+    if (vt->atlas) {
+        gl_state_forget_texture(vt->atlas);
+        glDeleteTextures(1, &vt->atlas);
+    }
+    for (int i = 0; i < VT_MAX_LOADS; i++) free(vt->loads[i].data);
+    free(vt->slotTile);
+    free(vt->slotUsed);
+    free(vt->tileSlot);
+    free(vt->tileWanted);
+    free(vt->pageEntries);
+    free(vt->wanted);
+    close(vt->fd);
+    free(vt);
+}